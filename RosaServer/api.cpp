@@ -6,9 +6,14 @@
 #include <chrono>
 #include <filesystem>
 #include <limits>
+#include <unordered_map>
 
 #include "console.h"
 #include "engine.h"
+#include "mpscqueue.h"
+#include "netstats.h"
+#include "roadgraph.h"
+#include "threadpool.h"
 
 bool initialized = false;
 bool shouldReset = false;
@@ -64,14 +69,18 @@ void hookAndReset(int reason) {
 				subhook::ScopedHookRemove remove(&Hooks::resetGameHook);
 				Engine::resetGame();
 			}
+			RoadGraph::rebuild();
 			if (Hooks::run != sol::nil) {
 				auto res = Hooks::run("PostResetGame", reason);
 				noLuaCallError(&res);
 			}
 		}
 	} else {
-		subhook::ScopedHookRemove remove(&Hooks::resetGameHook);
-		Engine::resetGame();
+		{
+			subhook::ScopedHookRemove remove(&Hooks::resetGameHook);
+			Engine::resetGame();
+		}
+		RoadGraph::rebuild();
 	}
 }
 
@@ -182,6 +191,156 @@ sol::object http::postSync(const char* scheme, const char* path,
 	return handleSyncHTTPResponse(res, s);
 }
 
+static constexpr unsigned int numHTTPThreads = 4;
+
+static MPSCQueue<LuaHTTPResponse> httpResponses;
+static std::unordered_map<unsigned int, sol::protected_function>
+    httpCallbacks;
+static unsigned int httpNumInFlight = 0;
+static unsigned int httpNextRequestID = 0;
+
+static ThreadPool& getHTTPPool() {
+	// Leaked so a hanging request can't block process exit
+	static ThreadPool* pool = new ThreadPool(numHTTPThreads);
+	return *pool;
+}
+
+httplib::Headers http::headersFromTable(sol::table headers) {
+	httplib::Headers httpHeaders;
+	for (const auto& pair : headers)
+		httpHeaders.emplace(pair.first.as<std::string>(),
+		                    pair.second.as<std::string>());
+	return httpHeaders;
+}
+
+void http::performRequest(httplib::Client& client,
+                          const LuaHTTPRequest& request,
+                          LuaHTTPResponse& response) {
+	try {
+		auto res = request.type == LuaRequestType::get
+		               ? client.Get(request.path, request.headers)
+		               : client.Post(request.path, request.headers, request.body,
+		                             request.contentType);
+
+		if (res) {
+			response.responded = true;
+			response.status = res->status;
+			response.body = std::move(res->body);
+			response.headers = std::move(res->headers);
+		} else {
+			response.error = "Request failed (error " +
+			                 std::to_string(static_cast<int>(res.error())) + ")";
+		}
+	} catch (const std::exception& e) {
+		response.error = e.what();
+	}
+}
+
+sol::table http::createResponseTable(sol::state_view lua,
+                                     LuaHTTPResponse& response) {
+	sol::table table = lua.create_table();
+	table["status"] = response.status;
+	table["body"] = std::move(response.body);
+
+	sol::table headers = lua.create_table();
+	for (const auto& h : response.headers) headers[h.first] = h.second;
+	table["headers"] = headers;
+
+	return table;
+}
+
+bool http::queueRequest(RequestJob job, sol::protected_function callback) {
+	if (httpNumInFlight >= maxHTTPRequestsInFlight) {
+		return false;
+	}
+
+	auto id = httpNextRequestID++;
+	httpCallbacks.emplace(id, std::move(callback));
+	httpNumInFlight++;
+
+	getHTTPPool().push([id, job = std::move(job)] {
+		LuaHTTPResponse response{id, false};
+		job(response);
+		httpResponses.push(std::move(response));
+	});
+	return true;
+}
+
+static bool queueHTTPRequest(LuaHTTPRequest request, sol::table headers,
+                             sol::protected_function callback) {
+	request.headers = http::headersFromTable(headers);
+	request.headers.emplace("Connection", "close");
+
+	return http::queueRequest(
+	    [request = std::move(request)](LuaHTTPResponse& response) {
+		    httplib::Client client(request.scheme);
+		    client.set_connection_timeout(request.timeoutSeconds);
+		    client.set_read_timeout(request.timeoutSeconds);
+		    client.set_write_timeout(request.timeoutSeconds);
+		    client.set_keep_alive(false);
+		    client.set_follow_location(true);
+
+		    http::performRequest(client, request, response);
+	    },
+	    std::move(callback));
+}
+
+bool http::get(const char* scheme, const char* path, sol::table headers,
+               sol::protected_function callback,
+               sol::optional<time_t> timeout) {
+	LuaHTTPRequest request{};
+	request.type = LuaRequestType::get;
+	request.scheme = scheme;
+	request.path = path;
+	request.timeoutSeconds = timeout.value_or(defaultHTTPTimeoutSeconds);
+
+	return queueHTTPRequest(std::move(request), headers, std::move(callback));
+}
+
+bool http::post(const char* scheme, const char* path, sol::table headers,
+                std::string body, const char* contentType,
+                sol::protected_function callback,
+                sol::optional<time_t> timeout) {
+	LuaHTTPRequest request{};
+	request.type = LuaRequestType::post;
+	request.scheme = scheme;
+	request.path = path;
+	request.body = std::move(body);
+	request.contentType = contentType;
+	request.timeoutSeconds = timeout.value_or(defaultHTTPTimeoutSeconds);
+
+	return queueHTTPRequest(std::move(request), headers, std::move(callback));
+}
+
+unsigned int http::getNumInFlight() { return httpNumInFlight; }
+
+// Called at the start of every logic tick on the main thread.
+void http::processResponses() {
+	LuaHTTPResponse response;
+	while (httpResponses.pop(response)) {
+		httpNumInFlight--;
+
+		auto search = httpCallbacks.find(response.id);
+		if (search == httpCallbacks.end()) {
+			// Requested by a Lua state that has since been reset
+			continue;
+		}
+
+		auto callback = std::move(search->second);
+		httpCallbacks.erase(search);
+
+		if (response.responded) {
+			auto res = callback(createResponseTable(*lua, response));
+			noLuaCallError(&res);
+		} else {
+			auto res = callback(sol::nil, response.error);
+			noLuaCallError(&res);
+		}
+	}
+}
+
+void http::clearCallbacks() { httpCallbacks.clear(); }
+
 static inline std::string withoutPostPrefix(std::string name) {
 	if (name.rfind("Post", 0) == 0) {
 		return name.substr(4);
@@ -1346,6 +1505,37 @@ bool Connection::hasReceivedEvent(Event* event) const {
 	return numReceivedEvents >= numEventsUpToThis;
 }
 
+uint64_t Connection::getBytesSent() const {
+	auto stats = NetStats::find(address, port);
+	return stats ? stats->bytesSent : 0;
+}
+
+uint64_t Connection::getPacketsSent() const {
+	auto stats = NetStats::find(address, port);
+	return stats ? stats->packetsSent : 0;
+}
+
+double Connection::getBytesPerSecond() const {
+	auto stats = NetStats::find(address, port);
+	return stats ? stats->bytesPerSecond : 0;
+}
+
+// Packet type -> number of packets of that type sent to this connection
+sol::table Connection::getPacketTypeCounts() const {
+	auto table = lua->create_table();
+
+	auto stats = NetStats::find(address, port);
+	if (stats) {
+		for (int i = 0; i < numPacketTypes; i++) {
+			if (stats->packetsSentByType[i]) {
+				table[i] = stats->packetsSentByType[i];
+			}
+		}
+	}
+
+	return table;
+}
+
 std::string Account::__tostring() const {
 	char buf[32];
 	sprintf(buf, "Account(%i)", getIndex());
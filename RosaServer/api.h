@@ -1,4 +1,5 @@
 #pragma once
+#include <functional>
 #include <memory>
 #include <mutex>
 #include <queue>
@@ -36,22 +37,28 @@ extern sol::table* bodyDataTables[maxNumberOfRigidBodies];
 
 enum LuaRequestType { get, post };
 
+static constexpr unsigned int maxHTTPRequestsInFlight = 64;
+static constexpr unsigned int defaultHTTPTimeoutSeconds = 6;
+
+// Responses cross threads, so they only carry an ID; the Lua callback stays
+// on the main thread until the response comes back.
 struct LuaHTTPRequest {
 	LuaRequestType type;
 	std::string scheme;
 	std::string path;
-	std::shared_ptr<sol::protected_function> callback;
 	std::string contentType;
 	std::string body;
 	httplib::Headers headers;
+	time_t timeoutSeconds;
 };
 
 struct LuaHTTPResponse {
-	std::shared_ptr<sol::protected_function> callback;
+	unsigned int id;
 	bool responded;
 	int status;
 	std::string body;
 	httplib::Headers headers;
+	std::string error;
 };
 
 extern std::mutex stateResetMutex;
@@ -80,6 +87,23 @@ sol::object getSync(const char* scheme, const char* path, sol::table headers,
 sol::object postSync(const char* scheme, const char* path, sol::table headers,
                      std::string body, const char* contentType,
                      sol::this_state s);
+bool get(const char* scheme, const char* path, sol::table headers,
+         sol::protected_function callback, sol::optional<time_t> timeout);
+bool post(const char* scheme, const char* path, sol::table headers,
+          std::string body, const char* contentType,
+          sol::protected_function callback, sol::optional<time_t> timeout);
+unsigned int getNumInFlight();
+void processResponses();
+
+// Runs on an HTTP pool thread and fills in the response
+using RequestJob = std::function<void(LuaHTTPResponse&)>;
+
+httplib::Headers headersFromTable(sol::table headers);
+void performRequest(httplib::Client& client, const LuaHTTPRequest& request,
+                    LuaHTTPResponse& response);
+sol::table createResponseTable(sol::state_view lua, LuaHTTPResponse& response);
+bool queueRequest(RequestJob job, sol::protected_function callback);
+void clearCallbacks();
 };  // namespace http
 
 namespace hook {
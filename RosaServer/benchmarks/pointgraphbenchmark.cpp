@@ -0,0 +1,217 @@
+// Compares PointGraph::findPath against the hash map based A* it replaced, on
+// a grid shaped like a large city navmesh, before and after freezing and with
+// landmarks.
+//
+// Usage: pointgraphbenchmark [gridWidth] [numQueries] [numLandmarks]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <limits>
+#include <queue>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "../pointgraph.h"
+
+static constexpr int nodeSpacing = 16;
+
+struct LegacyNode {
+	NodePoint point;
+	std::vector<Link> links;
+};
+
+static double getLegacyHeuristicScore(const LegacyNode& node,
+                                      const LegacyNode& goalNode) {
+	const int deltaX = goalNode.point.x - node.point.x;
+	const int deltaY = goalNode.point.y - node.point.y;
+	const int deltaZ = goalNode.point.z - node.point.z;
+	return deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ;
+}
+
+// The previous implementation, minus the Lua conversion
+static bool legacyFindPath(const std::vector<LegacyNode>& nodes,
+                           unsigned int startNodeId, unsigned int goalNodeId,
+                           std::vector<unsigned int>& path) {
+	std::unordered_map<unsigned int, double> gScores;
+	gScores.insert({startNodeId, 0.});
+
+	auto compare = [&gScores](unsigned int a, unsigned int b) -> bool {
+		return gScores.at(a) > gScores.at(b);
+	};
+
+	std::priority_queue<unsigned int, std::vector<unsigned int>,
+	                    decltype(compare)>
+	    openSet(compare);
+	openSet.push(startNodeId);
+
+	std::unordered_map<unsigned int, unsigned int> cameFrom;
+	std::unordered_map<unsigned int, double> fScores;
+	std::unordered_set<unsigned int> hasVisited;
+
+	while (!openSet.empty()) {
+		const unsigned int currentNodeId = openSet.top();
+		if (currentNodeId == goalNodeId) {
+			path = {currentNodeId};
+			unsigned int node = currentNodeId;
+			while (true) {
+				const auto search = cameFrom.find(node);
+				if (search == cameFrom.end()) break;
+				node = search->second;
+				path.insert(path.begin(), node);
+			}
+			return true;
+		}
+		openSet.pop();
+
+		if (hasVisited.count(currentNodeId)) continue;
+		hasVisited.insert(currentNodeId);
+
+		const LegacyNode& currentNode = nodes.at(currentNodeId);
+		for (const Link& link : currentNode.links) {
+			const double tentativeGScore = gScores.at(currentNodeId) + link.cost;
+			const auto search = gScores.find(link.toId);
+			const double gScore = search != gScores.end()
+			                          ? search->second
+			                          : std::numeric_limits<double>::infinity();
+			if (tentativeGScore < gScore) {
+				cameFrom.insert({link.toId, currentNodeId});
+				gScores.insert({link.toId, tentativeGScore});
+				fScores.insert(
+				    {link.toId,
+				     tentativeGScore +
+				         getLegacyHeuristicScore(nodes.at(link.toId), currentNode)});
+				openSet.push(link.toId);
+			}
+		}
+	}
+
+	return false;
+}
+
+static long getPathCost(const std::vector<LegacyNode>& nodes,
+                        const std::vector<unsigned int>& path) {
+	long cost = 0;
+	for (size_t i = 1; i < path.size(); i++) {
+		for (const Link& link : nodes[path[i - 1]].links) {
+			if (link.toId == path[i]) {
+				cost += link.cost;
+				break;
+			}
+		}
+	}
+	return cost;
+}
+
+using Queries = std::vector<std::pair<unsigned int, unsigned int>>;
+
+template <typename Function>
+static double timeQueries(const char* name, Function&& findPath,
+                          const Queries& queries,
+                          const std::vector<LegacyNode>& nodes) {
+	std::vector<std::vector<unsigned int>> paths(queries.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < queries.size(); i++) {
+		findPath(queries[i].first, queries[i].second, paths[i]);
+	}
+	auto elapsed = std::chrono::duration<double, std::milli>(
+	                   std::chrono::steady_clock::now() - start)
+	                   .count();
+
+	long totalCost = 0;
+	for (auto& path : paths) totalCost += getPathCost(nodes, path);
+
+	std::printf("%-8s %10.3f ms total %10.3f ms/query  (path cost: %ld)\n", name,
+	            elapsed, elapsed / queries.size(), totalCost);
+	return elapsed;
+}
+
+int main(int argc, const char* argv[]) {
+	const int width = argc > 1 ? std::atoi(argv[1]) : 450;
+	const int numQueries = argc > 2 ? std::atoi(argv[2]) : 50;
+	const int numLandmarks = argc > 3 ? std::atoi(argv[3]) : 16;
+
+	// Every link costs at least the distance it covers
+	PointGraph graph(4096, 1.);
+	std::vector<LegacyNode> legacyNodes;
+
+	for (int z = 0; z < width; z++) {
+		for (int x = 0; x < width; x++) {
+			graph.addNode(x * nodeSpacing, 0, z * nodeSpacing);
+			legacyNodes.push_back({{x * nodeSpacing, 0, z * nodeSpacing}, {}});
+		}
+	}
+
+	// Grid links with some costlier "roads" so paths aren't trivially straight
+	std::mt19937 random(1234);
+	std::uniform_int_distribution<int> extraCost(0, nodeSpacing);
+
+	auto link = [&](unsigned int from, unsigned int to) {
+		int cost = nodeSpacing + extraCost(random);
+		graph.addLink(from, to, cost);
+		graph.addLink(to, from, cost);
+		legacyNodes[from].links.emplace_back(to, cost);
+		legacyNodes[to].links.emplace_back(from, cost);
+	};
+
+	for (int z = 0; z < width; z++) {
+		for (int x = 0; x < width; x++) {
+			unsigned int id = z * width + x;
+			if (x + 1 < width) link(id, id + 1);
+			if (z + 1 < width) link(id, id + width);
+		}
+	}
+
+	std::uniform_int_distribution<unsigned int> anyNode(0, width * width - 1);
+	Queries queries;
+	for (int i = 0; i < numQueries; i++) {
+		queries.emplace_back(anyNode(random), anyNode(random));
+	}
+
+	std::printf("%d nodes, %d queries\n", width * width, numQueries);
+
+	double legacyTime = timeQueries(
+	    "legacy",
+	    [&](unsigned from, unsigned to, std::vector<unsigned int>& path) {
+		    return legacyFindPath(legacyNodes, from, to, path);
+	    },
+	    queries, legacyNodes);
+	double newTime = timeQueries(
+	    "dense",
+	    [&](unsigned from, unsigned to, std::vector<unsigned int>& path) {
+		    return graph.findPath(from, to, path);
+	    },
+	    queries, legacyNodes);
+
+	graph.freeze();
+	double frozenTime = timeQueries(
+	    "frozen",
+	    [&](unsigned from, unsigned to, std::vector<unsigned int>& path) {
+		    return graph.findPath(from, to, path);
+	    },
+	    queries, legacyNodes);
+
+	auto landmarkStart = std::chrono::steady_clock::now();
+	graph.computeLandmarks(numLandmarks);
+	graph.waitForLandmarks();
+	std::printf("%d landmarks computed in %.3f ms\n", numLandmarks,
+	            std::chrono::duration<double, std::milli>(
+	                std::chrono::steady_clock::now() - landmarkStart)
+	                .count());
+
+	double landmarkTime = timeQueries(
+	    "alt",
+	    [&](unsigned from, unsigned to, std::vector<unsigned int>& path) {
+		    return graph.findPath(from, to, path);
+	    },
+	    queries, legacyNodes);
+
+	std::printf("speedup  %.1fx dense, %.1fx frozen, %.1fx alt\n",
+	            legacyTime / newTime, legacyTime / frozenTime,
+	            legacyTime / landmarkTime);
+	std::printf("alt vs frozen  %.1fx\n", frozenTime / landmarkTime);
+	return 0;
+}
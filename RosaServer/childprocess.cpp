@@ -2,92 +2,131 @@
 
 #include <fcntl.h>
 #include <signal.h>
+#include <spawn.h>
+#include <sys/mman.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <climits>
+#include <cstring>
 
-static constexpr int defaultPipeBufferSize = 1024 * 256;
+#include "threadpool.h"
 
-// We're throwing an `EPERM` or `Operation not permitted` error?
-// It's probably pipe size - the default maximum permitted in bytes on Linux is
-// 16384 pages, or 67108864 bytes. This only fits ~256 of the above default
-// sized pipes.
-ChildProcess::ChildProcess(const char* fileName,
-                           sol::optional<int> pipeBufferSize) {
-	int actualBufferSize = defaultPipeBufferSize;
-	if (pipeBufferSize) {
-		actualBufferSize = std::clamp(pipeBufferSize.value(), 0, 1024 * 1024);
-	}
+static constexpr int defaultBufferSize = 1024 * 256;
+static constexpr int minBufferSize = 1024 * 4;
+static constexpr int maxBufferSize = 1024 * 1024 * 64;
 
-	if (pipe(fdParentToChild) == -1) {
-		throw std::runtime_error(strerror(errno));
-	}
+static uint32_t getRingCapacity(sol::optional<int> bufferSize) {
+	int size = std::clamp(bufferSize.value_or(defaultBufferSize), minBufferSize,
+	                      maxBufferSize);
 
-	if (pipe(fdChildToParent) == -1 ||
-	    fcntl(fdParentToChild[1], F_SETPIPE_SZ, actualBufferSize) == -1 ||
-	    fcntl(fdChildToParent[1], F_SETPIPE_SZ, actualBufferSize) == -1) {
-		close(fdParentToChild[0]);
-		close(fdParentToChild[1]);
+	uint32_t capacity = 1;
+	while (capacity < static_cast<uint32_t>(size)) capacity <<= 1;
+	return capacity;
+}
+
+// Messages go through two rings in a memfd shared with the satellite rather
+// than pipes, so sending and receiving never makes a syscall unless the other
+// side is asleep waiting on us.
+SatelliteProcess::SatelliteProcess(const char* fileName, uint32_t capacity)
+    : capacity(capacity) {
+	sharedRegionSize = SatelliteLayout::getRegionSize(capacity);
 
+	int sharedFD = memfd_create("rosaserver-child", MFD_CLOEXEC);
+	if (sharedFD == -1) {
 		throw std::runtime_error(strerror(errno));
 	}
 
-	pid = fork();
+	// dup2 onto the same number wouldn't clear close-on-exec
+	if (sharedFD == satelliteSharedFD) {
+		int movedFD = fcntl(sharedFD, F_DUPFD_CLOEXEC, satelliteSharedFD + 1);
+		close(sharedFD);
+		if (movedFD == -1) {
+			throw std::runtime_error(strerror(errno));
+		}
+		sharedFD = movedFD;
+	}
 
-	if (pid == -1) {
-		close(fdParentToChild[0]);
-		close(fdParentToChild[1]);
-		close(fdChildToParent[0]);
-		close(fdChildToParent[1]);
+	if (ftruncate(sharedFD, sharedRegionSize) == -1) {
+		close(sharedFD);
+		throw std::runtime_error(strerror(errno));
+	}
 
+	sharedRegion = mmap(nullptr, sharedRegionSize, PROT_READ | PROT_WRITE,
+	                    MAP_SHARED, sharedFD, 0);
+	if (sharedRegion == MAP_FAILED) {
+		sharedRegion = nullptr;
+		close(sharedFD);
 		throw std::runtime_error(strerror(errno));
 	}
 
-	if (pid != 0) {
-		close(fdParentToChild[0]);
-		close(fdChildToParent[1]);
+	SatelliteLayout layout(sharedRegionSize);
+	control = new (layout.getControl(sharedRegion)) SatelliteControl();
+	control->state = static_cast<uint32_t>(SatelliteState::starting);
+	control->exitStatus = 0;
+	SharedMemoryRing::initialize(layout.getToChild(sharedRegion), capacity);
+	SharedMemoryRing::initialize(layout.getToParent(sharedRegion), capacity);
+	createRings();
+
+	char workingDirectory[PATH_MAX];
+	if (getcwd(workingDirectory, sizeof(workingDirectory)) == nullptr) {
+		close(sharedFD);
+		munmap(sharedRegion, sharedRegionSize);
+		throw std::runtime_error(strerror(errno));
+	}
 
-		fcntl(fdChildToParent[0], F_SETFL, O_NONBLOCK);
-	} else {
-		close(fdParentToChild[1]);
-		close(fdChildToParent[0]);
+	char ldPreload[PATH_MAX + 64];
+	sprintf(ldPreload, "LD_PRELOAD=%s/libluajit.so", workingDirectory);
 
-		// Set reading the pipe to not block execution
-		fcntl(fdParentToChild[0], F_SETFL, O_NONBLOCK);
+	char strSharedFD[12];
+	sprintf(strSharedFD, "%i", satelliteSharedFD);
 
-		char strFromParentFD[10];
-		char strToParentFD[10];
+	char* args[] = {(char*)"./rosaserversatellite", strSharedFD,
+	                (char*)fileName, nullptr};
+	char parentPID[64];
+	sprintf(parentPID, "%s=%i", satelliteParentPIDVariable, getpid());
 
-		sprintf(strFromParentFD, "%i", fdParentToChild[0]);
-		sprintf(strToParentFD, "%i", fdChildToParent[1]);
+	char* env[] = {ldPreload, parentPID, nullptr};
 
-		char* args[] = {(char*)"./rosaserversatellite", strFromParentFD,
-		                strToParentFD, (char*)fileName, nullptr};
+	posix_spawn_file_actions_t fileActions;
+	posix_spawn_file_actions_init(&fileActions);
+	posix_spawn_file_actions_adddup2(&fileActions, sharedFD, satelliteSharedFD);
 
-		char workingDirectory[PATH_MAX];
+	int spawnError = posix_spawn(&pid, args[0], &fileActions, nullptr, args, env);
 
-		if (getcwd(workingDirectory, sizeof(workingDirectory)) == nullptr) {
-			perror("getcwd");
-			exit(1);
-		}
+	posix_spawn_file_actions_destroy(&fileActions);
+	close(sharedFD);
 
-		char ldPreload[PATH_MAX + 64];
-		sprintf(ldPreload, "LD_PRELOAD=%s/libluajit.so", workingDirectory);
+	if (spawnError != 0) {
+		pid = -1;
+		munmap(sharedRegion, sharedRegionSize);
+		throw std::runtime_error(strerror(spawnError));
+	}
+}
 
-		char* env[] = {ldPreload, nullptr};
+SatelliteProcess::~SatelliteProcess() {
+	terminate();
+	munmap(sharedRegion, sharedRegionSize);
+}
 
-		if (execvpe(args[0], args, env) == -1) {
-			perror("execvpe");
-			exit(1);
-		}
-	}
+void SatelliteProcess::createRings() {
+	SatelliteLayout layout(sharedRegionSize);
+	toChild = std::make_unique<SharedMemoryRing>(layout.getToChild(sharedRegion),
+	                                             layout.ringRegionSize);
+	fromChild = std::make_unique<SharedMemoryRing>(
+	    layout.getToParent(sharedRegion), layout.ringRegionSize);
 }
 
-ChildProcess::~ChildProcess() { terminate(); }
+void SatelliteProcess::resetRings() {
+	SatelliteLayout layout(sharedRegionSize);
+	SharedMemoryRing::initialize(layout.getToChild(sharedRegion), capacity);
+	SharedMemoryRing::initialize(layout.getToParent(sharedRegion), capacity);
+	createRings();
+}
 
-bool ChildProcess::isRunning() {
+bool SatelliteProcess::isAlive() {
 	if (gotExitCode || pid == -1) {
 		return false;
 	}
@@ -108,8 +147,8 @@ bool ChildProcess::isRunning() {
 	return false;
 }
 
-void ChildProcess::terminate() {
-	if (pid != -1) {
+void SatelliteProcess::terminate() {
+	if (pid != -1 && !gotExitCode) {
 		if (kill(pid, SIGTERM) == -1) {
 			if (errno != ESRCH) {
 				throw std::runtime_error(strerror(errno));
@@ -125,70 +164,172 @@ void ChildProcess::terminate() {
 			gotExitCode = true;
 			exitCode = status;
 		}
+	}
 
-		// Close file handles
-		close(fdParentToChild[1]);
-		close(fdChildToParent[0]);
+	pid = -1;
+}
 
-		pid = -1;
+bool SatelliteProcess::getExitStatus(int& status) {
+	isAlive();
+
+	if (gotExitCode) {
+		status = exitCode;
+		return true;
+	}
+
+	return false;
+}
+
+// Satellites get SIGTERM when the thread that spawned them exits, not the
+// process, so pooled ones are spawned from a thread that is never stopped.
+// Checked out satellites can outlive the pool that spawned them.
+static void requestSpawn(std::shared_ptr<ChildProcessPoolState> state) {
+	static ThreadPool* spawner = new ThreadPool(1);
+
+	spawner->push([state = std::move(state)]() {
+		{
+			std::lock_guard<std::mutex> guard(state->mutex);
+			if (state->stopped) return;
+		}
+
+		std::unique_ptr<SatelliteProcess> process;
+		std::string error;
+		try {
+			process = std::make_unique<SatelliteProcess>(nullptr, state->capacity);
+		} catch (std::exception& e) {
+			error = e.what();
+		}
+
+		std::lock_guard<std::mutex> guard(state->mutex);
+		if (state->stopped) return;
+
+		if (process) {
+			state->idle.push_back(std::move(process));
+		} else {
+			// Not retried, the same thing would most likely happen again
+			state->lastError = std::move(error);
+		}
+	});
+}
+
+ChildProcess::ChildProcess(const char* fileName,
+                           sol::optional<int> bufferSize)
+    : process(std::make_unique<SatelliteProcess>(
+          fileName, getRingCapacity(bufferSize))) {}
+
+ChildProcess::ChildProcess(std::unique_ptr<SatelliteProcess> process,
+                           std::shared_ptr<ChildProcessPoolState> pool)
+    : process(std::move(process)), pool(std::move(pool)) {}
+
+ChildProcess::~ChildProcess() { release(); }
+
+// For a pooled child, whether its script is still going.
+bool ChildProcess::isRunning() {
+	if (!process || !process->isAlive()) {
+		return false;
+	}
+
+	return !pool || process->control->getState() == SatelliteState::running;
+}
+
+void ChildProcess::terminate() {
+	if (!process) return;
+
+	process->terminate();
+
+	if (pool && !requestedReplacement) {
+		requestedReplacement = true;
+
+		std::lock_guard<std::mutex> guard(pool->mutex);
+		if (!pool->stopped) requestSpawn(pool);
+	}
+}
+
+// Hands a pooled child whose script has finished back to its pool; any other
+// child is terminated. The handle can't be used to send anything afterwards.
+void ChildProcess::release() {
+	if (!process) return;
+
+	if (pool && !hasLimits && process->isAlive() &&
+	    process->control->getState() == SatelliteState::finished) {
+		process->resetRings();
+		process->control->setState(SatelliteState::idle);
+
+		std::lock_guard<std::mutex> guard(pool->mutex);
+		if (!pool->stopped) {
+			pool->idle.push_back(std::move(process));
+			return;
+		}
 	}
+
+	terminate();
+	process.reset();
 }
 
 sol::object ChildProcess::getExitCode(sol::this_state s) {
 	sol::state_view lua(s);
 
-	isRunning();
+	if (!process) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	if (pool && process->isAlive()) {
+		if (process->control->getState() == SatelliteState::finished) {
+			return sol::make_object(lua, process->control->exitStatus.load());
+		}
+		return sol::make_object(lua, sol::nil);
+	}
 
-	if (gotExitCode) {
-		return sol::make_object(lua, exitCode);
+	int status;
+	if (process->getExitStatus(status)) {
+		return sol::make_object(lua, status);
 	}
 
 	return sol::make_object(lua, sol::nil);
 }
 
+// Anything the child sent before exiting can still be received afterwards.
 sol::object ChildProcess::receiveMessage(sol::this_state s) {
 	sol::state_view lua(s);
 
-	unsigned int length;
-
-	auto bytesRead = read(fdChildToParent[0], &length, sizeof(length));
-	if (bytesRead == -1) {
-		if (errno != EAGAIN) {
-			throw std::runtime_error(strerror(errno));
-		}
-	} else if (bytesRead == sizeof(length)) {
-		std::string message(length, ' ');
-		bytesRead = read(fdChildToParent[0], message.data(), length);
-		if (bytesRead == -1) {
-			if (errno != EAGAIN) {
-				throw std::runtime_error(strerror(errno));
-			}
-		} else if (bytesRead == length) {
-			return sol::make_object(lua, message);
-		}
+	sol::object message = sol::make_object(lua, sol::nil);
+	if (process) {
+		process->fromChild->read([&](std::string_view data) {
+			message = sol::make_object(lua, data);
+		});
 	}
 
-	return sol::make_object(lua, sol::nil);
+	return message;
 }
 
-void ChildProcess::sendMessage(std::string_view message) {
-	if (!isRunning()) return;
+// Takes up to `max` messages at once. If a table is passed it is refilled in
+// place instead of creating a new one.
+sol::table ChildProcess::receiveMessages(unsigned int max,
+                                         sol::optional<sol::table> reuse,
+                                         sol::this_state s) {
+	sol::state_view lua(s);
+	sol::table messages = reuse ? reuse.value() : lua.create_table();
 
-	unsigned int length = static_cast<unsigned int>(message.length());
+	size_t count = 0;
+	if (process) {
+		process->fromChild->readMany(max, [&](std::string_view data) {
+			messages[++count] = data;
+		});
+	}
 
-	auto bytesWritten = write(fdParentToChild[1], &length, sizeof(length));
-	if (bytesWritten == -1) {
-		throw std::runtime_error(strerror(errno));
-	} else if (bytesWritten != sizeof(length)) {
-		throw std::runtime_error("Couldn't write full message to pipe");
-	} else {
-		bytesWritten = write(fdParentToChild[1], message.data(), length);
-		if (bytesWritten == -1) {
-			throw std::runtime_error(strerror(errno));
-		} else if (bytesWritten != length) {
-			throw std::runtime_error("Couldn't write full message to pipe");
-		}
+	// Trim whatever was left over from a bigger previous batch
+	for (size_t i = count + 1; messages[i].valid(); i++) {
+		messages[i] = sol::nil;
 	}
+
+	return messages;
+}
+
+// Returns false if the child isn't running or its buffer is full.
+bool ChildProcess::sendMessage(std::string_view message) {
+	if (!isRunning()) return false;
+
+	return process->toChild->tryWrite(message);
 }
 
 void ChildProcess::setLimit(__rlimit_resource resource, rlim_t softLimit,
@@ -197,7 +338,8 @@ void ChildProcess::setLimit(__rlimit_resource resource, rlim_t softLimit,
 
 	const rlimit limits{softLimit, hardLimit};
 
-	if (prlimit(pid, resource, &limits, nullptr) == -1) {
+	hasLimits = true;
+	if (prlimit(process->getPID(), resource, &limits, nullptr) == -1) {
 		throw std::runtime_error(strerror(errno));
 	}
 }
@@ -221,7 +363,7 @@ int ChildProcess::getPriority() {
 	// getpriority()
 	errno = 0;
 
-	int nice = getpriority(PRIO_PROCESS, pid);
+	int nice = getpriority(PRIO_PROCESS, process->getPID());
 	if (nice == -1 && errno != 0) {
 		throw std::runtime_error(strerror(errno));
 	}
@@ -232,7 +374,100 @@ int ChildProcess::getPriority() {
 void ChildProcess::setPriority(int nice) {
 	if (!isRunning()) return;
 
-	if (setpriority(PRIO_PROCESS, pid, nice) == -1) {
+	hasLimits = true;
+	if (setpriority(PRIO_PROCESS, process->getPID(), nice) == -1) {
 		throw std::runtime_error(strerror(errno));
 	}
 }
+
+ChildProcessPool::ChildProcessPool(unsigned int size,
+                                   sol::optional<int> bufferSize)
+    : state(std::make_shared<ChildProcessPoolState>()), size(size) {
+	state->capacity = getRingCapacity(bufferSize);
+
+	for (unsigned int i = 0; i < size; i++) {
+		requestSpawn(state);
+	}
+}
+
+ChildProcessPool::~ChildProcessPool() {
+	std::lock_guard<std::mutex> guard(state->mutex);
+	state->stopped = true;
+	state->idle.clear();
+}
+
+// Returns nil if no satellite is idle and ready right now.
+std::shared_ptr<ChildProcess> ChildProcessPool::checkoutJob(
+    char kind, std::string_view payload) {
+	std::unique_ptr<SatelliteProcess> process;
+
+	{
+		std::lock_guard<std::mutex> guard(state->mutex);
+
+		for (auto it = state->idle.begin(); it != state->idle.end();) {
+			if (!(*it)->isAlive()) {
+				it = state->idle.erase(it);
+				requestSpawn(state);
+				continue;
+			}
+
+			if ((*it)->control->getState() == SatelliteState::idle) {
+				process = std::move(*it);
+				state->idle.erase(it);
+				break;
+			}
+
+			++it;
+		}
+	}
+
+	if (!process) return nullptr;
+
+	std::string job;
+	job.reserve(payload.size() + 1);
+	job += kind;
+	job += payload;
+
+	try {
+		process->toChild->tryWrite(job);
+	} catch (std::exception&) {
+		std::lock_guard<std::mutex> guard(state->mutex);
+		state->idle.push_front(std::move(process));
+		throw;
+	}
+
+	process->control->setState(SatelliteState::running);
+	return std::make_shared<ChildProcess>(std::move(process), state);
+}
+
+std::shared_ptr<ChildProcess> ChildProcessPool::checkout(
+    std::string_view fileName) {
+	return checkoutJob(satelliteJobFile, fileName);
+}
+
+std::shared_ptr<ChildProcess> ChildProcessPool::checkoutChunk(
+    std::string_view source) {
+	return checkoutJob(satelliteJobChunk, source);
+}
+
+unsigned int ChildProcessPool::getNumIdle() {
+	std::lock_guard<std::mutex> guard(state->mutex);
+
+	unsigned int numIdle = 0;
+	for (auto& process : state->idle) {
+		if (process->control->getState() == SatelliteState::idle) numIdle++;
+	}
+
+	return numIdle;
+}
+
+sol::object ChildProcessPool::getLastError(sol::this_state s) {
+	sol::state_view lua(s);
+
+	std::lock_guard<std::mutex> guard(state->mutex);
+	if (state->lastError.empty()) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	return sol::make_object(lua, state->lastError);
+}
@@ -1,31 +1,98 @@
 #pragma once
 #include <sys/resource.h>
 
+#include <deque>
+#include <memory>
+#include <mutex>
 #include <string>
 
+#include "satellite.h"
 #include "sol/sol.hpp"
 
-class ChildProcess {
-	int fdParentToChild[2];
-	int fdChildToParent[2];
-	int pid;
+// A running rosaserversatellite and the memfd it shares with us. Spawned with
+// posix_spawn, so the server's address space is never copied.
+class SatelliteProcess {
+	void* sharedRegion = nullptr;
+	size_t sharedRegionSize = 0;
+	uint32_t capacity;
+	int pid = -1;
 
 	bool gotExitCode = false;
 	int exitCode;
 
+	void createRings();
+
+ public:
+	SatelliteControl* control;
+	std::unique_ptr<SharedMemoryRing> toChild;
+	std::unique_ptr<SharedMemoryRing> fromChild;
+
+	// Without a file name the satellite is pooled and waits for jobs instead.
+	SatelliteProcess(const char* fileName, uint32_t capacity);
+	~SatelliteProcess();
+
+	int getPID() const { return pid; }
+	bool isAlive();
+	void terminate();
+	bool getExitStatus(int& status);
+	// Only while the satellite is between jobs
+	void resetRings();
+};
+
+struct ChildProcessPoolState {
+	std::mutex mutex;
+	std::deque<std::unique_ptr<SatelliteProcess>> idle;
+	uint32_t capacity;
+	bool stopped = false;
+	std::string lastError;
+};
+
+class ChildProcess {
+	std::unique_ptr<SatelliteProcess> process;
+	// Set when checked out of a ChildProcessPool
+	std::shared_ptr<ChildProcessPoolState> pool;
+	bool hasLimits = false;
+	bool requestedReplacement = false;
+
 	void setLimit(__rlimit_resource resource, rlim_t softLimit, rlim_t hardLimit);
 
  public:
-	ChildProcess(const char* fileName, sol::optional<int> pipeBufferSize);
+	ChildProcess(const char* fileName, sol::optional<int> bufferSize);
+	ChildProcess(std::unique_ptr<SatelliteProcess> process,
+	             std::shared_ptr<ChildProcessPoolState> pool);
 	~ChildProcess();
 	bool isRunning();
 	void terminate();
+	void release();
 	sol::object getExitCode(sol::this_state s);
 	sol::object receiveMessage(sol::this_state s);
-	void sendMessage(std::string_view message);
+	sol::table receiveMessages(unsigned int max, sol::optional<sol::table> reuse,
+	                           sol::this_state s);
+	bool sendMessage(std::string_view message);
 	void setCPULimit(rlim_t softLimit, rlim_t hardLimit);
 	void setMemoryLimit(rlim_t softLimit, rlim_t hardLimit);
 	void setFileSizeLimit(rlim_t softLimit, rlim_t hardLimit);
 	int getPriority();
 	void setPriority(int nice);
 };
+
+// Keeps satellites spawned and idle with their Lua libraries loaded, so
+// running a script only costs handing it over. Spawning happens on a
+// background thread.
+class ChildProcessPool {
+	std::shared_ptr<ChildProcessPoolState> state;
+	unsigned int size;
+
+	std::shared_ptr<ChildProcess> checkoutJob(char kind,
+	                                          std::string_view payload);
+
+ public:
+	ChildProcessPool(unsigned int size, sol::optional<int> bufferSize);
+	~ChildProcessPool();
+
+	std::shared_ptr<ChildProcess> checkout(std::string_view fileName);
+	std::shared_ptr<ChildProcess> checkoutChunk(std::string_view source);
+	unsigned int getNumIdle();
+	unsigned int getSize() const { return size; }
+	sol::object getLastError(sol::this_state s);
+};
@@ -4,9 +4,14 @@
 
 #include "api.h"
 #include "console.h"
+#include "httpserver.h"
+#include "netstats.h"
+#include "pathrequests.h"
+#include "sqlite.h"
+#include "worldsnapshot.h"
 
 namespace Hooks {
-sol::protected_function run;
+HookRunner run;
 
 const std::unordered_map<std::string, EnableKeys> enableNames(
     {{"InterruptSignal", EnableKeys::InterruptSignal},
@@ -393,6 +398,8 @@ void areaDeleteBlock(int zero, int blockX, int blockY, int blockZ) {
 }
 
 void logicSimulation() {
+	Metrics::ScopedTimer timer(Metrics::server::logicTime);
+
 	if (shouldReset) {
 		shouldReset = false;
 		luaInit(true);
@@ -400,6 +407,12 @@ void logicSimulation() {
 		hookAndReset(RESET_REASON_LUARESET);
 	}
 
+	Lua::http::processResponses();
+	PathRequests::processResults();
+	SQLite::processResults();
+	HTTPServer::processAll();
+	Metrics::sampleGameState();
+
 	bool noParent = false;
 
 	if (Console::shouldExit) {
@@ -413,6 +426,7 @@ void logicSimulation() {
 
 	if (enabledKeys[EnableKeys::Logic]) {
 		if (run != sol::nil) {
+			Metrics::ScopedTimer luaTimer(Metrics::server::luaLogicTime);
 			auto res = run("Logic");
 			if (noLuaCallError(&res)) noParent = (bool)res;
 		}
@@ -627,6 +641,8 @@ void logicPlayerActions(int playerID) {
 }
 
 void physicsSimulation() {
+	Metrics::ScopedTimer timer(Metrics::server::physicsTime);
+
 	if (enabledKeys[EnableKeys::Physics]) {
 		bool noParent = false;
 		if (run != sol::nil) {
@@ -638,14 +654,18 @@ void physicsSimulation() {
 				subhook::ScopedHookRemove remove(&physicsSimulationHook);
 				Engine::physicsSimulation();
 			}
+			WorldSnapshot::capture();
 			if (run != sol::nil) {
 				auto res = run("PostPhysics");
 				noLuaCallError(&res);
 			}
 		}
 	} else {
-		subhook::ScopedHookRemove remove(&physicsSimulationHook);
-		Engine::physicsSimulation();
+		{
+			subhook::ScopedHookRemove remove(&physicsSimulationHook);
+			Engine::physicsSimulation();
+		}
+		WorldSnapshot::capture();
 	}
 }
 
@@ -745,6 +765,8 @@ int serverReceive() {
 }
 
 void serverSend() {
+	Metrics::ScopedTimer timer(Metrics::server::sendTime);
+
 	if (enabledKeys[EnableKeys::ServerSend]) {
 		bool noParent = false;
 		if (run != sol::nil) {
@@ -799,6 +821,7 @@ int packetReceive() {
 				subhook::ScopedHookRemove remove(&packetReceiveHook);
 				ret = Engine::packetReceive();
 			}
+			if (ret > 0) NetStats::recordReceived(*Engine::packetSize);
 			if (run != sol::nil) {
 				auto res = run("PostPacketReceive");
 				noLuaCallError(&res);
@@ -807,8 +830,13 @@ int packetReceive() {
 		}
 		return 0;
 	} else {
-		subhook::ScopedHookRemove remove(&packetReceiveHook);
-		return Engine::packetReceive();
+		int ret;
+		{
+			subhook::ScopedHookRemove remove(&packetReceiveHook);
+			ret = Engine::packetReceive();
+		}
+		if (ret > 0) NetStats::recordReceived(*Engine::packetSize);
+		return ret;
 	}
 }
 
@@ -852,6 +880,9 @@ int sendPacket(unsigned int address, unsigned short port) {
 			if (noLuaCallError(&res)) noParent = (bool)res;
 		}
 		if (!noParent) {
+			NetStats::recordSent(address, port, Engine::packet[4],
+			                     *Engine::packetSize);
+
 			int ret;
 			{
 				subhook::ScopedHookRemove remove(&sendPacketHook);
@@ -866,6 +897,9 @@ int sendPacket(unsigned int address, unsigned short port) {
 		}
 		return 0;
 	} else {
+		NetStats::recordSent(address, port, Engine::packet[4],
+		                     *Engine::packetSize);
+
 		subhook::ScopedHookRemove remove(&sendPacketHook);
 		return Engine::sendPacket(address, port);
 	}
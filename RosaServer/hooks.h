@@ -1,11 +1,34 @@
 #pragma once
 #include <unordered_map>
 
+#include "metrics.h"
 #include "structs.h"
 #include "subhook.h"
 
 namespace Hooks {
-extern sol::protected_function run;
+// hook.run from the Lua state, counting calls per event as it goes
+class HookRunner {
+	sol::protected_function function;
+
+ public:
+	template <typename T>
+	HookRunner& operator=(T&& value) {
+		function = std::forward<T>(value);
+		return *this;
+	}
+
+	bool operator==(sol::lua_nil_t) const { return function == sol::lua_nil; }
+	bool operator!=(sol::lua_nil_t) const { return function != sol::lua_nil; }
+
+	template <typename... Args>
+	sol::protected_function_result operator()(const char* event,
+	                                          Args&&... args) {
+		Metrics::countHookCall(event);
+		return function(event, std::forward<Args>(args)...);
+	}
+};
+
+extern HookRunner run;
 
 enum EnableKeys {
 	ResetGame,
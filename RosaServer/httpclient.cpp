@@ -0,0 +1,132 @@
+#include "httpclient.h"
+
+std::unique_ptr<httplib::Client> HTTPConnectionPool::acquire() {
+	{
+		std::lock_guard<std::mutex> guard(idleMutex);
+		if (!idle.empty()) {
+			auto client = std::move(idle.back());
+			idle.pop_back();
+			return client;
+		}
+	}
+
+	auto client = std::make_unique<httplib::Client>(host);
+	client->set_connection_timeout(defaultHTTPTimeoutSeconds);
+	client->set_read_timeout(defaultHTTPTimeoutSeconds);
+	client->set_write_timeout(defaultHTTPTimeoutSeconds);
+	client->set_keep_alive(true);
+	client->set_follow_location(true);
+	return client;
+}
+
+void HTTPConnectionPool::release(std::unique_ptr<httplib::Client> client) {
+	std::lock_guard<std::mutex> guard(idleMutex);
+	if (idle.size() < maxIdle) {
+		idle.push_back(std::move(client));
+	}
+}
+
+// A client only ever runs one request at a time, so each pooled client is one
+// connection. httplib keeps its socket (and TLS session) open between requests
+// and reconnects on its own if the server dropped it while idle.
+void HTTPConnectionPool::perform(const LuaHTTPRequest& request,
+                                 LuaHTTPResponse& response) {
+	auto client = acquire();
+
+	if (client->is_socket_open()) {
+		numReusedConnections++;
+	} else {
+		numNewConnections++;
+	}
+
+	Lua::http::performRequest(*client, request, response);
+
+	// Don't hand a connection in an unknown state to the next request
+	if (response.responded) {
+		release(std::move(client));
+	}
+}
+
+HTTPClient::HTTPClient(std::string host)
+    : HTTPClient(std::move(host), defaultHTTPClientMaxIdleConnections) {}
+
+HTTPClient::HTTPClient(std::string host, unsigned int maxIdleConnections)
+    : pool(std::make_shared<HTTPConnectionPool>()) {
+	pool->host = std::move(host);
+	pool->maxIdle = maxIdleConnections;
+}
+
+LuaHTTPRequest HTTPClient::createRequest(LuaRequestType type,
+                                         std::string_view path,
+                                         sol::table headers) const {
+	LuaHTTPRequest request{};
+	request.type = type;
+	request.scheme = pool->host;
+	request.path = path;
+	request.headers = Lua::http::headersFromTable(headers);
+	request.timeoutSeconds = defaultHTTPTimeoutSeconds;
+	return request;
+}
+
+sol::object HTTPClient::performSync(const LuaHTTPRequest& request,
+                                    sol::this_state s) {
+	sol::state_view lua(s);
+
+	LuaHTTPResponse response{0, false};
+	pool->perform(request, response);
+
+	if (!response.responded) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	return Lua::http::createResponseTable(lua, response);
+}
+
+sol::object HTTPClient::getSync(std::string_view path, sol::table headers,
+                                sol::this_state s) {
+	return performSync(createRequest(LuaRequestType::get, path, headers), s);
+}
+
+sol::object HTTPClient::postSync(std::string_view path, sol::table headers,
+                                 std::string body, std::string contentType,
+                                 sol::this_state s) {
+	auto request = createRequest(LuaRequestType::post, path, headers);
+	request.body = std::move(body);
+	request.contentType = std::move(contentType);
+	return performSync(request, s);
+}
+
+bool HTTPClient::get(std::string_view path, sol::table headers,
+                     sol::protected_function callback) {
+	return Lua::http::queueRequest(
+	    [pool = pool, request = createRequest(LuaRequestType::get, path,
+	                                          headers)](LuaHTTPResponse& response) {
+		    pool->perform(request, response);
+	    },
+	    std::move(callback));
+}
+
+bool HTTPClient::post(std::string_view path, sol::table headers,
+                      std::string body, std::string contentType,
+                      sol::protected_function callback) {
+	auto request = createRequest(LuaRequestType::post, path, headers);
+	request.body = std::move(body);
+	request.contentType = std::move(contentType);
+
+	return Lua::http::queueRequest(
+	    [pool = pool, request = std::move(request)](LuaHTTPResponse& response) {
+		    pool->perform(request, response);
+	    },
+	    std::move(callback));
+}
+
+// Drops idle connections; ones in use by queued requests close when done.
+void HTTPClient::close() {
+	std::lock_guard<std::mutex> guard(pool->idleMutex);
+	pool->idle.clear();
+}
+
+unsigned int HTTPClient::getNumIdleConnections() const {
+	std::lock_guard<std::mutex> guard(pool->idleMutex);
+	return pool->idle.size();
+}
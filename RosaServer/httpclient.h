@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "api.h"
+
+// How many connections are kept open between requests; any number of requests
+// can still run at once.
+static constexpr unsigned int defaultHTTPClientMaxIdleConnections = 4;
+
+// Keep-alive connections to a single host. Shared with queued requests so it
+// outlives the Lua object if that is collected while requests are in flight.
+struct HTTPConnectionPool {
+	std::string host;
+	unsigned int maxIdle;
+
+	std::mutex idleMutex;
+	std::vector<std::unique_ptr<httplib::Client>> idle;
+
+	std::atomic_uint numNewConnections = 0;
+	std::atomic_uint numReusedConnections = 0;
+
+	std::unique_ptr<httplib::Client> acquire();
+	void release(std::unique_ptr<httplib::Client> client);
+	void perform(const LuaHTTPRequest& request, LuaHTTPResponse& response);
+};
+
+class HTTPClient {
+	std::shared_ptr<HTTPConnectionPool> pool;
+
+	LuaHTTPRequest createRequest(LuaRequestType type, std::string_view path,
+	                             sol::table headers) const;
+	sol::object performSync(const LuaHTTPRequest& request, sol::this_state s);
+
+ public:
+	HTTPClient(std::string host);
+	HTTPClient(std::string host, unsigned int maxIdleConnections);
+
+	sol::object getSync(std::string_view path, sol::table headers,
+	                    sol::this_state s);
+	sol::object postSync(std::string_view path, sol::table headers,
+	                     std::string body, std::string contentType,
+	                     sol::this_state s);
+	bool get(std::string_view path, sol::table headers,
+	         sol::protected_function callback);
+	bool post(std::string_view path, sol::table headers, std::string body,
+	          std::string contentType, sol::protected_function callback);
+
+	void close();
+	std::string getHost() const { return pool->host; }
+	unsigned int getNumNewConnections() const {
+		return pool->numNewConnections;
+	}
+	unsigned int getNumReusedConnections() const {
+		return pool->numReusedConnections;
+	}
+	unsigned int getNumIdleConnections() const;
+};
@@ -0,0 +1,309 @@
+#include "httpserver.h"
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <stdexcept>
+#include <vector>
+
+// Every live server, drained at the start of each logic tick
+static std::vector<HTTPServer*> servers;
+
+static inline std::string getRouteKey(std::string method,
+                                      std::string_view path) {
+	std::transform(method.begin(), method.end(), method.begin(), ::toupper);
+	method += ' ';
+	method += path;
+	return method;
+}
+
+void PendingServerRequest::complete(int status, std::string body,
+                                    std::string contentType) {
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		if (done) return;
+
+		done = true;
+		this->status = status;
+		responseBody = std::move(body);
+		this->contentType = std::move(contentType);
+	}
+	responded.notify_one();
+}
+
+HTTPServerResponse::~HTTPServerResponse() {
+	// Dropped by Lua without ever responding
+	if (request) {
+		request->complete(500, "Internal Server Error", "text/plain");
+	}
+}
+
+void HTTPServerResponse::setHeader(std::string name, std::string value) {
+	if (!request) {
+		throw std::runtime_error("Response was already sent");
+	}
+
+	headers.emplace(std::move(name), std::move(value));
+}
+
+void HTTPServerResponse::send(std::string body,
+                              sol::optional<std::string> contentType) {
+	if (!request) {
+		throw std::runtime_error("Response was already sent");
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(request->mutex);
+		request->responseHeaders = std::move(headers);
+	}
+
+	request->complete(status, std::move(body),
+	                  contentType.value_or("text/plain"));
+	request.reset();
+}
+
+HTTPServer::HTTPServer(std::string host, unsigned short port) {
+	server.new_task_queue = [] {
+		return new httplib::ThreadPool(httpServerNumThreads);
+	};
+
+	auto handler = [this](const httplib::Request& req, httplib::Response& res) {
+		handle(req, res);
+	};
+
+	server.Get(".*", handler);
+	server.Post(".*", handler);
+	server.Put(".*", handler);
+	server.Patch(".*", handler);
+	server.Delete(".*", handler);
+
+	if (!server.bind_to_port(host.c_str(), port)) {
+		throw std::runtime_error("Could not bind HTTP server");
+	}
+
+	running = true;
+	listenThread = std::thread([this] {
+		server.listen_after_bind();
+		running = false;
+	});
+
+	servers.push_back(this);
+}
+
+HTTPServer::~HTTPServer() {
+	stop();
+	servers.erase(std::remove(servers.begin(), servers.end(), this),
+	              servers.end());
+}
+
+// Runs on a listener thread. Published content is answered right here; Lua
+// routes wait for the main thread to pick the request up on its next tick.
+void HTTPServer::handle(const httplib::Request& req, httplib::Response& res) {
+	if (req.method == "GET" && servePublished(req, res)) {
+		return;
+	}
+
+	auto key = getRouteKey(req.method, req.path);
+	{
+		std::shared_lock<std::shared_mutex> lock(routesMutex);
+		if (!routeKeys.count(key)) {
+			res.status = 404;
+			return;
+		}
+	}
+
+	if (numWaiting.fetch_add(1) >= maxHTTPServerWaitingRequests) {
+		numWaiting--;
+		res.status = 503;
+		return;
+	}
+
+	struct WaitingGuard {
+		std::atomic_uint& numWaiting;
+		~WaitingGuard() { numWaiting--; }
+	} waitingGuard{numWaiting};
+
+	auto pending = std::make_shared<PendingServerRequest>();
+	pending->routeKey = std::move(key);
+	pending->method = req.method;
+	pending->path = req.path;
+	pending->body = req.body;
+	pending->remoteAddress = req.remote_addr;
+	pending->headers = req.headers;
+	pending->params = req.params;
+
+	{
+		std::shared_lock<std::shared_mutex> lock(routesMutex);
+		if (stopping) {
+			res.status = 503;
+			return;
+		}
+
+		numQueued++;
+		queue.push(pending);
+	}
+
+	std::unique_lock<std::mutex> lock(pending->mutex);
+	if (!pending->responded.wait_for(
+	        lock, std::chrono::seconds(httpServerResponseTimeoutSeconds),
+	        [&] { return pending->done; })) {
+		// The main thread still owns the request; it just won't be heard
+		pending->done = true;
+		res.status = 504;
+		return;
+	}
+
+	res.status = pending->status;
+	for (const auto& h : pending->responseHeaders)
+		res.set_header(h.first, h.second);
+	res.set_content(std::move(pending->responseBody), pending->contentType);
+}
+
+bool HTTPServer::servePublished(const httplib::Request& req,
+                                httplib::Response& res) {
+	std::shared_ptr<const PublishedContent> content;
+	{
+		std::shared_lock<std::shared_mutex> lock(publishedMutex);
+		auto search = published.find(req.path);
+		if (search == published.end()) return false;
+		content = search->second;
+	}
+
+	res.set_content(content->body, content->contentType);
+	return true;
+}
+
+void HTTPServer::processAll() {
+	// Copied since a route callback may construct or collect a server
+	auto current = servers;
+	for (auto server : current) {
+		if (std::find(servers.begin(), servers.end(), server) != servers.end()) {
+			server->processRequests();
+		}
+	}
+}
+
+void HTTPServer::processRequests() {
+	// Only what was queued when the tick started, so a flood can't starve it
+	unsigned int toProcess = numQueued;
+
+	outstanding.erase(
+	    std::remove_if(outstanding.begin(), outstanding.end(),
+	                   [](const auto& weak) { return weak.expired(); }),
+	    outstanding.end());
+
+	std::shared_ptr<PendingServerRequest> pending;
+	while (toProcess-- && queue.pop(pending)) {
+		numQueued--;
+
+		auto search = routeCallbacks.find(pending->routeKey);
+		if (search == routeCallbacks.end()) {
+			pending->complete(404, "Not Found", "text/plain");
+			continue;
+		}
+
+		sol::table request = lua->create_table();
+		request["method"] = pending->method;
+		request["path"] = pending->path;
+		request["body"] = pending->body;
+		request["remoteAddress"] = pending->remoteAddress;
+
+		sol::table headers = lua->create_table();
+		for (const auto& h : pending->headers) headers[h.first] = h.second;
+		request["headers"] = headers;
+
+		sol::table params = lua->create_table();
+		for (const auto& p : pending->params) params[p.first] = p.second;
+		request["params"] = params;
+
+		auto response = std::make_shared<HTTPServerResponse>(pending);
+		outstanding.push_back(pending);
+
+		auto callback = search->second;
+		auto res = callback(request, response);
+		if (!noLuaCallError(&res)) {
+			pending->complete(500, "Internal Server Error", "text/plain");
+		}
+	}
+}
+
+void HTTPServer::route(std::string method, std::string path,
+                       sol::protected_function callback) {
+	auto key = getRouteKey(std::move(method), path);
+
+	{
+		std::unique_lock<std::shared_mutex> lock(routesMutex);
+		routeKeys.insert(key);
+	}
+
+	routeCallbacks[key] = std::move(callback);
+}
+
+void HTTPServer::removeRoute(std::string method, std::string path) {
+	auto key = getRouteKey(std::move(method), path);
+
+	{
+		std::unique_lock<std::shared_mutex> lock(routesMutex);
+		routeKeys.erase(key);
+	}
+
+	routeCallbacks.erase(key);
+}
+
+// Published content is served by listener threads without touching Lua.
+// Republishing a path swaps in the new content; requests already being served
+// keep the old copy alive until they finish.
+void HTTPServer::publish(std::string path, std::string body,
+                         sol::optional<std::string> contentType) {
+	auto content = std::make_shared<const PublishedContent>(PublishedContent{
+	    std::move(body), contentType.value_or("text/plain")});
+
+	std::unique_lock<std::shared_mutex> lock(publishedMutex);
+	published[std::move(path)] = std::move(content);
+}
+
+void HTTPServer::unpublish(std::string path) {
+	std::unique_lock<std::shared_mutex> lock(publishedMutex);
+	published.erase(path);
+}
+
+void HTTPServer::failQueued() {
+	std::shared_ptr<PendingServerRequest> pending;
+	while (queue.pop(pending)) {
+		numQueued--;
+		pending->complete(503, "Service Unavailable", "text/plain");
+	}
+}
+
+void HTTPServer::stopAll() {
+	for (auto server : servers) {
+		server->stop();
+	}
+}
+
+void HTTPServer::stop() {
+	routeCallbacks.clear();
+
+	if (!listenThread.joinable()) {
+		return;
+	}
+
+	{
+		std::unique_lock<std::shared_mutex> lock(routesMutex);
+		stopping = true;
+	}
+
+	server.stop();
+	failQueued();
+
+	// Listener threads are joined on shutdown, so don't leave them waiting on
+	// responses Lua is still holding on to
+	for (const auto& weak : outstanding) {
+		if (auto pending = weak.lock()) {
+			pending->complete(503, "Service Unavailable", "text/plain");
+		}
+	}
+	outstanding.clear();
+
+	listenThread.join();
+}
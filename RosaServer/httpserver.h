@@ -0,0 +1,114 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+#include "api.h"
+#include "mpscqueue.h"
+
+static constexpr unsigned int httpServerNumThreads = 16;
+// Each request to a Lua route holds a listener thread until Lua responds, so
+// only this many can wait at once; the rest of the threads are kept free for
+// published content and 404s.
+static constexpr unsigned int maxHTTPServerWaitingRequests = 12;
+static constexpr unsigned int httpServerResponseTimeoutSeconds = 10;
+
+// A request waiting on a listener thread for the main thread to respond.
+struct PendingServerRequest {
+	std::string routeKey;
+	std::string method;
+	std::string path;
+	std::string body;
+	std::string remoteAddress;
+	httplib::Headers headers;
+	httplib::Params params;
+
+	std::mutex mutex;
+	std::condition_variable responded;
+	bool done = false;
+	int status = 200;
+	std::string responseBody;
+	std::string contentType = "text/plain";
+	httplib::Headers responseHeaders;
+
+	void complete(int status, std::string body, std::string contentType);
+};
+
+class HTTPServerResponse {
+	std::shared_ptr<PendingServerRequest> request;
+	int status = 200;
+	httplib::Headers headers;
+
+ public:
+	HTTPServerResponse(std::shared_ptr<PendingServerRequest> request)
+	    : request(request) {}
+	~HTTPServerResponse();
+
+	int getStatus() const { return status; }
+	void setStatus(int status) { this->status = status; }
+	void setHeader(std::string name, std::string value);
+	void send(std::string body, sol::optional<std::string> contentType);
+	bool isSent() const { return !request; }
+};
+
+struct PublishedContent {
+	std::string body;
+	std::string contentType;
+};
+
+class HTTPServer {
+	httplib::Server server;
+	std::thread listenThread;
+	std::atomic_bool running = false;
+
+	MPSCQueue<std::shared_ptr<PendingServerRequest>> queue;
+	std::atomic_uint numQueued = 0;
+	std::atomic_uint numWaiting = 0;
+
+	// Route keys are read by listener threads to 404 without involving the main
+	// thread; the callbacks themselves are only touched on the main thread.
+	// Listener threads also hold it while queueing, so once `stopping` is set
+	// nothing new can be queued.
+	std::shared_mutex routesMutex;
+	std::unordered_set<std::string> routeKeys;
+	bool stopping = false;
+	std::unordered_map<std::string, sol::protected_function> routeCallbacks;
+
+	// Handed to Lua but not yet responded to
+	std::vector<std::weak_ptr<PendingServerRequest>> outstanding;
+
+	std::shared_mutex publishedMutex;
+	std::unordered_map<std::string, std::shared_ptr<const PublishedContent>>
+	    published;
+
+	void handle(const httplib::Request& req, httplib::Response& res);
+	bool servePublished(const httplib::Request& req, httplib::Response& res);
+	void processRequests();
+	void failQueued();
+
+ public:
+	HTTPServer(std::string host, unsigned short port);
+	~HTTPServer();
+
+	static void processAll();
+	static void stopAll();
+
+	void route(std::string method, std::string path,
+	           sol::protected_function callback);
+	void removeRoute(std::string method, std::string path);
+	void publish(std::string path, std::string body,
+	             sol::optional<std::string> contentType);
+	void unpublish(std::string path);
+	void stop();
+
+	bool isRunning() const { return running; }
+	unsigned int getNumQueued() const { return numQueued; }
+};
@@ -0,0 +1,400 @@
+#include "metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <charconv>
+#include <cmath>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+
+#include "api.h"
+#include "netstats.h"
+#include "worker.h"
+
+namespace Metrics {
+const std::vector<double> defaultBuckets = {
+    0.0005, 0.001, 0.0025, 0.005, 0.01, 0.016, 0.025, 0.05, 0.1, 0.25};
+
+enum class Type { counter, gauge, histogram };
+
+struct Entry {
+	Type type;
+	std::string help;
+	std::unique_ptr<Counter> counter;
+	std::unique_ptr<Gauge> gauge;
+	std::unique_ptr<Histogram> histogram;
+};
+
+static std::mutex registryMutex;
+
+// Function-local so metrics can be registered from static initializers in
+// other files. Sorted so every series of a family is rendered together.
+static std::map<std::string, Entry>& getRegistry() {
+	static std::map<std::string, Entry> registry;
+	return registry;
+}
+
+// Pre-rendered sections for series that come and go, keyed by owner
+static std::map<std::string, std::string> published;
+
+static std::atomic_int exporterPort = -1;
+
+Histogram::Histogram(std::vector<double> bounds)
+    : bounds(std::move(bounds)),
+      buckets(new std::atomic_uint64_t[this->bounds.size() + 1]()) {}
+
+void Histogram::observe(double value) {
+	size_t index = 0;
+	while (index < bounds.size() && value > bounds[index]) index++;
+
+	buckets[index].fetch_add(1, std::memory_order_relaxed);
+	count.fetch_add(1, std::memory_order_relaxed);
+	sum.add(value);
+}
+
+static Entry& getEntry(const std::string& name, Type type,
+                       const std::string& help) {
+	auto& registry = getRegistry();
+
+	auto search = registry.find(name);
+	if (search != registry.end()) {
+		if (search->second.type != type) {
+			throw std::invalid_argument("Metric already registered as another type");
+		}
+		return search->second;
+	}
+
+	auto& entry = registry[name];
+	entry.type = type;
+	entry.help = help;
+	return entry;
+}
+
+Counter& counter(const std::string& name, const std::string& help) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+
+	auto& entry = getEntry(name, Type::counter, help);
+	if (!entry.counter) entry.counter = std::make_unique<Counter>();
+	return *entry.counter;
+}
+
+Gauge& gauge(const std::string& name, const std::string& help) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+
+	auto& entry = getEntry(name, Type::gauge, help);
+	if (!entry.gauge) entry.gauge = std::make_unique<Gauge>();
+	return *entry.gauge;
+}
+
+Histogram& histogram(const std::string& name, const std::string& help,
+                     const std::vector<double>& bounds) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+
+	auto& entry = getEntry(name, Type::histogram, help);
+	if (!entry.histogram) entry.histogram = std::make_unique<Histogram>(bounds);
+	return *entry.histogram;
+}
+
+std::string formatValue(double value) {
+	if (std::isnan(value)) return "NaN";
+	if (std::isinf(value)) return value > 0 ? "+Inf" : "-Inf";
+
+	char buffer[32];
+	auto result = std::to_chars(buffer, buffer + sizeof(buffer), value);
+	return std::string(buffer, result.ptr);
+}
+
+static inline std::string_view getFamily(std::string_view name) {
+	return name.substr(0, name.find('{'));
+}
+
+// `name{a="b"}` + `_bucket`, `le="1"` -> `name_bucket{a="b",le="1"}`
+static void writeSeries(std::ostringstream& out, std::string_view name,
+                        std::string_view suffix, std::string_view extraLabel) {
+	auto brace = name.find('{');
+	out << name.substr(0, brace) << suffix;
+
+	std::string_view labels;
+	if (brace != std::string_view::npos) {
+		labels = name.substr(brace + 1, name.size() - brace - 2);
+	}
+
+	if (labels.empty() && extraLabel.empty()) return;
+
+	out << '{' << labels;
+	if (!labels.empty() && !extraLabel.empty()) out << ',';
+	out << extraLabel << '}';
+}
+
+std::string render() {
+	std::ostringstream out;
+	std::string_view lastFamily;
+
+	std::lock_guard<std::mutex> guard(registryMutex);
+	for (const auto& [name, entry] : getRegistry()) {
+		auto family = getFamily(name);
+		if (family != lastFamily) {
+			lastFamily = family;
+			if (!entry.help.empty()) {
+				out << "# HELP " << family << ' ' << entry.help << '\n';
+			}
+
+			static constexpr const char* typeNames[] = {"counter", "gauge",
+			                                            "histogram"};
+			out << "# TYPE " << family << ' '
+			    << typeNames[static_cast<int>(entry.type)] << '\n';
+		}
+
+		switch (entry.type) {
+			case Type::counter:
+				writeSeries(out, name, "", "");
+				out << ' ' << entry.counter->get() << '\n';
+				break;
+			case Type::gauge:
+				writeSeries(out, name, "", "");
+				out << ' ' << formatValue(entry.gauge->get()) << '\n';
+				break;
+			case Type::histogram: {
+				const auto& histogram = *entry.histogram;
+				const auto& bounds = histogram.getBounds();
+
+				uint64_t cumulative = 0;
+				for (size_t i = 0; i <= bounds.size(); i++) {
+					cumulative += histogram.getBucket(i);
+
+					std::string le = "le=\"";
+					le += i == bounds.size() ? "+Inf" : formatValue(bounds[i]);
+					le += '"';
+
+					writeSeries(out, name, "_bucket", le);
+					out << ' ' << cumulative << '\n';
+				}
+
+				writeSeries(out, name, "_sum", "");
+				out << ' ' << formatValue(histogram.getSum()) << '\n';
+				writeSeries(out, name, "_count", "");
+				out << ' ' << histogram.getCount() << '\n';
+				break;
+			}
+		}
+	}
+
+	for (const auto& [owner, text] : published) out << text;
+
+	return out.str();
+}
+
+void publish(const std::string& owner, std::string text) {
+	std::lock_guard<std::mutex> guard(registryMutex);
+	published[owner] = std::move(text);
+}
+
+// A client that connects and then goes quiet mustn't hold up every scrape
+// after it.
+static constexpr time_t exporterClientTimeoutSeconds = 5;
+
+static void runExporter(int socketDescriptor) {
+	char requestBuffer[4096];
+	const timeval timeout{exporterClientTimeoutSeconds, 0};
+
+	while (true) {
+		int client = accept(socketDescriptor, nullptr, nullptr);
+		if (client == -1) {
+			if (errno == EINTR) continue;
+			return;
+		}
+
+		setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+		// Every path gets the metrics, so the request itself is ignored
+		if (read(client, requestBuffer, sizeof(requestBuffer)) <= 0) {
+			close(client);
+			continue;
+		}
+
+		auto body = render();
+		std::string response =
+		    "HTTP/1.0 200 OK\r\n"
+		    "Content-Type: text/plain; version=0.0.4\r\n"
+		    "Content-Length: " +
+		    std::to_string(body.size()) + "\r\n\r\n" + body;
+
+		size_t written = 0;
+		while (written < response.size()) {
+			auto res = write(client, response.data() + written,
+			                 response.size() - written);
+			if (res <= 0) break;
+			written += res;
+		}
+
+		close(client);
+	}
+}
+
+// Serves the registry from a dedicated thread, independent of the Lua state
+// and of the game tick. Can only be started once per process.
+void listen(unsigned short port) {
+	int expected = -1;
+	if (!exporterPort.compare_exchange_strong(expected, port)) {
+		if (expected == port) return;
+		throw std::runtime_error("Metrics exporter is already listening");
+	}
+
+	int socketDescriptor = socket(AF_INET, SOCK_STREAM, 0);
+	if (socketDescriptor == -1) {
+		exporterPort = -1;
+		throw std::runtime_error(strerror(errno));
+	}
+
+	int reuseAddress = 1;
+	setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, &reuseAddress,
+	           sizeof(reuseAddress));
+
+	sockaddr_in bindAddress{};
+	bindAddress.sin_family = AF_INET;
+	bindAddress.sin_port = htons(port);
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(socketDescriptor, reinterpret_cast<sockaddr*>(&bindAddress),
+	         sizeof(bindAddress)) == -1 ||
+	    ::listen(socketDescriptor, 16) == -1) {
+		auto error = strerror(errno);
+		close(socketDescriptor);
+		exporterPort = -1;
+		throw std::runtime_error(error);
+	}
+
+	std::thread(runExporter, socketDescriptor).detach();
+}
+
+namespace server {
+static constexpr const char* tickPhaseHelp =
+    "Time spent in each part of the server tick in seconds";
+
+Histogram& logicTime = histogram(
+    "rosaserver_tick_phase_seconds{phase=\"logic\"}", tickPhaseHelp);
+Histogram& luaLogicTime = histogram(
+    "rosaserver_tick_phase_seconds{phase=\"lua_logic\"}", tickPhaseHelp);
+Histogram& physicsTime = histogram(
+    "rosaserver_tick_phase_seconds{phase=\"physics\"}", tickPhaseHelp);
+Histogram& sendTime =
+    histogram("rosaserver_tick_phase_seconds{phase=\"send\"}", tickPhaseHelp);
+
+static constexpr const char* workerQueueHelp =
+    "Messages waiting in worker queues";
+
+static Gauge& workerMessagesToWorker = gauge(
+    "rosaserver_worker_queue_depth{direction=\"to_worker\"}", workerQueueHelp);
+static Gauge& workerMessagesFromWorker =
+    gauge("rosaserver_worker_queue_depth{direction=\"from_worker\"}",
+          workerQueueHelp);
+
+static Gauge& luaHeapBytes =
+    gauge("rosaserver_lua_heap_bytes", "Memory used by the main Lua state");
+static Gauge& httpInFlight = gauge("rosaserver_http_requests_in_flight",
+                                   "Asynchronous HTTP requests in flight");
+};  // namespace server
+
+// Only called on the main thread, and event names are always literals, so the
+// lookup can be keyed by pointer.
+void countHookCall(const char* event) {
+	static std::unordered_map<const char*, Counter*> counters;
+
+	auto search = counters.find(event);
+	if (search != counters.end()) {
+		search->second->add();
+		return;
+	}
+
+	auto& hookCounter =
+	    counter(std::string("rosaserver_hook_calls_total{hook=\"") + event + "\"}",
+	            "Calls into hook.run by event");
+	counters.emplace(event, &hookCounter);
+	hookCounter.add();
+}
+
+struct SlotMetrics {
+	Gauge& used;
+	int (*getCount)();
+};
+
+static SlotMetrics createSlotMetrics(const char* type, int max,
+                                     int (*getCount)()) {
+	std::string labels = std::string("{type=\"") + type + "\"}";
+
+	gauge("rosaserver_slots_max" + labels, "Size of each entity array")
+	    .set(max);
+
+	return {gauge("rosaserver_slots_used" + labels, "Active entity slots"),
+	        getCount};
+}
+
+// Walking every entity array isn't free, so most of this only runs once a
+// second.
+void sampleGameState() {
+	// Summed here rather than counted per message, which would have every worker
+	// thread contending on the same gauges
+	size_t toWorkers, fromWorkers;
+	Worker::sumQueueSizes(toWorkers, fromWorkers);
+	server::workerMessagesToWorker.set(toWorkers);
+	server::workerMessagesFromWorker.set(fromWorkers);
+
+	static auto lastSample = std::chrono::steady_clock::now();
+	auto now = std::chrono::steady_clock::now();
+	if (now - lastSample < std::chrono::seconds(1)) return;
+
+	double elapsedSeconds =
+	    std::chrono::duration<double>(now - lastSample).count();
+	lastSample = now;
+
+	static SlotMetrics slots[] = {
+	    createSlotMetrics("accounts", maxNumberOfAccounts,
+	                      Lua::accounts::getCount),
+	    createSlotMetrics("players", maxNumberOfPlayers, Lua::players::getCount),
+	    createSlotMetrics("humans", maxNumberOfHumans, Lua::humans::getCount),
+	    createSlotMetrics("items", maxNumberOfItems, Lua::items::getCount),
+	    createSlotMetrics("vehicles", maxNumberOfVehicles,
+	                      Lua::vehicles::getCount),
+	    createSlotMetrics("rigidBodies", maxNumberOfRigidBodies,
+	                      Lua::rigidBodies::getCount),
+	    createSlotMetrics("bonds", maxNumberOfBonds, Lua::bonds::getCount),
+	};
+
+	for (auto& slot : slots) {
+		slot.used.set(slot.getCount());
+	}
+
+	server::luaHeapBytes.set(lua_gc(lua->lua_state(), LUA_GCCOUNT, 0) * 1024.0 +
+	                         lua_gc(lua->lua_state(), LUA_GCCOUNTB, 0));
+	server::httpInFlight.set(Lua::http::getNumInFlight());
+
+	NetStats::sample(elapsedSeconds);
+}
+};  // namespace Metrics
+
+namespace Lua {
+namespace metrics {
+Metrics::Counter* counter(std::string name, sol::optional<std::string> help) {
+	return &Metrics::counter(name, help.value_or(""));
+}
+
+Metrics::Gauge* gauge(std::string name, sol::optional<std::string> help) {
+	return &Metrics::gauge(name, help.value_or(""));
+}
+
+Metrics::Histogram* histogram(std::string name, sol::optional<std::string> help,
+                              sol::optional<std::vector<double>> bounds) {
+	return &Metrics::histogram(name, help.value_or(""),
+	                           bounds.value_or(Metrics::defaultBuckets));
+}
+}  // namespace metrics
+}  // namespace Lua
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "sol/sol.hpp"
+
+namespace Metrics {
+static constexpr const char* prefix = "rosaserver_";
+
+class Counter {
+	std::atomic_uint64_t value = 0;
+
+ public:
+	void add(uint64_t amount = 1) {
+		value.fetch_add(amount, std::memory_order_relaxed);
+	}
+	uint64_t get() const { return value.load(std::memory_order_relaxed); }
+};
+
+class Gauge {
+	std::atomic<double> value = 0.0;
+
+ public:
+	void set(double newValue) {
+		value.store(newValue, std::memory_order_relaxed);
+	}
+	void add(double amount) {
+		double current = value.load(std::memory_order_relaxed);
+		while (!value.compare_exchange_weak(current, current + amount,
+		                                    std::memory_order_relaxed))
+			;
+	}
+	double get() const { return value.load(std::memory_order_relaxed); }
+};
+
+class Histogram {
+	const std::vector<double> bounds;
+	// One per bound plus +Inf; not cumulative, that's done when rendering
+	std::unique_ptr<std::atomic_uint64_t[]> buckets;
+	std::atomic_uint64_t count = 0;
+	Gauge sum;
+
+ public:
+	Histogram(std::vector<double> bounds);
+
+	void observe(double value);
+	const std::vector<double>& getBounds() const { return bounds; }
+	uint64_t getBucket(size_t index) const {
+		return buckets[index].load(std::memory_order_relaxed);
+	}
+	uint64_t getCount() const { return count.load(std::memory_order_relaxed); }
+	double getSum() const { return sum.get(); }
+};
+
+// Seconds, sized for a 16 ms tick
+extern const std::vector<double> defaultBuckets;
+
+// Names may carry Prometheus labels, e.g. `hook_calls_total{hook="Logic"}`.
+// Metrics are never unregistered, so the references stay valid forever and
+// survive Lua resets.
+Counter& counter(const std::string& name, const std::string& help = "");
+Gauge& gauge(const std::string& name, const std::string& help = "");
+Histogram& histogram(const std::string& name, const std::string& help = "",
+                     const std::vector<double>& bounds = defaultBuckets);
+
+std::string render();
+// Shortest text that parses back to exactly the same value
+std::string formatValue(double value);
+// Replaces a block of already formatted series appended to every scrape
+void publish(const std::string& owner, std::string text);
+void listen(unsigned short port);
+
+class ScopedTimer {
+	Histogram& histogram;
+	std::chrono::steady_clock::time_point start;
+
+ public:
+	ScopedTimer(Histogram& histogram)
+	    : histogram(histogram), start(std::chrono::steady_clock::now()) {}
+	~ScopedTimer() {
+		histogram.observe(std::chrono::duration<double>(
+		                      std::chrono::steady_clock::now() - start)
+		                      .count());
+	}
+};
+
+// Built-in metrics updated from the engine hooks
+namespace server {
+extern Histogram& logicTime;
+extern Histogram& luaLogicTime;
+extern Histogram& physicsTime;
+extern Histogram& sendTime;
+};  // namespace server
+
+void countHookCall(const char* event);
+void sampleGameState();
+};  // namespace Metrics
+
+namespace Lua {
+namespace metrics {
+Metrics::Counter* counter(std::string name, sol::optional<std::string> help);
+Metrics::Gauge* gauge(std::string name, sol::optional<std::string> help);
+Metrics::Histogram* histogram(std::string name, sol::optional<std::string> help,
+                              sol::optional<std::vector<double>> bounds);
+}  // namespace metrics
+}  // namespace Lua
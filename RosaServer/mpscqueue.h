@@ -0,0 +1,53 @@
+#pragma once
+#include <atomic>
+#include <utility>
+
+// Unbounded lock-free multi-producer single-consumer queue (Vyukov). Any
+// thread may push; only one thread, usually the main thread, may pop.
+template <typename T>
+class MPSCQueue {
+	struct Node {
+		std::atomic<Node*> next = nullptr;
+		T value;
+	};
+
+	std::atomic<Node*> head;
+	Node* tail;
+
+ public:
+	MPSCQueue() {
+		Node* stub = new Node;
+		head.store(stub, std::memory_order_relaxed);
+		tail = stub;
+	}
+
+	~MPSCQueue() {
+		T discarded;
+		while (pop(discarded))
+			;
+		delete tail;
+	}
+
+	MPSCQueue(const MPSCQueue&) = delete;
+	MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+	void push(T value) {
+		Node* node = new Node;
+		node->value = std::move(value);
+
+		Node* previous = head.exchange(node, std::memory_order_acq_rel);
+		previous->next.store(node, std::memory_order_release);
+	}
+
+	bool pop(T& out) {
+		Node* next = tail->next.load(std::memory_order_acquire);
+		if (next == nullptr) {
+			return false;
+		}
+
+		out = std::move(next->value);
+		delete tail;
+		tail = next;
+		return true;
+	}
+};
@@ -0,0 +1,123 @@
+#include "netstats.h"
+
+#include <cmath>
+#include <sstream>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "api.h"
+#include "metrics.h"
+
+static std::unordered_map<uint64_t, ConnectionStats> connectionStats;
+
+// Most packets in a row go to the same client, so skip the hash when we can
+static uint64_t lastKey = -1;
+static ConnectionStats* lastStats = nullptr;
+
+static Metrics::Counter& packetsSent =
+    Metrics::counter("rosaserver_packets_sent_total", "Packets sent to clients");
+static Metrics::Counter& bytesSent =
+    Metrics::counter("rosaserver_bytes_sent_total", "Bytes sent to clients");
+static Metrics::Counter& packetsReceived = Metrics::counter(
+    "rosaserver_packets_received_total", "Packets received from clients");
+static Metrics::Counter& bytesReceived = Metrics::counter(
+    "rosaserver_bytes_received_total", "Bytes received from clients");
+
+static inline uint64_t getKey(unsigned int address, unsigned short port) {
+	return static_cast<uint64_t>(address) << 16 | port;
+}
+
+static Metrics::Counter& getTypeCounter(int packetType) {
+	static Metrics::Counter* counters[numPacketTypes] = {};
+
+	auto& counter = counters[packetType];
+	if (!counter) {
+		counter = &Metrics::counter(
+		    "rosaserver_packets_sent_by_type_total{type=\"" +
+		        std::to_string(packetType) + "\"}",
+		    "Packets sent to clients by packet type");
+	}
+	return *counter;
+}
+
+namespace NetStats {
+void recordSent(unsigned int address, unsigned short port, int packetType,
+                int packetSize) {
+	packetType &= numPacketTypes - 1;
+
+	auto key = getKey(address, port);
+	if (key != lastKey) {
+		auto& stats = connectionStats[key];
+		stats.address = address;
+		stats.port = port;
+
+		lastKey = key;
+		lastStats = &stats;
+	}
+
+	lastStats->bytesSent += packetSize;
+	lastStats->packetsSent++;
+	lastStats->packetsSentByType[packetType]++;
+
+	packetsSent.add();
+	bytesSent.add(packetSize);
+	getTypeCounter(packetType).add();
+}
+
+// The engine doesn't keep the sender of the last packet anywhere we can read,
+// so received traffic is only accounted for in total.
+void recordReceived(int packetSize) {
+	packetsReceived.add();
+	if (packetSize > 0) bytesReceived.add(packetSize);
+}
+
+const ConnectionStats* find(unsigned int address, unsigned short port) {
+	auto search = connectionStats.find(getKey(address, port));
+	if (search == connectionStats.end()) return nullptr;
+	return &search->second;
+}
+
+// Updates send rates, forgets clients that have left and publishes
+// per-connection series for the exporter.
+void sample(double elapsedSeconds) {
+	std::unordered_set<uint64_t> connected;
+	for (unsigned int i = 0; i < *Engine::numConnections; i++) {
+		auto con = &Engine::connections[i];
+		connected.insert(getKey(con->address, con->port));
+	}
+
+	double alpha = 1.0 - std::exp(-elapsedSeconds / sendRateTimeConstant);
+
+	std::ostringstream series;
+	series << "# TYPE rosaserver_connection_bytes_sent_total counter\n";
+
+	std::ostringstream rates;
+	rates << "# TYPE rosaserver_connection_send_bytes_per_second gauge\n";
+
+	for (auto it = connectionStats.begin(); it != connectionStats.end();) {
+		if (!connected.count(it->first)) {
+			it = connectionStats.erase(it);
+			continue;
+		}
+
+		auto& stats = it->second;
+		double rate = (stats.bytesSent - stats.lastSampledBytes) / elapsedSeconds;
+		stats.bytesPerSecond += alpha * (rate - stats.bytesPerSecond);
+		stats.lastSampledBytes = stats.bytesSent;
+
+		auto labels = "{address=\"" + addressFromInteger(stats.address) +
+		              "\",port=\"" + std::to_string(stats.port) + "\"}";
+		series << "rosaserver_connection_bytes_sent_total" << labels << ' '
+		       << stats.bytesSent << '\n';
+		rates << "rosaserver_connection_send_bytes_per_second" << labels << ' '
+		      << Metrics::formatValue(stats.bytesPerSecond) << '\n';
+
+		++it;
+	}
+
+	lastKey = -1;
+	lastStats = nullptr;
+
+	Metrics::publish("connections", series.str() + rates.str());
+}
+};  // namespace NetStats
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+static constexpr int numPacketTypes = 256;
+// How quickly bytesPerSecond follows changes, in seconds
+static constexpr double sendRateTimeConstant = 5.0;
+
+struct ConnectionStats {
+	unsigned int address;
+	unsigned short port;
+
+	uint64_t bytesSent = 0;
+	uint64_t packetsSent = 0;
+	uint64_t packetsSentByType[numPacketTypes] = {};
+
+	uint64_t lastSampledBytes = 0;
+	double bytesPerSecond = 0;
+};
+
+// Traffic accounting kept natively so it costs nothing in Lua. Connections are
+// keyed by address and port since their index in Engine::connections shifts
+// as clients leave.
+namespace NetStats {
+void recordSent(unsigned int address, unsigned short port, int packetType,
+                int packetSize);
+void recordReceived(int packetSize);
+const ConnectionStats* find(unsigned int address, unsigned short port);
+void sample(double elapsedSeconds);
+};  // namespace NetStats
@@ -0,0 +1,201 @@
+#include "pathrequests.h"
+
+#include <algorithm>
+#include <deque>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include "api.h"
+#include "mpscqueue.h"
+#include "threadpool.h"
+
+// Pairs per task when splitting up a batch
+static constexpr size_t pathBatchChunkSize = 16;
+
+struct PathSearch {
+	unsigned int startNodeId;
+	unsigned int goalNodeId;
+};
+
+struct PathResult {
+	unsigned int id;
+	size_t first;
+	std::vector<SharedPath> paths;
+	std::string error;
+};
+
+struct PendingPathRequest {
+	sol::protected_function callback;
+	bool isBatch;
+	size_t numRemaining;
+	std::vector<SharedPath> paths;
+	// The first search that failed, if any
+	std::string error;
+};
+
+static MPSCQueue<PathResult> pathResults;
+static std::unordered_map<unsigned int, PendingPathRequest> pendingRequests;
+// Finished but not yet called back, when the budget ran out
+static std::deque<unsigned int> readyRequests;
+static unsigned int numSearchesInFlight = 0;
+static unsigned int nextRequestID = 0;
+
+static ThreadPool& getPathPool() {
+	static ThreadPool* pool =
+	    new ThreadPool(std::max(1u, std::thread::hardware_concurrency() / 2));
+	return *pool;
+}
+
+static void completeSearches(PathResult&& result) {
+	auto search = pendingRequests.find(result.id);
+	if (search == pendingRequests.end()) return;
+
+	PendingPathRequest& request = search->second;
+	auto& paths = result.paths;
+	std::move(paths.begin(), paths.end(), request.paths.begin() + result.first);
+	if (request.error.empty()) request.error = std::move(result.error);
+	request.numRemaining -= paths.size();
+	if (request.numRemaining == 0) readyRequests.push_back(result.id);
+}
+
+static bool queueSearches(PointGraph& graph,
+                          const std::vector<PathSearch>& searches,
+                          sol::protected_function callback, bool isBatch) {
+	if (numSearchesInFlight + searches.size() > maxPathSearchesInFlight) {
+		return false;
+	}
+
+	// Validated up front, so nothing is queued if any of them are bad
+	if (!graph.getIsFrozen()) throw std::runtime_error("Graph isn't frozen");
+	for (const PathSearch& search : searches) {
+		graph.throwIfInvalidNode(search.startNodeId);
+		graph.throwIfInvalidNode(search.goalNodeId);
+	}
+
+	const unsigned int id = nextRequestID++;
+	auto& request = pendingRequests[id];
+	request = {std::move(callback), isBatch, searches.size(),
+	           std::vector<SharedPath>(searches.size()), {}};
+
+	// Whatever is already cached skips the pool entirely
+	std::vector<size_t> uncached;
+	for (size_t i = 0; i < searches.size(); i++) {
+		if (!graph.getCachedPath(searches[i].startNodeId,
+		                         searches[i].goalNodeId, request.paths[i])) {
+			uncached.push_back(i);
+		}
+	}
+
+	request.numRemaining = uncached.size();
+	if (uncached.empty()) {
+		readyRequests.push_back(id);
+		return true;
+	}
+
+	numSearchesInFlight += uncached.size();
+
+	for (size_t begin = 0; begin < uncached.size();
+	     begin += pathBatchChunkSize) {
+		const size_t end = std::min(begin + pathBatchChunkSize, uncached.size());
+
+		std::vector<std::pair<size_t, PathSearch>> chunk;
+		for (size_t i = begin; i < end; i++) {
+			chunk.emplace_back(uncached[i], searches[uncached[i]]);
+		}
+
+		graph.beginPendingSearch();
+		getPathPool().push([&graph, id, chunk = std::move(chunk)] {
+			for (const auto& [index, search] : chunk) {
+				PathResult result{id, index, {nullptr}, {}};
+				try {
+					result.paths[0] =
+					    graph.findCachedPath(search.startNodeId, search.goalNodeId);
+				} catch (std::exception& e) {
+					result.error = e.what();
+				}
+				pathResults.push(std::move(result));
+			}
+			graph.endPendingSearch();
+		});
+	}
+
+	return true;
+}
+
+bool PathRequests::findPathAsync(PointGraph& graph, unsigned int startNodeId,
+                                 unsigned int goalNodeId,
+                                 sol::protected_function callback) {
+	return queueSearches(graph, {{startNodeId, goalNodeId}}, std::move(callback),
+	                     false);
+}
+
+bool PathRequests::findPathsBatch(PointGraph& graph, sol::table pairs,
+                                  sol::protected_function callback) {
+	std::vector<PathSearch> searches;
+	searches.reserve(pairs.size());
+
+	for (size_t i = 1; i <= pairs.size(); i++) {
+		sol::table pair = pairs[i];
+		searches.push_back({pair[1], pair[2]});
+	}
+
+	return queueSearches(graph, searches, std::move(callback), true);
+}
+
+unsigned int PathRequests::getNumInFlight() { return numSearchesInFlight; }
+
+// Batches mark a missing path with false, so the table has no holes
+static sol::object getPathObject(sol::state_view lua, const SharedPath& path,
+                                 bool isBatch) {
+	if (path) return sol::make_object(lua, sol::as_table(*path));
+	if (isBatch) return sol::make_object(lua, false);
+	return sol::make_object(lua, sol::nil);
+}
+
+// Called at the start of every logic tick on the main thread.
+void PathRequests::processResults() {
+	PathResult result;
+	while (pathResults.pop(result)) {
+		numSearchesInFlight -= result.paths.size();
+		completeSearches(std::move(result));
+	}
+
+	sol::state_view state(*lua);
+
+	unsigned int numCalled = 0;
+	while (numCalled < maxPathCallbacksPerTick && !readyRequests.empty()) {
+		const unsigned int id = readyRequests.front();
+		readyRequests.pop_front();
+
+		auto search = pendingRequests.find(id);
+		if (search == pendingRequests.end()) continue;
+
+		PendingPathRequest request = std::move(search->second);
+		pendingRequests.erase(search);
+		numCalled++;
+
+		if (!request.error.empty()) {
+			auto res = request.callback(sol::nil, request.error);
+			noLuaCallError(&res);
+		} else if (request.isBatch) {
+			sol::table paths = state.create_table(request.paths.size());
+			for (size_t i = 0; i < request.paths.size(); i++) {
+				paths[i + 1] = getPathObject(state, request.paths[i], true);
+			}
+
+			auto res = request.callback(paths);
+			noLuaCallError(&res);
+		} else {
+			auto res =
+			    request.callback(getPathObject(state, request.paths[0], false));
+			noLuaCallError(&res);
+		}
+	}
+}
+
+void PathRequests::clearCallbacks() {
+	pendingRequests.clear();
+	readyRequests.clear();
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "pointgraph.h"
+#include "sol/sol.hpp"
+
+static constexpr unsigned int maxPathSearchesInFlight = 4096;
+static constexpr unsigned int maxPathCallbacksPerTick = 256;
+
+// Searches of frozen PointGraphs on a shared thread pool, with callbacks run
+// on the main thread at the start of the next logic tick. If any search fails,
+// such as when the graph is destroyed first, the callback gets nil and the
+// error instead.
+namespace PathRequests {
+bool findPathAsync(PointGraph& graph, unsigned int startNodeId,
+                   unsigned int goalNodeId, sol::protected_function callback);
+bool findPathsBatch(PointGraph& graph, sol::table pairs,
+                    sol::protected_function callback);
+unsigned int getNumInFlight();
+
+void processResults();
+void clearCallbacks();
+};  // namespace PathRequests
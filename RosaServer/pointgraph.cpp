@@ -1,34 +1,99 @@
 #include "pointgraph.h"
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <numeric>
 #include <queue>
 #include <stdexcept>
-#include <unordered_set>
 
-PointGraph::PointGraph(unsigned int squareRootCacheSize) {
-	squareRootCache = new double[squareRootCacheSize];
-	numCachedSquareRoots = squareRootCacheSize;
+static constexpr const char* errorInvalidNode = "Node doesn't exist";
+static constexpr const char* errorFrozen = "Graph is frozen";
+static constexpr const char* errorNotFrozen = "Graph isn't frozen";
+static constexpr const char* errorInvalidFile = "Invalid graph file";
+static constexpr const char* errorClosing = "Graph was destroyed";
+
+static constexpr unsigned int maxLandmarks = 64;
+
+PointGraph::PointGraph(unsigned int squareRootCacheSize,
+                       double heuristicWeight)
+    : heuristicWeight(heuristicWeight), squareRootCache(squareRootCacheSize) {
+	if (!(heuristicWeight >= 0.)) {
+		throw std::invalid_argument("Heuristic weight can't be negative");
+	}
 
 	for (unsigned int square = 0; square < squareRootCacheSize; square++) {
 		squareRootCache[square] = std::sqrt(square);
 	}
 }
 
-PointGraph::~PointGraph() { delete[] squareRootCache; }
+PointGraph::~PointGraph() {
+	isClosing = true;
+	if (landmarkThread.joinable()) landmarkThread.join();
+
+	std::unique_lock<std::mutex> lock(pendingMutex);
+	pendingDone.wait(lock, [this] { return numPending == 0; });
+}
 
-int PointGraph::getSize() const { return nodes.size(); }
+std::unique_ptr<PointGraph> PointGraph::load(
+    const std::string& path, sol::optional<unsigned int> squareRootCacheSize,
+    sol::optional<double> heuristicWeight) {
+	auto graph = std::make_unique<PointGraph>(squareRootCacheSize.value_or(0),
+	                                          heuristicWeight.value_or(0.));
+	graph->frozen = FrozenGraph::load(path, graph->landmarks);
+	graph->spatialIndex = std::make_unique<SpatialIndex>(*graph->frozen);
+	graph->pathCache = std::make_unique<PathCache>(defaultPathCacheSize);
+	return graph;
+}
+
+void PointGraph::throwIfFrozen() const {
+	if (frozen) throw std::runtime_error(errorFrozen);
+}
+
+void PointGraph::throwIfNotFrozen() const {
+	if (!frozen) throw std::runtime_error(errorNotFrozen);
+}
+
+int PointGraph::getSize() const {
+	return frozen ? frozen->numNodes : nodes.size();
+}
 
 void PointGraph::addNode(const int x, const int y, const int z) {
+	throwIfFrozen();
+
 	NodePoint point{x, y, z};
 	nodes.emplace_back(point);
 	nodeIdByPoint.insert({point, nodes.size() - 1});
 }
 
+NodePoint PointGraph::getPoint(unsigned int index) const {
+	if (frozen) {
+		if (index >= frozen->numNodes) {
+			throw std::invalid_argument(errorInvalidNode);
+		}
+		return frozen->points[frozen->toInternal[index]];
+	}
+
+	if (index >= nodes.size()) throw std::invalid_argument(errorInvalidNode);
+	return nodes[index].point;
+}
+
 std::tuple<int, int, int> PointGraph::getNodePoint(unsigned int index) const {
-	const Node& node = nodes.at(index);
-	return std::make_tuple(node.point.x, node.point.y, node.point.z);
+	const NodePoint point = getPoint(index);
+	return std::make_tuple(point.x, point.y, point.z);
 }
 
 void PointGraph::addLink(unsigned int fromId, unsigned int toId, int cost) {
+	throwIfFrozen();
+
 	Node& node = nodes.at(fromId);
 	if (toId >= nodes.size()) {
 		throw std::invalid_argument("Link isn't to a valid node");
@@ -40,6 +105,13 @@ sol::object PointGraph::getNodeByPoint(int x, int y, int z,
                                        sol::this_state s) const {
 	sol::state_view lua(s);
 
+	if (frozen && nodeIdByPoint.empty()) {
+		nodeIdByPoint.reserve(frozen->numNodes);
+		for (uint32_t i = 0; i < frozen->numNodes; i++) {
+			nodeIdByPoint.insert({frozen->points[i], frozen->toExternal[i]});
+		}
+	}
+
 	const auto search = nodeIdByPoint.find({x, y, z});
 	if (search != nodeIdByPoint.end()) {
 		return sol::make_object(lua, search->second);
@@ -48,117 +120,1132 @@ sol::object PointGraph::getNodeByPoint(int x, int y, int z,
 	}
 }
 
-static inline double getHeuristicScore(const Node& node, const Node& goalNode,
-                                       const unsigned int numCachedSquareRoots,
-                                       const double* squareRootCache) {
-	const int deltaX = goalNode.point.x - node.point.x;
-	const int deltaY = goalNode.point.y - node.point.y;
-	const int deltaZ = goalNode.point.z - node.point.z;
+bool PointGraph::findNearestNode(const double point[3], double maxDistance,
+                                 int64_t component,
+                                 unsigned int& nodeId) const {
+	throwIfNotFrozen();
+
+	uint32_t nearest;
+	if (!spatialIndex->findNearest(*frozen, point, maxDistance, component,
+	                               nearest)) {
+		return false;
+	}
+	nodeId = frozen->toExternal[nearest];
+	return true;
+}
+
+static int64_t getComponentFilter(sol::optional<unsigned int> component) {
+	return component ? static_cast<int64_t>(*component)
+	                 : SpatialIndex::anyComponent;
+}
+
+sol::object PointGraph::getNearestNode(double x, double y, double z,
+                                       sol::optional<double> maxDistance,
+                                       sol::optional<unsigned int> component,
+                                       sol::this_state s) const {
+	sol::state_view lua(s);
+
+	const double point[3] = {x, y, z};
+	unsigned int nodeId;
+	if (findNearestNode(point,
+	                    maxDistance.value_or(
+	                        std::numeric_limits<double>::infinity()),
+	                    getComponentFilter(component), nodeId)) {
+		return sol::make_object(lua, nodeId);
+	}
+
+	return sol::make_object(lua, sol::nil);
+}
+
+// Nearest first
+sol::table PointGraph::getNodesInRadius(double x, double y, double z,
+                                        double radius,
+                                        sol::optional<unsigned int> component,
+                                        sol::this_state s) const {
+	sol::state_view lua(s);
+	throwIfNotFrozen();
+
+	const double point[3] = {x, y, z};
+	std::vector<std::pair<double, uint32_t>> found;
+	spatialIndex->findInRadius(*frozen, point, radius,
+	                           getComponentFilter(component), found);
+	std::sort(found.begin(), found.end());
 
-	const int square = deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ;
-	if (square < numCachedSquareRoots) {
-		return squareRootCache[square];
+	sol::table nodeIds = lua.create_table(found.size());
+	for (size_t i = 0; i < found.size(); i++) {
+		nodeIds[i + 1] = frozen->toExternal[found[i].second];
 	}
-	return square;
+	return nodeIds;
+}
+
+unsigned int PointGraph::getNodeComponent(unsigned int index) const {
+	throwIfNotFrozen();
+	if (index >= frozen->numNodes) throw std::invalid_argument(errorInvalidNode);
+	return spatialIndex->components[frozen->toInternal[index]];
 }
 
-static inline double getScoreOrInfinity(
-    const std::unordered_map<unsigned int, double>& scores,
-    const unsigned int nodeId) {
-	const auto search = scores.find(nodeId);
-	if (search != scores.end()) {
-		return search->second;
+unsigned int PointGraph::getNumComponents() const {
+	throwIfNotFrozen();
+	return spatialIndex->numComponents;
+}
+
+// Compacts the graph so it can't be changed any more, but is faster to search
+// and can be saved.
+void PointGraph::freeze() {
+	if (frozen) return;
+
+	frozen = FrozenGraph::build(nodes);
+	spatialIndex = std::make_unique<SpatialIndex>(*frozen);
+	pathCache = std::make_unique<PathCache>(defaultPathCacheSize);
+	nodes.clear();
+	nodes.shrink_to_fit();
+}
+
+void PointGraph::save(const std::string& path) const {
+	if (frozen) {
+		frozen->save(path, getLandmarks().get());
 	} else {
-		return std::numeric_limits<double>::infinity();
+		FrozenGraph::build(nodes)->save(path, nullptr);
 	}
 }
 
-static inline std::vector<unsigned int> reconstructPath(
-    std::unordered_map<unsigned int, unsigned int>& cameFrom,
-    unsigned int currentNodeId) {
-	std::vector<unsigned int> path{currentNodeId};
-	while (true) {
-		const auto search = cameFrom.find(currentNodeId);
-		if (search == cameFrom.end()) {
-			break;
+namespace {
+static constexpr unsigned int noNode = std::numeric_limits<unsigned int>::max();
+static constexpr uint32_t notQueued = std::numeric_limits<uint32_t>::max() - 1;
+static constexpr uint32_t closed = std::numeric_limits<uint32_t>::max();
+
+// Per-thread scratch space for searches, sized to the biggest graph searched
+// so far. A node's entries only count if its stamp matches the current
+// search, which makes starting a new search O(1) instead of clearing
+// everything.
+struct SearchState {
+	std::vector<uint32_t> stamps;
+	std::vector<double> gScores;
+	std::vector<double> fScores;
+	std::vector<unsigned int> cameFrom;
+	std::vector<uint32_t> heapPositions;
+	std::vector<unsigned int> heap;
+	uint32_t stamp = 0;
+
+	void begin(size_t numNodes) {
+		if (stamps.size() < numNodes) {
+			stamps.resize(numNodes, 0);
+			gScores.resize(numNodes);
+			fScores.resize(numNodes);
+			cameFrom.resize(numNodes);
+			heapPositions.resize(numNodes);
+		}
+
+		if (++stamp == 0) {
+			std::fill(stamps.begin(), stamps.end(), 0);
+			stamp = 1;
 		}
 
-		currentNodeId = search->second;
-		path.insert(path.begin(), currentNodeId);
+		heap.clear();
 	}
-	return path;
+
+	void discover(unsigned int node) {
+		if (stamps[node] == stamp) return;
+
+		stamps[node] = stamp;
+		gScores[node] = std::numeric_limits<double>::infinity();
+		cameFrom[node] = noNode;
+		heapPositions[node] = notQueued;
+	}
+
+	// Indexed binary min-heap on f-score, so a better path to a queued node
+	// moves it up in place instead of queueing a duplicate.
+	void siftUp(uint32_t position) {
+		const unsigned int node = heap[position];
+		const double key = fScores[node];
+
+		while (position > 0) {
+			const uint32_t parent = (position - 1) / 2;
+			if (fScores[heap[parent]] <= key) break;
+
+			heap[position] = heap[parent];
+			heapPositions[heap[position]] = position;
+			position = parent;
+		}
+
+		heap[position] = node;
+		heapPositions[node] = position;
+	}
+
+	void siftDown(uint32_t position) {
+		const unsigned int node = heap[position];
+		const double key = fScores[node];
+		const uint32_t size = heap.size();
+
+		while (true) {
+			uint32_t child = position * 2 + 1;
+			if (child >= size) break;
+			if (child + 1 < size &&
+			    fScores[heap[child + 1]] < fScores[heap[child]]) {
+				child++;
+			}
+			if (key <= fScores[heap[child]]) break;
+
+			heap[position] = heap[child];
+			heapPositions[heap[position]] = position;
+			position = child;
+		}
+
+		heap[position] = node;
+		heapPositions[node] = position;
+	}
+
+	void push(unsigned int node) {
+		heap.push_back(node);
+		siftUp(heap.size() - 1);
+	}
+
+	unsigned int pop() {
+		const unsigned int top = heap.front();
+		heapPositions[top] = closed;
+
+		const unsigned int last = heap.back();
+		heap.pop_back();
+		if (!heap.empty()) {
+			heap.front() = last;
+			siftDown(0);
+		}
+
+		return top;
+	}
+};
+
+static thread_local SearchState searchState;
+}  // namespace
+
+// Straight-line distance to the goal, which only never overestimates if link
+// costs are at least the distance between their nodes.
+double PointGraph::getHeuristicScore(const NodePoint& point,
+                                     const NodePoint& goal) const {
+	// Widened before subtracting, and squared in floating point, so nodes any
+	// distance apart can't overflow. Small squares are still exact.
+	const double deltaX = int64_t(goal.x) - point.x;
+	const double deltaY = int64_t(goal.y) - point.y;
+	const double deltaZ = int64_t(goal.z) - point.z;
+
+	const double square = deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ;
+	if (square < squareRootCache.size()) {
+		return squareRootCache[static_cast<size_t>(square)];
+	}
+	return std::sqrt(square);
 }
 
+namespace {
+struct LiveAdjacency {
+	const std::vector<Node>& nodes;
+
+	size_t size() const { return nodes.size(); }
+	unsigned int toInternal(unsigned int id) const { return id; }
+	unsigned int toExternal(unsigned int id) const { return id; }
+	const NodePoint& point(unsigned int id) const { return nodes[id].point; }
+
+	template <typename Callback>
+	void forEachLink(unsigned int id, Callback&& callback) const {
+		for (const Link& link : nodes[id].links) callback(link.toId, link.cost);
+	}
+
+	double getLowerBound(unsigned int, unsigned int) const { return 0.; }
+};
+
+struct FrozenAdjacency {
+	const FrozenGraph& graph;
+	const LandmarkTable* landmarks;
+
+	size_t size() const { return graph.numNodes; }
+	unsigned int toInternal(unsigned int id) const {
+		return graph.toInternal[id];
+	}
+	unsigned int toExternal(unsigned int id) const {
+		return graph.toExternal[id];
+	}
+	const NodePoint& point(unsigned int id) const { return graph.points[id]; }
+
+	template <typename Callback>
+	void forEachLink(unsigned int id, Callback&& callback) const {
+		const uint32_t end = graph.offsets[id + 1];
+		for (uint32_t i = graph.offsets[id]; i < end; i++) {
+			callback(graph.targets[i], graph.costs[i]);
+		}
+	}
+
+	double getLowerBound(unsigned int id, unsigned int goal) const {
+		return landmarks ? landmarks->getLowerBound(id, goal) : 0.;
+	}
+};
+}  // namespace
+
 // https://en.wikipedia.org/wiki/A*_search_algorithm
+template <typename Adjacency>
+bool PointGraph::search(const Adjacency& graph, unsigned int startNodeId,
+                        unsigned int goalNodeId,
+                        std::vector<unsigned int>& path) const {
+	const unsigned int start = graph.toInternal(startNodeId);
+	const unsigned int goal = graph.toInternal(goalNodeId);
+	const NodePoint& goalPoint = graph.point(goal);
+
+	// Landmark bounds hold for any link costs, so they're always used
+	auto estimate = [&](unsigned int node) {
+		const double lowerBound = graph.getLowerBound(node, goal);
+		if (heuristicWeight == 0.) return lowerBound;
+
+		return std::max(
+		    heuristicWeight * getHeuristicScore(graph.point(node), goalPoint),
+		    lowerBound);
+	};
+
+	SearchState& state = searchState;
+	state.begin(graph.size());
+
+	state.discover(start);
+	state.gScores[start] = 0.;
+	state.fScores[start] = estimate(start);
+	state.push(start);
+
+	while (!state.heap.empty()) {
+		const unsigned int current = state.pop();
+
+		if (current == goal) {
+			path.clear();
+			for (unsigned int node = goal; node != noNode;
+			     node = state.cameFrom[node]) {
+				path.push_back(graph.toExternal(node));
+			}
+			std::reverse(path.begin(), path.end());
+			return true;
+		}
+
+		const double currentGScore = state.gScores[current];
+
+		graph.forEachLink(current, [&](unsigned int neighbor, int cost) {
+			state.discover(neighbor);
+
+			const uint32_t position = state.heapPositions[neighbor];
+			if (position == closed) return;
+
+			const double tentativeGScore = currentGScore + cost;
+			if (tentativeGScore >= state.gScores[neighbor]) return;
+
+			// This path to neighbor is better than any previous one. Record it!
+			state.cameFrom[neighbor] = current;
+			state.gScores[neighbor] = tentativeGScore;
+			state.fScores[neighbor] = tentativeGScore + estimate(neighbor);
+
+			if (position == notQueued) {
+				state.push(neighbor);
+			} else {
+				state.siftUp(position);
+			}
+		});
+	}
+
+	return false;
+}
+
+void PointGraph::throwIfInvalidNode(unsigned int index) const {
+	if (index >= static_cast<unsigned int>(getSize())) {
+		throw std::invalid_argument(errorInvalidNode);
+	}
+}
+
+bool PointGraph::findPath(unsigned int startNodeId, unsigned int goalNodeId,
+                          std::vector<unsigned int>& path) const {
+	throwIfInvalidNode(startNodeId);
+	throwIfInvalidNode(goalNodeId);
+
+	if (frozen) {
+		const auto table = getLandmarks();
+		return search(FrozenAdjacency{*frozen, table.get()}, startNodeId,
+		              goalNodeId, path);
+	}
+	return search(LiveAdjacency{nodes}, startNodeId, goalNodeId, path);
+}
+
 sol::object PointGraph::findShortestPath(unsigned int startNodeId,
                                          unsigned int goalNodeId,
                                          sol::this_state s) const {
 	sol::state_view lua(s);
 
-	const Node& goalNode = nodes.at(goalNodeId);
+	std::vector<unsigned int> path;
+	if (findPath(startNodeId, goalNodeId, path)) {
+		return sol::make_object(lua, sol::as_table(path));
+	}
+
+	return sol::make_object(lua, sol::nil);
+}
+
+namespace {
+static inline double getCoordinate(const NodePoint& point, int axis) {
+	return axis == 0 ? point.x : axis == 1 ? point.y : point.z;
+}
+
+static inline double getSquareDistance(const NodePoint& point,
+                                       const double other[3]) {
+	const double deltaX = point.x - other[0];
+	const double deltaY = point.y - other[1];
+	const double deltaZ = point.z - other[2];
+	return deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ;
+}
+
+static void buildTree(const NodePoint* points, uint32_t* tree, uint8_t* axes,
+                      size_t begin, size_t end) {
+	if (end - begin <= 1) return;
+
+	// Split on whichever axis the points are most spread out along
+	double min[3], max[3];
+	for (int axis = 0; axis < 3; axis++) {
+		min[axis] = max[axis] = getCoordinate(points[tree[begin]], axis);
+	}
+	for (size_t i = begin + 1; i < end; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			const double coordinate = getCoordinate(points[tree[i]], axis);
+			min[axis] = std::min(min[axis], coordinate);
+			max[axis] = std::max(max[axis], coordinate);
+		}
+	}
+	int axis = 0;
+	for (int other = 1; other < 3; other++) {
+		if (max[other] - min[other] > max[axis] - min[axis]) axis = other;
+	}
+
+	const size_t middle = begin + (end - begin) / 2;
+	std::nth_element(tree + begin, tree + middle, tree + end,
+	                 [&](uint32_t a, uint32_t b) {
+		                 return getCoordinate(points[a], axis) <
+		                        getCoordinate(points[b], axis);
+	                 });
+	axes[middle] = axis;
+
+	buildTree(points, tree, axes, begin, middle);
+	buildTree(points, tree, axes, middle + 1, end);
+}
+
+// Iterative Tarjan, since recursing once per node would overflow the stack
+// on a large map.
+static uint32_t getStronglyConnectedComponents(
+    const FrozenGraph& graph, std::vector<uint32_t>& components) {
+	static constexpr uint32_t unvisited = UINT32_MAX;
+
+	const uint32_t numNodes = graph.numNodes;
+	std::vector<uint32_t> order(numNodes, unvisited);
+	std::vector<uint32_t> lowLinks(numNodes);
+	std::vector<bool> isOnStack(numNodes, false);
+	std::vector<uint32_t> stack;
+	// Node and the next of its links to look at
+	std::vector<std::pair<uint32_t, uint32_t>> callStack;
+
+	components.assign(numNodes, 0);
+	uint32_t numVisited = 0;
+	uint32_t numComponents = 0;
+
+	for (uint32_t root = 0; root < numNodes; root++) {
+		if (order[root] != unvisited) continue;
+
+		callStack.emplace_back(root, graph.offsets[root]);
+		order[root] = lowLinks[root] = numVisited++;
+		stack.push_back(root);
+		isOnStack[root] = true;
+
+		while (!callStack.empty()) {
+			auto& [node, link] = callStack.back();
+
+			if (link < graph.offsets[node + 1]) {
+				const uint32_t target = graph.targets[link++];
+				if (order[target] == unvisited) {
+					order[target] = lowLinks[target] = numVisited++;
+					stack.push_back(target);
+					isOnStack[target] = true;
+					callStack.emplace_back(target, graph.offsets[target]);
+				} else if (isOnStack[target]) {
+					lowLinks[node] = std::min(lowLinks[node], order[target]);
+				}
+				continue;
+			}
 
-	// For node n, gScores[n] is the cost of the cheapest path from start to n
-	// currently known.
-	std::unordered_map<unsigned int, double> gScores;
-	gScores.insert({startNodeId, 0.});
+			const uint32_t finished = node;
+			callStack.pop_back();
 
-	auto compare = [&gScores](unsigned int a, unsigned int b) -> bool {
-		return gScores.at(a) > gScores.at(b);
+			if (lowLinks[finished] == order[finished]) {
+				uint32_t member;
+				do {
+					member = stack.back();
+					stack.pop_back();
+					isOnStack[member] = false;
+					components[member] = numComponents;
+				} while (member != finished);
+				numComponents++;
+			}
+
+			if (!callStack.empty()) {
+				const uint32_t parent = callStack.back().first;
+				lowLinks[parent] = std::min(lowLinks[parent], lowLinks[finished]);
+			}
+		}
+	}
+
+	return numComponents;
+}
+}  // namespace
+
+SpatialIndex::SpatialIndex(const FrozenGraph& graph)
+    : tree(graph.numNodes), axes(graph.numNodes, 0) {
+	std::iota(tree.begin(), tree.end(), 0);
+	buildTree(graph.points, tree.data(), axes.data(), 0, tree.size());
+	numComponents = getStronglyConnectedComponents(graph, components);
+}
+
+bool SpatialIndex::findNearest(const FrozenGraph& graph,
+                               const double point[3], double maxDistance,
+                               int64_t component, uint32_t& nearest) const {
+	double bestSquareDistance = maxDistance * maxDistance;
+	bool found = false;
+
+	auto visit = [&](auto& self, size_t begin, size_t end) -> void {
+		if (begin >= end) return;
+
+		const size_t middle = begin + (end - begin) / 2;
+		const uint32_t node = tree[middle];
+		const NodePoint& nodePoint = graph.points[node];
+
+		const double squareDistance = getSquareDistance(nodePoint, point);
+		if (squareDistance <= bestSquareDistance &&
+		    (component == anyComponent || components[node] == component)) {
+			bestSquareDistance = squareDistance;
+			nearest = node;
+			found = true;
+		}
+
+		const int axis = axes[middle];
+		const double delta = point[axis] - getCoordinate(nodePoint, axis);
+		const bool isBefore = delta < 0;
+
+		// The side the point is on first, since it shrinks the radius most
+		if (isBefore) {
+			self(self, begin, middle);
+		} else {
+			self(self, middle + 1, end);
+		}
+		if (delta * delta <= bestSquareDistance) {
+			if (isBefore) {
+				self(self, middle + 1, end);
+			} else {
+				self(self, begin, middle);
+			}
+		}
 	};
 
-	// The set of discovered nodes that may need to be (re-)expanded.
-	// Initially, only the start node is known.
-	std::priority_queue<unsigned int, std::vector<unsigned int>,
-	                    decltype(compare)>
-	    openSet(compare);
-
-	openSet.push(startNodeId);
-
-	// For node n, cameFrom[n] is the node immediately preceding it on the
-	// cheapest path from start to n currently known.
-	std::unordered_map<unsigned int, unsigned int> cameFrom;
-
-	// For node n, fScores[n] := gScores[n] + h(n). fScores[n] represents our
-	// current best guess as to how short a path from start to finish can be if it
-	// goes through n.
-	std::unordered_map<unsigned int, double> fScores;
-	fScores.insert(
-	    {startNodeId, getHeuristicScore(nodes.at(startNodeId), goalNode,
-	                                    numCachedSquareRoots, squareRootCache)});
-
-	std::unordered_set<unsigned int> hasVisited;
-
-	while (!openSet.empty()) {
-		const unsigned int currentNodeId = openSet.top();
-		if (currentNodeId == goalNodeId) {
-			const auto path = reconstructPath(cameFrom, currentNodeId);
-			return sol::make_object(lua, sol::as_table(path));
-		}
-		openSet.pop();
-
-		if (hasVisited.count(currentNodeId)) {
-			continue;
-		}
-
-		hasVisited.insert(currentNodeId);
-
-		const Node& currentNode = nodes.at(currentNodeId);
-		for (const Link& link : currentNode.links) {
-			const double tentativeGScore = gScores.at(currentNodeId) + link.cost;
-			const double gScore = getScoreOrInfinity(gScores, link.toId);
-			if (tentativeGScore < gScore) {
-				// This path to neighbor is better than any previous one. Record it!
-				cameFrom.insert({link.toId, currentNodeId});
-				gScores.insert({link.toId, tentativeGScore});
-				fScores.insert(
-				    {link.toId,
-				     tentativeGScore +
-				         getHeuristicScore(nodes.at(link.toId), currentNode,
-				                           numCachedSquareRoots, squareRootCache)});
-				openSet.push(link.toId);
+	visit(visit, 0, tree.size());
+	return found;
+}
+
+void SpatialIndex::findInRadius(
+    const FrozenGraph& graph, const double point[3], double radius,
+    int64_t component, std::vector<std::pair<double, uint32_t>>& found) const {
+	const double squareRadius = radius * radius;
+
+	auto visit = [&](auto& self, size_t begin, size_t end) -> void {
+		if (begin >= end) return;
+
+		const size_t middle = begin + (end - begin) / 2;
+		const uint32_t node = tree[middle];
+		const NodePoint& nodePoint = graph.points[node];
+
+		const double squareDistance = getSquareDistance(nodePoint, point);
+		if (squareDistance <= squareRadius &&
+		    (component == anyComponent || components[node] == component)) {
+			found.emplace_back(squareDistance, node);
+		}
+
+		const int axis = axes[middle];
+		const double delta = point[axis] - getCoordinate(nodePoint, axis);
+		if (delta < 0 || delta * delta <= squareRadius) {
+			self(self, begin, middle);
+		}
+		if (delta >= 0 || delta * delta <= squareRadius) {
+			self(self, middle + 1, end);
+		}
+	};
+
+	visit(visit, 0, tree.size());
+}
+
+// Both follow from the triangle inequality for any landmark L:
+//   d(v, t) >= d(L, t) - d(L, v)  and  d(v, t) >= d(v, L) - d(t, L)
+double LandmarkTable::getLowerBound(uint32_t node, uint32_t goal) const {
+	const uint32_t* nodeFrom = fromLandmark + size_t(node) * numLandmarks;
+	const uint32_t* nodeTo = toLandmark + size_t(node) * numLandmarks;
+	const uint32_t* goalFrom = fromLandmark + size_t(goal) * numLandmarks;
+	const uint32_t* goalTo = toLandmark + size_t(goal) * numLandmarks;
+
+	int64_t bound = 0;
+	for (uint32_t i = 0; i < numLandmarks; i++) {
+		if (nodeFrom[i] != unreachable && goalFrom[i] != unreachable) {
+			bound = std::max(bound, int64_t(goalFrom[i]) - nodeFrom[i]);
+		}
+		if (nodeTo[i] != unreachable && goalTo[i] != unreachable) {
+			bound = std::max(bound, int64_t(nodeTo[i]) - goalTo[i]);
+		}
+	}
+	return bound;
+}
+
+namespace {
+struct CompressedLinks {
+	const uint32_t* offsets;
+	const uint32_t* targets;
+	const int32_t* costs;
+};
+
+// Plain Dijkstra from one node. Returns false if cancelled part way.
+static bool getDistances(const CompressedLinks& links, uint32_t numNodes,
+                         uint32_t source, std::vector<uint32_t>& distances,
+                         const std::atomic_bool& cancel) {
+	using Entry = std::pair<uint64_t, uint32_t>;
+	std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+	std::vector<uint64_t> best(numNodes, std::numeric_limits<uint64_t>::max());
+
+	best[source] = 0;
+	queue.emplace(0, source);
+
+	uint32_t numPopped = 0;
+	while (!queue.empty()) {
+		const auto [distance, node] = queue.top();
+		queue.pop();
+		if (distance != best[node]) continue;
+
+		if ((++numPopped & 0xffff) == 0 && cancel) return false;
+
+		for (uint32_t i = links.offsets[node]; i < links.offsets[node + 1]; i++) {
+			const uint64_t tentative = distance + links.costs[i];
+			const uint32_t target = links.targets[i];
+			if (tentative < best[target]) {
+				best[target] = tentative;
+				queue.emplace(tentative, target);
 			}
 		}
 	}
 
-	return sol::make_object(lua, sol::nil);
+	// A distance too big to store would give a bound that's too high, so it
+	// counts as unreachable
+	distances.resize(numNodes);
+	for (uint32_t i = 0; i < numNodes; i++) {
+		distances[i] = best[i] < LandmarkTable::unreachable
+		                   ? static_cast<uint32_t>(best[i])
+		                   : LandmarkTable::unreachable;
+	}
+	return true;
+}
+
+// Picks landmarks one at a time, each as far as possible from the ones
+// before, which spreads them out to the edges of the map where they give the
+// best bounds.
+static std::shared_ptr<const LandmarkTable> computeLandmarkTable(
+    const FrozenGraph& graph, unsigned int count,
+    const std::atomic_bool& cancel) {
+	const uint32_t numNodes = graph.numNodes;
+	count = std::min<uint32_t>(count, numNodes);
+
+	// Links reversed, for distances to each landmark
+	std::vector<uint32_t> reverseOffsets(numNodes + 1, 0);
+	std::vector<uint32_t> reverseTargets(graph.numLinks);
+	std::vector<int32_t> reverseCosts(graph.numLinks);
+	for (uint32_t i = 0; i < graph.numLinks; i++) {
+		reverseOffsets[graph.targets[i] + 1]++;
+	}
+	std::partial_sum(reverseOffsets.begin(), reverseOffsets.end(),
+	                 reverseOffsets.begin());
+	{
+		std::vector<uint32_t> positions(reverseOffsets.begin(),
+		                                reverseOffsets.end() - 1);
+		for (uint32_t node = 0; node < numNodes; node++) {
+			for (uint32_t i = graph.offsets[node]; i < graph.offsets[node + 1];
+			     i++) {
+				const uint32_t position = positions[graph.targets[i]]++;
+				reverseTargets[position] = node;
+				reverseCosts[position] = graph.costs[i];
+			}
+		}
+	}
+
+	const CompressedLinks forward{graph.offsets, graph.targets, graph.costs};
+	const CompressedLinks backward{reverseOffsets.data(), reverseTargets.data(),
+	                               reverseCosts.data()};
+
+	auto storage = std::make_shared<std::vector<uint32_t>>(
+	    count + size_t(count) * numNodes * 2);
+	auto table = std::make_shared<LandmarkTable>();
+	table->numLandmarks = count;
+	table->landmarks = storage->data();
+	table->fromLandmark = storage->data() + count;
+	table->toLandmark = table->fromLandmark + size_t(count) * numNodes;
+	table->storage = std::shared_ptr<const void>(storage, storage->data());
+
+	uint32_t* landmarks = storage->data();
+	uint32_t* fromLandmark = landmarks + count;
+	uint32_t* toLandmark = fromLandmark + size_t(count) * numNodes;
+
+	// How close each node is to its nearest landmark so far
+	std::vector<uint64_t> nearest(numNodes, std::numeric_limits<uint64_t>::max());
+	std::vector<uint32_t> from, to;
+
+	// Seed with whatever is farthest from an arbitrary node
+	if (!getDistances(forward, numNodes, 0, from, cancel)) return nullptr;
+	uint32_t next = 0;
+	for (uint32_t node = 0; node < numNodes; node++) {
+		if (from[node] != LandmarkTable::unreachable &&
+		    from[node] > from[next]) {
+			next = node;
+		}
+	}
+
+	for (uint32_t landmark = 0; landmark < count; landmark++) {
+		landmarks[landmark] = next;
+		if (!getDistances(forward, numNodes, next, from, cancel) ||
+		    !getDistances(backward, numNodes, next, to, cancel)) {
+			return nullptr;
+		}
+
+		for (uint32_t node = 0; node < numNodes; node++) {
+			fromLandmark[size_t(node) * count + landmark] = from[node];
+			toLandmark[size_t(node) * count + landmark] = to[node];
+
+			uint64_t distance = std::min(from[node], to[node]);
+			if (distance != LandmarkTable::unreachable) {
+				nearest[node] = std::min(nearest[node], distance);
+			}
+		}
+
+		// Nodes no landmark reaches yet are the farthest of all
+		nearest[next] = 0;
+		for (uint32_t node = 0; node < numNodes; node++) {
+			if (nearest[node] > nearest[next]) next = node;
+		}
+	}
+
+	return table;
+}
+}  // namespace
+
+std::shared_ptr<const LandmarkTable> PointGraph::getLandmarks() const {
+	std::lock_guard<std::mutex> guard(landmarksMutex);
+	return landmarks;
+}
+
+void PointGraph::computeLandmarks(unsigned int count) {
+	throwIfNotFrozen();
+	if (count == 0 || count > maxLandmarks) {
+		throw std::invalid_argument("Invalid number of landmarks");
+	}
+	if (computingLandmarks) {
+		throw std::runtime_error("Landmarks are already being computed");
+	}
+
+	// Bounds from distances along negative links wouldn't hold
+	for (uint32_t i = 0; i < frozen->numLinks; i++) {
+		if (frozen->costs[i] < 0) {
+			throw std::runtime_error("Landmarks need non-negative link costs");
+		}
+	}
+
+	if (landmarkThread.joinable()) landmarkThread.join();
+
+	computingLandmarks = true;
+	landmarkThread = std::thread([this, graph = frozen, count]() {
+		auto table = computeLandmarkTable(*graph, count, isClosing);
+		if (table) {
+			std::lock_guard<std::mutex> guard(landmarksMutex);
+			landmarks = std::move(table);
+		}
+		computingLandmarks = false;
+	});
+}
+
+void PointGraph::waitForLandmarks() {
+	if (landmarkThread.joinable()) landmarkThread.join();
+}
+
+unsigned int PointGraph::getNumLandmarks() const {
+	const auto table = getLandmarks();
+	return table ? table->numLandmarks : 0;
+}
+
+static inline uint64_t getPathKey(unsigned int startNodeId,
+                                  unsigned int goalNodeId) {
+	return static_cast<uint64_t>(startNodeId) << 32 | goalNodeId;
+}
+
+bool PathCache::find(unsigned int startNodeId, unsigned int goalNodeId,
+                     SharedPath& path) {
+	std::lock_guard<std::mutex> guard(mutex);
+
+	auto search = entries.find(getPathKey(startNodeId, goalNodeId));
+	if (search == entries.end()) return false;
+
+	recent.splice(recent.begin(), recent, search->second.second);
+	path = search->second.first;
+	return true;
+}
+
+void PathCache::insert(unsigned int startNodeId, unsigned int goalNodeId,
+                       SharedPath path) {
+	if (capacity == 0) return;
+
+	const uint64_t key = getPathKey(startNodeId, goalNodeId);
+	std::lock_guard<std::mutex> guard(mutex);
+
+	// Another thread may have found the same path first
+	if (entries.count(key)) return;
+
+	if (entries.size() >= capacity) {
+		entries.erase(recent.back());
+		recent.pop_back();
+	}
+
+	recent.push_front(key);
+	entries.emplace(key, std::make_pair(std::move(path), recent.begin()));
+}
+
+void PointGraph::beginPendingSearch() {
+	throwIfNotFrozen();
+
+	std::lock_guard<std::mutex> guard(pendingMutex);
+	numPending++;
+}
+
+void PointGraph::endPendingSearch() {
+	std::lock_guard<std::mutex> guard(pendingMutex);
+	if (--numPending == 0) pendingDone.notify_all();
+}
+
+bool PointGraph::getCachedPath(unsigned int startNodeId,
+                               unsigned int goalNodeId,
+                               SharedPath& path) const {
+	return pathCache && pathCache->find(startNodeId, goalNodeId, path);
+}
+
+SharedPath PointGraph::findCachedPath(unsigned int startNodeId,
+                                      unsigned int goalNodeId) {
+	throwIfNotFrozen();
+
+	SharedPath path;
+	if (pathCache->find(startNodeId, goalNodeId, path)) return path;
+
+	// Not worth finishing if the graph is about to be destroyed
+	if (isClosing) throw std::runtime_error(errorClosing);
+
+	auto found = std::make_shared<std::vector<unsigned int>>();
+	if (findPath(startNodeId, goalNodeId, *found)) path = std::move(found);
+
+	pathCache->insert(startNodeId, goalNodeId, path);
+	return path;
+}
+
+namespace {
+static constexpr char graphFileMagic[8] = {'R', 'S', 'G', 'R',
+                                           'A', 'P', 'H', '\0'};
+static constexpr uint32_t graphFileVersion = 1;
+
+struct GraphFileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t numNodes;
+	uint32_t numLinks;
+	// Version 1 files without landmarks have this zeroed
+	uint32_t numLandmarks;
+	uint32_t reserved[6];
+};
+
+// Where each array starts in the file, each aligned to 8 bytes. Landmark
+// tables, if any, come after the graph itself.
+struct GraphFileLayout {
+	size_t points;
+	size_t offsets;
+	size_t targets;
+	size_t costs;
+	size_t toInternal;
+	size_t toExternal;
+	size_t graphSize;
+	size_t landmarks;
+	size_t fromLandmark;
+	size_t toLandmark;
+	size_t size;
+
+	GraphFileLayout(uint64_t numNodes, uint64_t numLinks,
+	                uint64_t numLandmarks = 0) {
+		size_t position = sizeof(GraphFileHeader);
+		auto place = [&](size_t bytes) {
+			size_t start = position;
+			position = (position + bytes + 7) & ~size_t(7);
+			return start;
+		};
+
+		points = place(numNodes * sizeof(NodePoint));
+		offsets = place((numNodes + 1) * sizeof(uint32_t));
+		targets = place(numLinks * sizeof(uint32_t));
+		costs = place(numLinks * sizeof(int32_t));
+		toInternal = place(numNodes * sizeof(uint32_t));
+		toExternal = place(numNodes * sizeof(uint32_t));
+		graphSize = position;
+		landmarks = place(numLandmarks * sizeof(uint32_t));
+		fromLandmark = place(numLandmarks * numNodes * sizeof(uint32_t));
+		toLandmark = place(numLandmarks * numNodes * sizeof(uint32_t));
+		size = position;
+	}
+};
+
+static_assert(sizeof(GraphFileHeader) % 8 == 0);
+static_assert(sizeof(NodePoint) == 12);
+
+static inline uint64_t spreadBits(uint64_t value) {
+	value &= 0x1fffff;
+	value = (value | value << 32) & 0x1f00000000ffff;
+	value = (value | value << 16) & 0x1f0000ff0000ff;
+	value = (value | value << 8) & 0x100f00f00f00f00f;
+	value = (value | value << 4) & 0x10c30c30c30c30c3;
+	value = (value | value << 2) & 0x1249249249249249;
+	return value;
+}
+
+// Z-order of every node, so nodes close in space end up close in memory and a
+// search touches far fewer cache lines.
+static std::vector<uint32_t> getLocalityOrder(const std::vector<Node>& nodes) {
+	std::vector<uint32_t> order(nodes.size());
+	std::iota(order.begin(), order.end(), 0);
+	if (nodes.empty()) return order;
+
+	NodePoint min = nodes[0].point;
+	NodePoint max = nodes[0].point;
+	for (const Node& node : nodes) {
+		min.x = std::min(min.x, node.point.x);
+		min.y = std::min(min.y, node.point.y);
+		min.z = std::min(min.z, node.point.z);
+		max.x = std::max(max.x, node.point.x);
+		max.y = std::max(max.y, node.point.y);
+		max.z = std::max(max.z, node.point.z);
+	}
+
+	// Drop low bits until the widest axis fits in 21
+	int64_t range = std::max({int64_t(max.x) - min.x, int64_t(max.y) - min.y,
+	                          int64_t(max.z) - min.z});
+	int shift = 0;
+	while ((range >> shift) >= (1 << 21)) shift++;
+
+	std::vector<uint64_t> keys(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		const NodePoint& point = nodes[i].point;
+		keys[i] = spreadBits((int64_t(point.x) - min.x) >> shift) |
+		          spreadBits((int64_t(point.z) - min.z) >> shift) << 1 |
+		          spreadBits((int64_t(point.y) - min.y) >> shift) << 2;
+	}
+
+	std::stable_sort(order.begin(), order.end(),
+	                 [&](uint32_t a, uint32_t b) { return keys[a] < keys[b]; });
+	return order;
+}
+}  // namespace
+
+void FrozenGraph::bind(const void* data, size_t size) {
+	auto bytes = static_cast<const uint8_t*>(data);
+	auto header = reinterpret_cast<const GraphFileHeader*>(bytes);
+	GraphFileLayout layout(header->numNodes, header->numLinks);
+
+	numNodes = header->numNodes;
+	numLinks = header->numLinks;
+	points = reinterpret_cast<const NodePoint*>(bytes + layout.points);
+	offsets = reinterpret_cast<const uint32_t*>(bytes + layout.offsets);
+	targets = reinterpret_cast<const uint32_t*>(bytes + layout.targets);
+	costs = reinterpret_cast<const int32_t*>(bytes + layout.costs);
+	toInternal = reinterpret_cast<const uint32_t*>(bytes + layout.toInternal);
+	toExternal = reinterpret_cast<const uint32_t*>(bytes + layout.toExternal);
+	storageSize = size;
+}
+
+std::shared_ptr<const FrozenGraph> FrozenGraph::build(
+    const std::vector<Node>& nodes) {
+	uint64_t numLinks = 0;
+	for (const Node& node : nodes) numLinks += node.links.size();
+
+	if (nodes.size() >= std::numeric_limits<uint32_t>::max() ||
+	    numLinks >= std::numeric_limits<uint32_t>::max()) {
+		throw std::runtime_error("Graph is too large to freeze");
+	}
+
+	GraphFileLayout layout(nodes.size(), numLinks);
+	auto buffer = std::make_shared<std::vector<uint64_t>>(layout.size / 8);
+	auto bytes = reinterpret_cast<uint8_t*>(buffer->data());
+
+	auto header = reinterpret_cast<GraphFileHeader*>(bytes);
+	std::memcpy(header->magic, graphFileMagic, sizeof(graphFileMagic));
+	header->version = graphFileVersion;
+	header->numNodes = nodes.size();
+	header->numLinks = numLinks;
+
+	auto points = reinterpret_cast<NodePoint*>(bytes + layout.points);
+	auto offsets = reinterpret_cast<uint32_t*>(bytes + layout.offsets);
+	auto targets = reinterpret_cast<uint32_t*>(bytes + layout.targets);
+	auto costs = reinterpret_cast<int32_t*>(bytes + layout.costs);
+	auto toInternal = reinterpret_cast<uint32_t*>(bytes + layout.toInternal);
+	auto toExternal = reinterpret_cast<uint32_t*>(bytes + layout.toExternal);
+
+	const std::vector<uint32_t> order = getLocalityOrder(nodes);
+	for (uint32_t internal = 0; internal < order.size(); internal++) {
+		toExternal[internal] = order[internal];
+		toInternal[order[internal]] = internal;
+	}
+
+	uint32_t linkIndex = 0;
+	for (uint32_t internal = 0; internal < order.size(); internal++) {
+		const Node& node = nodes[order[internal]];
+		points[internal] = node.point;
+		offsets[internal] = linkIndex;
+
+		for (const Link& link : node.links) {
+			targets[linkIndex] = toInternal[link.toId];
+			costs[linkIndex] = link.cost;
+			linkIndex++;
+		}
+	}
+	offsets[order.size()] = linkIndex;
+
+	auto graph = std::make_shared<FrozenGraph>();
+	graph->storage = std::shared_ptr<const void>(buffer, buffer->data());
+	graph->bind(bytes, layout.graphSize);
+	return graph;
+}
+
+// Maps the file read-only, so every state loading the same file shares the
+// same physical pages. Everything is checked before use, since a bad index
+// would otherwise send a search outside the mapping.
+std::shared_ptr<const FrozenGraph> FrozenGraph::load(
+    const std::string& path, std::shared_ptr<const LandmarkTable>& landmarks) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+	if (fd == -1) throw std::runtime_error(strerror(errno));
+
+	struct stat info;
+	if (fstat(fd, &info) == -1) {
+		close(fd);
+		throw std::runtime_error(strerror(errno));
+	}
+
+	size_t size = info.st_size;
+	if (size < sizeof(GraphFileHeader)) {
+		close(fd);
+		throw std::runtime_error(errorInvalidFile);
+	}
+
+	void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (mapping == MAP_FAILED) throw std::runtime_error(strerror(errno));
+
+	std::shared_ptr<const void> storage(mapping, [size](const void* data) {
+		munmap(const_cast<void*>(data), size);
+	});
+
+	auto header = static_cast<const GraphFileHeader*>(mapping);
+	if (std::memcmp(header->magic, graphFileMagic, sizeof(graphFileMagic)) != 0) {
+		throw std::runtime_error(errorInvalidFile);
+	}
+	if (header->version != graphFileVersion) {
+		throw std::runtime_error("Unsupported graph file version");
+	}
+	if (header->numLandmarks > maxLandmarks) {
+		throw std::runtime_error(errorInvalidFile);
+	}
+	GraphFileLayout layout(header->numNodes, header->numLinks,
+	                       header->numLandmarks);
+	if (layout.size != size) throw std::runtime_error(errorInvalidFile);
+
+	auto graph = std::make_shared<FrozenGraph>();
+	graph->storage = storage;
+	graph->bind(mapping, layout.graphSize);
+
+	const uint32_t numNodes = graph->numNodes;
+	if (graph->offsets[0] != 0 || graph->offsets[numNodes] != graph->numLinks) {
+		throw std::runtime_error(errorInvalidFile);
+	}
+	for (uint32_t i = 0; i < numNodes; i++) {
+		if (graph->offsets[i] > graph->offsets[i + 1] ||
+		    graph->toInternal[i] >= numNodes || graph->toExternal[i] >= numNodes ||
+		    graph->toInternal[graph->toExternal[i]] != i) {
+			throw std::runtime_error(errorInvalidFile);
+		}
+	}
+	for (uint32_t i = 0; i < graph->numLinks; i++) {
+		if (graph->targets[i] >= numNodes) {
+			throw std::runtime_error(errorInvalidFile);
+		}
+	}
+
+	landmarks = nullptr;
+	if (header->numLandmarks != 0) {
+		auto bytes = static_cast<const uint8_t*>(mapping);
+		auto table = std::make_shared<LandmarkTable>();
+		table->numLandmarks = header->numLandmarks;
+		table->landmarks =
+		    reinterpret_cast<const uint32_t*>(bytes + layout.landmarks);
+		table->fromLandmark =
+		    reinterpret_cast<const uint32_t*>(bytes + layout.fromLandmark);
+		table->toLandmark =
+		    reinterpret_cast<const uint32_t*>(bytes + layout.toLandmark);
+		table->storage = std::move(storage);
+
+		for (uint32_t i = 0; i < table->numLandmarks; i++) {
+			if (table->landmarks[i] >= numNodes) {
+				throw std::runtime_error(errorInvalidFile);
+			}
+		}
+		landmarks = std::move(table);
+	}
+
+	return graph;
+}
+
+// Written to a temporary file first, so a graph being loaded elsewhere never
+// sees a half written file.
+void FrozenGraph::save(const std::string& path,
+                       const LandmarkTable* landmarks) const {
+	const std::string temporaryPath = path + ".tmp";
+	const uint32_t numLandmarks = landmarks ? landmarks->numLandmarks : 0;
+	GraphFileLayout layout(numNodes, numLinks, numLandmarks);
+
+	{
+		std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!file) throw std::runtime_error("Couldn't open file for writing");
+
+		auto bytes = static_cast<const char*>(storage.get());
+		GraphFileHeader header;
+		std::memcpy(&header, bytes, sizeof(header));
+		header.numLandmarks = numLandmarks;
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(bytes + sizeof(header), storageSize - sizeof(header));
+
+		if (landmarks) {
+			const size_t tableSize = size_t(numLandmarks) * numNodes;
+			auto writeAt = [&](size_t position, const uint32_t* data,
+			                   size_t count) {
+				file.seekp(position);
+				file.write(reinterpret_cast<const char*>(data),
+				           count * sizeof(uint32_t));
+			};
+			writeAt(layout.landmarks, landmarks->landmarks, numLandmarks);
+			writeAt(layout.fromLandmark, landmarks->fromLandmark, tableSize);
+			writeAt(layout.toLandmark, landmarks->toLandmark, tableSize);
+		}
+
+		// Pad the last section out to its alignment
+		if (static_cast<size_t>(file.tellp()) < layout.size) {
+			file.seekp(layout.size - 1);
+			file.put('\0');
+		}
+		if (!file) throw std::runtime_error("Couldn't write graph file");
+	}
+
+	if (std::rename(temporaryPath.c_str(), path.c_str()) != 0) {
+		throw std::runtime_error(strerror(errno));
+	}
 }
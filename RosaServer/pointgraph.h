@@ -1,5 +1,12 @@
 #pragma once
 #include <cstdint>
+#include <atomic>
+#include <condition_variable>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
 #include <tuple>
 #include <unordered_map>
 #include <vector>
@@ -36,21 +43,186 @@ struct Node {
 	Node(NodePoint& point) : point(point){};
 };
 
+// Shortest distances to and from a few far apart nodes, which give a much
+// tighter lower bound on the distance between two nodes than a straight line
+// through the triangle inequality. Indexed by internal node ID.
+struct LandmarkTable {
+	static constexpr uint32_t unreachable = UINT32_MAX;
+
+	uint32_t numLandmarks;
+	const uint32_t* landmarks;
+	// Node v's distances are [v * numLandmarks, (v + 1) * numLandmarks)
+	const uint32_t* fromLandmark;
+	const uint32_t* toLandmark;
+
+	std::shared_ptr<const void> storage;
+
+	double getLowerBound(uint32_t node, uint32_t goal) const;
+};
+
+// A graph compacted into compressed sparse row arrays, in exactly the layout
+// of the file it is saved to, so loading is a single mmap. Nodes are stored
+// in a spatially local order; `toInternal`/`toExternal` map between that and
+// the IDs scripts know the nodes by.
+struct FrozenGraph {
+	uint32_t numNodes;
+	uint32_t numLinks;
+	const NodePoint* points;
+	// Node i's links are [offsets[i], offsets[i + 1])
+	const uint32_t* offsets;
+	const uint32_t* targets;
+	const int32_t* costs;
+	const uint32_t* toInternal;
+	const uint32_t* toExternal;
+
+	// Either owns the bytes or keeps a mapped file alive
+	std::shared_ptr<const void> storage;
+	size_t storageSize;
+
+	static std::shared_ptr<const FrozenGraph> build(
+	    const std::vector<Node>& nodes);
+	// Also loads any landmarks saved with the graph into `landmarks`
+	static std::shared_ptr<const FrozenGraph> load(
+	    const std::string& path, std::shared_ptr<const LandmarkTable>& landmarks);
+	void save(const std::string& path, const LandmarkTable* landmarks) const;
+
+ private:
+	void bind(const void* data, size_t size);
+};
+
+// Node points in an implicit k-d tree, plus which strongly connected
+// component each node is in. Indexed by internal node ID, and only built for
+// frozen graphs.
+struct SpatialIndex {
+	static constexpr int64_t anyComponent = -1;
+
+	// Internal node IDs; the middle of any range splits the rest of it on
+	// `axes` at that position
+	std::vector<uint32_t> tree;
+	std::vector<uint8_t> axes;
+	std::vector<uint32_t> components;
+	uint32_t numComponents;
+
+	SpatialIndex(const FrozenGraph& graph);
+	bool findNearest(const FrozenGraph& graph, const double point[3],
+	                 double maxDistance, int64_t component,
+	                 uint32_t& nearest) const;
+	void findInRadius(const FrozenGraph& graph, const double point[3],
+	                  double radius, int64_t component,
+	                  std::vector<std::pair<double, uint32_t>>& found) const;
+};
+
+using SharedPath = std::shared_ptr<const std::vector<unsigned int>>;
+
+// Recently found paths by start and goal, least recently used dropped first.
+// A missing path is remembered as null.
+class PathCache {
+	std::mutex mutex;
+	size_t capacity;
+	std::list<uint64_t> recent;
+	std::unordered_map<uint64_t,
+	                   std::pair<SharedPath, std::list<uint64_t>::iterator>>
+	    entries;
+
+ public:
+	PathCache(size_t capacity) : capacity(capacity) {}
+	bool find(unsigned int startNodeId, unsigned int goalNodeId,
+	          SharedPath& path);
+	void insert(unsigned int startNodeId, unsigned int goalNodeId,
+	            SharedPath path);
+};
+
+static constexpr size_t defaultPathCacheSize = 4096;
+
 class PointGraph {
 	std::vector<Node> nodes;
-	std::unordered_map<NodePoint, unsigned int> nodeIdByPoint;
-	double* squareRootCache;
-	unsigned int numCachedSquareRoots;
+	// How much the straight-line distance to the goal counts in a search
+	double heuristicWeight;
+	std::shared_ptr<const FrozenGraph> frozen;
+	std::unique_ptr<const SpatialIndex> spatialIndex;
+	// Built lazily for loaded graphs
+	mutable std::unordered_map<NodePoint, unsigned int> nodeIdByPoint;
+	std::vector<double> squareRootCache;
+
+	std::shared_ptr<const LandmarkTable> landmarks;
+	mutable std::mutex landmarksMutex;
+	std::thread landmarkThread;
+	std::atomic_bool computingLandmarks = false;
+	std::atomic_bool isClosing = false;
+
+	// Frozen graphs never change, so cached paths stay valid until the graph
+	// is gone
+	std::unique_ptr<PathCache> pathCache;
+	// Searches queued on other threads, which the destructor waits out
+	std::mutex pendingMutex;
+	std::condition_variable pendingDone;
+	unsigned int numPending = 0;
+
+	double getHeuristicScore(const NodePoint& point, const NodePoint& goal) const;
+	template <typename Adjacency>
+	bool search(const Adjacency& adjacency, unsigned int startNodeId,
+	            unsigned int goalNodeId, std::vector<unsigned int>& path) const;
+	void throwIfFrozen() const;
+	void throwIfNotFrozen() const;
+	std::shared_ptr<const LandmarkTable> getLandmarks() const;
 
  public:
-	PointGraph(unsigned int squareRootCacheSize);
+	// With a heuristic weight of 0 searches always find the cheapest path, for
+	// any link costs. A weight of 1 is faster, and still exact as long as every
+	// link costs at least the straight-line distance between its nodes. Higher
+	// weights are faster again, but may not find the cheapest path.
+	PointGraph(unsigned int squareRootCacheSize, double heuristicWeight = 0.);
 	~PointGraph();
+	static std::unique_ptr<PointGraph> load(
+	    const std::string& path, sol::optional<unsigned int> squareRootCacheSize,
+	    sol::optional<double> heuristicWeight);
+
 	int getSize() const;
 	void addNode(int x, int y, int z);
 	std::tuple<int, int, int> getNodePoint(unsigned int index) const;
+	NodePoint getPoint(unsigned int index) const;
 	void addLink(unsigned int fromId, unsigned int toId, int cost);
 	sol::object getNodeByPoint(int x, int y, int z, sol::this_state s) const;
+	// Fills `path` with node IDs from start to goal. Safe to call from several
+	// threads at once as long as the graph isn't being changed.
+	bool findPath(unsigned int startNodeId, unsigned int goalNodeId,
+	              std::vector<unsigned int>& path) const;
 	sol::object findShortestPath(unsigned int startNodeId,
 	                             unsigned int goalNodeId,
 	                             sol::this_state s) const;
+
+	// For searching a frozen graph from other threads. Every search handed to
+	// another thread must be bracketed by these two.
+	void beginPendingSearch();
+	void endPendingSearch();
+	bool getCachedPath(unsigned int startNodeId, unsigned int goalNodeId,
+	                   SharedPath& path) const;
+	// Null if there is no path. Throws rather than searching if the graph is
+	// being destroyed.
+	SharedPath findCachedPath(unsigned int startNodeId, unsigned int goalNodeId);
+	void throwIfInvalidNode(unsigned int index) const;
+
+	// Both only consider nodes in `component`, if given, so a position never
+	// snaps to a node that can't reach where it's going.
+	bool findNearestNode(const double point[3], double maxDistance,
+	                     int64_t component, unsigned int& nodeId) const;
+	sol::object getNearestNode(double x, double y, double z,
+	                           sol::optional<double> maxDistance,
+	                           sol::optional<unsigned int> component,
+	                           sol::this_state s) const;
+	sol::table getNodesInRadius(double x, double y, double z, double radius,
+	                            sol::optional<unsigned int> component,
+	                            sol::this_state s) const;
+	unsigned int getNodeComponent(unsigned int index) const;
+	unsigned int getNumComponents() const;
+
+	void freeze();
+	bool getIsFrozen() const { return frozen != nullptr; }
+	void save(const std::string& path) const;
+
+	// Picks `count` landmarks and computes their distance tables on a
+	// background thread. Searches start using them once they're done.
+	void computeLandmarks(unsigned int count);
+	void waitForLandmarks();
+	unsigned int getNumLandmarks() const;
 };
@@ -0,0 +1,337 @@
+#include "roadgraph.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+
+#include "engine.h"
+
+static constexpr const char* errorInvalidLane = "Lane doesn't exist";
+static constexpr const char* errorInvalidIntersection =
+    "Intersection doesn't exist";
+static constexpr const char* errorNotBuilt = "No level has been loaded";
+
+static std::mutex currentNetworkMutex;
+static std::shared_ptr<const RoadNetwork> currentNetwork;
+
+static inline float getDistance(const Vector& a, const Vector& b) {
+	const float deltaX = b.x - a.x;
+	const float deltaY = b.y - a.y;
+	const float deltaZ = b.z - a.z;
+	return std::sqrt(deltaX * deltaX + deltaY * deltaY + deltaZ * deltaZ);
+}
+
+static float getDistanceToSegment(const Vector& point, const Vector& start,
+                                  const Vector& end) {
+	const Vector segment{end.x - start.x, end.y - start.y, end.z - start.z};
+	const float lengthSquare = segment.x * segment.x + segment.y * segment.y +
+	                           segment.z * segment.z;
+
+	float fraction = 0.f;
+	if (lengthSquare > 0.f) {
+		fraction = ((point.x - start.x) * segment.x +
+		            (point.y - start.y) * segment.y +
+		            (point.z - start.z) * segment.z) /
+		           lengthSquare;
+		fraction = std::fmin(std::fmax(fraction, 0.f), 1.f);
+	}
+
+	const Vector closest{start.x + segment.x * fraction,
+	                     start.y + segment.y * fraction,
+	                     start.z + segment.z * fraction};
+	return getDistance(point, closest);
+}
+
+// Lanes with direction 0 are driven from the street's intersection A to B,
+// and the rest the other way. Which end of the lane is which is taken from
+// whichever is closer to the intersection it leaves.
+static RoadLane getRoadLane(const Street& street, int streetIndex,
+                            int laneIndex, int numIntersections) {
+	const StreetLane& streetLane = street.lanes[laneIndex];
+
+	RoadLane lane{streetIndex, laneIndex, -1, -1, streetLane.posA,
+	              streetLane.posB, 0.f};
+
+	const bool isForward = streetLane.direction == 0;
+	const int from = isForward ? street.intersectionA : street.intersectionB;
+	const int to = isForward ? street.intersectionB : street.intersectionA;
+
+	if (from >= 0 && from < numIntersections && to >= 0 &&
+	    to < numIntersections) {
+		lane.fromIntersection = from;
+		lane.toIntersection = to;
+
+		const Vector& origin = Engine::streetIntersections[from].pos;
+		if (getDistance(origin, streetLane.posB) <
+		    getDistance(origin, streetLane.posA)) {
+			std::swap(lane.start, lane.end);
+		}
+	}
+
+	lane.length = getDistance(lane.start, lane.end);
+	return lane;
+}
+
+// Rounded up and padded, so it's never less than the straight line between
+// the two lanes' rounded start points, which is what the search estimates.
+static int getTurnCost(const RoadLane& lane, const RoadLane& next) {
+	return static_cast<int>(
+	           std::ceil(lane.length + getDistance(lane.end, next.start))) +
+	       2;
+}
+
+using LaneTurns = std::vector<std::vector<std::pair<unsigned int, int>>>;
+
+// Uses the same costs as routing between lanes: every turn costs the lane
+// before it plus the way across the intersection, and the last lane costs its
+// length.
+static void computeIntersectionDistances(
+    RoadNetwork& network, const LaneTurns& turns,
+    const std::vector<std::vector<unsigned int>>& lanesLeaving) {
+	const unsigned int numIntersections = network.numIntersections;
+	const size_t numLanes = network.lanes.size();
+
+	const size_t numPairs = size_t(numIntersections) * numIntersections;
+	network.intersectionDistances.assign(
+	    numPairs, std::numeric_limits<float>::infinity());
+	network.nextIntersections.assign(numPairs, -1);
+
+	// Cost to reach the start of each lane, and where the route to it first
+	// crossed an intersection
+	std::vector<float> laneDistances(numLanes);
+	std::vector<int> firstHops(numLanes);
+
+	using Entry = std::pair<float, unsigned int>;
+
+	// One Dijkstra over lanes per intersection, since which turns can be made
+	// depends on the lane a car arrived on
+	for (unsigned int source = 0; source < numIntersections; source++) {
+		const size_t row = size_t(source) * numIntersections;
+		float* distances = &network.intersectionDistances[row];
+		int* nextHops = &network.nextIntersections[row];
+
+		distances[source] = 0.f;
+		nextHops[source] = source;
+
+		std::fill(laneDistances.begin(), laneDistances.end(),
+		          std::numeric_limits<float>::infinity());
+
+		std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> queue;
+		for (unsigned int id : lanesLeaving[source]) {
+			laneDistances[id] = 0.f;
+			firstHops[id] = network.lanes[id].toIntersection;
+			queue.emplace(0.f, id);
+		}
+
+		while (!queue.empty()) {
+			const auto [distance, id] = queue.top();
+			queue.pop();
+			if (distance > laneDistances[id]) continue;
+
+			const RoadLane& lane = network.lanes[id];
+			const float arrival = distance + lane.length;
+			if (arrival < distances[lane.toIntersection]) {
+				distances[lane.toIntersection] = arrival;
+				nextHops[lane.toIntersection] = firstHops[id];
+			}
+
+			for (const auto& [nextID, cost] : turns[id]) {
+				const float tentative = distance + cost;
+				if (tentative < laneDistances[nextID]) {
+					laneDistances[nextID] = tentative;
+					firstHops[nextID] = firstHops[id];
+					queue.emplace(tentative, nextID);
+				}
+			}
+		}
+	}
+}
+
+std::shared_ptr<const RoadNetwork> RoadNetwork::build() {
+	auto network = std::make_shared<RoadNetwork>();
+
+	const int numStreets = *Engine::numStreets;
+	const int numIntersections = *Engine::numStreetIntersections;
+	network->numIntersections = numIntersections;
+
+	for (int streetIndex = 0; streetIndex < numStreets; streetIndex++) {
+		const Street& street = Engine::streets[streetIndex];
+		network->firstLaneOfStreet.push_back(network->lanes.size());
+
+		const int numLanes = std::clamp(street.numLanes, 0, 16);
+		for (int laneIndex = 0; laneIndex < numLanes; laneIndex++) {
+			network->lanes.push_back(
+			    getRoadLane(street, streetIndex, laneIndex, numIntersections));
+		}
+	}
+	network->firstLaneOfStreet.push_back(network->lanes.size());
+
+	std::vector<std::vector<unsigned int>> lanesLeaving(numIntersections);
+	for (unsigned int id = 0; id < network->lanes.size(); id++) {
+		const RoadLane& lane = network->lanes[id];
+		if (lane.fromIntersection != -1) {
+			lanesLeaving[lane.fromIntersection].push_back(id);
+		}
+	}
+
+	LaneTurns turns(network->lanes.size());
+	for (unsigned int id = 0; id < network->lanes.size(); id++) {
+		const RoadLane& lane = network->lanes[id];
+		if (lane.toIntersection == -1) continue;
+
+		const auto& leaving = lanesLeaving[lane.toIntersection];
+
+		// No U-turns, unless it's a dead end
+		bool hasOtherStreet = false;
+		for (unsigned int nextID : leaving) {
+			if (network->lanes[nextID].streetIndex != lane.streetIndex) {
+				hasOtherStreet = true;
+				break;
+			}
+		}
+
+		for (unsigned int nextID : leaving) {
+			const RoadLane& next = network->lanes[nextID];
+			if (hasOtherStreet && next.streetIndex == lane.streetIndex) continue;
+
+			turns[id].emplace_back(nextID, getTurnCost(lane, next));
+		}
+	}
+
+	// Turn costs never undercut the straight line, so the search can lean on it
+	network->laneGraph = std::make_unique<PointGraph>(0, 1.);
+	PointGraph& graph = *network->laneGraph;
+
+	for (const RoadLane& lane : network->lanes) {
+		graph.addNode(std::lround(lane.start.x), std::lround(lane.start.y),
+		              std::lround(lane.start.z));
+	}
+
+	for (unsigned int id = 0; id < turns.size(); id++) {
+		for (const auto& [nextID, cost] : turns[id]) {
+			graph.addLink(id, nextID, cost);
+		}
+	}
+
+	graph.freeze();
+	computeIntersectionDistances(*network, turns, lanesLeaving);
+
+	return network;
+}
+
+void RoadGraph::rebuild() {
+	auto network = RoadNetwork::build();
+
+	std::lock_guard<std::mutex> guard(currentNetworkMutex);
+	currentNetwork = std::move(network);
+}
+
+RoadGraph::RoadGraph() {
+	std::lock_guard<std::mutex> guard(currentNetworkMutex);
+	if (!currentNetwork) throw std::runtime_error(errorNotBuilt);
+	network = currentNetwork;
+}
+
+const RoadLane& RoadGraph::lane(unsigned int id) const {
+	if (id >= network->lanes.size()) {
+		throw std::invalid_argument(errorInvalidLane);
+	}
+	return network->lanes[id];
+}
+
+unsigned int RoadGraph::intersectionPair(unsigned int from,
+                                         unsigned int to) const {
+	if (from >= network->numIntersections || to >= network->numIntersections) {
+		throw std::invalid_argument(errorInvalidIntersection);
+	}
+	return from * network->numIntersections + to;
+}
+
+std::tuple<int, int, int, int> RoadGraph::getLane(unsigned int id) const {
+	const RoadLane& found = lane(id);
+	return std::make_tuple(found.streetIndex, found.laneIndex,
+	                       found.fromIntersection, found.toIntersection);
+}
+
+std::tuple<Vector, Vector> RoadGraph::getLanePoints(unsigned int id) const {
+	const RoadLane& found = lane(id);
+	return std::make_tuple(found.start, found.end);
+}
+
+unsigned int RoadGraph::getLaneID(unsigned int streetIndex,
+                                  unsigned int laneIndex) const {
+	const auto& firstLanes = network->firstLaneOfStreet;
+	if (streetIndex + 1 >= firstLanes.size() ||
+	    laneIndex >= firstLanes[streetIndex + 1] - firstLanes[streetIndex]) {
+		throw std::invalid_argument(errorInvalidLane);
+	}
+	return firstLanes[streetIndex] + laneIndex;
+}
+
+sol::object RoadGraph::findRoute(unsigned int fromLane, unsigned int toLane,
+                                 sol::this_state s) const {
+	lane(fromLane);
+	lane(toLane);
+	return network->laneGraph->findShortestPath(fromLane, toLane, s);
+}
+
+// Every lane is checked, but there are only a few thousand of them at most.
+std::tuple<sol::object, sol::object> RoadGraph::getNearestLane(
+    Vector* pos, sol::optional<float> maxDistance, sol::this_state s) const {
+	sol::state_view lua(s);
+
+	float bestDistance =
+	    maxDistance.value_or(std::numeric_limits<float>::infinity());
+	int bestID = -1;
+
+	for (unsigned int id = 0; id < network->lanes.size(); id++) {
+		const RoadLane& candidate = network->lanes[id];
+		const float distance =
+		    getDistanceToSegment(*pos, candidate.start, candidate.end);
+		if (distance <= bestDistance) {
+			bestDistance = distance;
+			bestID = id;
+		}
+	}
+
+	if (bestID == -1) {
+		return std::make_tuple(sol::make_object(lua, sol::nil),
+		                       sol::make_object(lua, sol::nil));
+	}
+	return std::make_tuple(sol::make_object(lua, bestID),
+	                       sol::make_object(lua, bestDistance));
+}
+
+sol::object RoadGraph::getIntersectionDistance(unsigned int from,
+                                               unsigned int to,
+                                               sol::this_state s) const {
+	sol::state_view lua(s);
+
+	const float distance =
+	    network->intersectionDistances[intersectionPair(from, to)];
+	if (std::isinf(distance)) return sol::make_object(lua, sol::nil);
+	return sol::make_object(lua, distance);
+}
+
+sol::object RoadGraph::findIntersectionRoute(unsigned int from,
+                                             unsigned int to,
+                                             sol::this_state s) const {
+	sol::state_view lua(s);
+
+	if (network->nextIntersections[intersectionPair(from, to)] == -1) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	std::vector<unsigned int> route{from};
+	for (unsigned int intersection = from; intersection != to;) {
+		intersection =
+		    network->nextIntersections[intersectionPair(intersection, to)];
+		route.push_back(intersection);
+	}
+
+	return sol::make_object(lua, sol::as_table(route));
+}
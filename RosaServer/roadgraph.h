@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <tuple>
+#include <vector>
+
+#include "pointgraph.h"
+#include "sol/sol.hpp"
+#include "structs.h"
+
+struct RoadLane {
+	int streetIndex;
+	int laneIndex;
+	int fromIntersection;
+	int toIntersection;
+	Vector start;
+	Vector end;
+	float length;
+};
+
+// The city's roads as of the last level load, copied out of the engine's
+// street and intersection arrays so any thread can route on them.
+struct RoadNetwork {
+	std::vector<RoadLane> lanes;
+	// Index of a street's first lane in `lanes`
+	std::vector<unsigned int> firstLaneOfStreet;
+	// One node per lane, linked to every lane it can turn into
+	std::unique_ptr<PointGraph> laneGraph;
+
+	unsigned int numIntersections;
+	// Shortest driving distance and first intersection on the way there, for
+	// every pair of intersections
+	std::vector<float> intersectionDistances;
+	std::vector<int> nextIntersections;
+
+	static std::shared_ptr<const RoadNetwork> build();
+};
+
+// A handle on the road network, which stays valid even once the level is
+// reset and the network is rebuilt.
+class RoadGraph {
+	std::shared_ptr<const RoadNetwork> network;
+
+	const RoadLane& lane(unsigned int id) const;
+	unsigned int intersectionPair(unsigned int from, unsigned int to) const;
+
+ public:
+	// Called on the main thread whenever the engine resets the game
+	static void rebuild();
+
+	RoadGraph();
+	unsigned int getNumLanes() const { return network->lanes.size(); }
+	unsigned int getNumIntersections() const {
+		return network->numIntersections;
+	}
+
+	std::tuple<int, int, int, int> getLane(unsigned int id) const;
+	std::tuple<Vector, Vector> getLanePoints(unsigned int id) const;
+	unsigned int getLaneID(unsigned int streetIndex,
+	                       unsigned int laneIndex) const;
+	sol::object findRoute(unsigned int fromLane, unsigned int toLane,
+	                      sol::this_state s) const;
+	std::tuple<sol::object, sol::object> getNearestLane(
+	    Vector* pos, sol::optional<float> maxDistance, sol::this_state s) const;
+	sol::object getIntersectionDistance(unsigned int from, unsigned int to,
+	                                    sol::this_state s) const;
+	sol::object findIntersectionRoute(unsigned int from, unsigned int to,
+	                                  sol::this_state s) const;
+};
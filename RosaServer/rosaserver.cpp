@@ -164,13 +164,38 @@ void defineThreadSafeAPIs(sol::state* state) {
 
 	{
 		auto meta = state->new_usertype<PointGraph>(
-		    "PointGraph", sol::constructors<PointGraph(unsigned int)>());
+		    "PointGraph", sol::constructors<PointGraph(unsigned int),
+		                                    PointGraph(unsigned int, double)>());
 		meta["getSize"] = &PointGraph::getSize;
 		meta["addNode"] = &PointGraph::addNode;
 		meta["getNodePoint"] = &PointGraph::getNodePoint;
 		meta["addLink"] = &PointGraph::addLink;
 		meta["getNodeByPoint"] = &PointGraph::getNodeByPoint;
 		meta["findShortestPath"] = &PointGraph::findShortestPath;
+		meta["getNearestNode"] = &PointGraph::getNearestNode;
+		meta["getNodesInRadius"] = &PointGraph::getNodesInRadius;
+		meta["getNodeComponent"] = &PointGraph::getNodeComponent;
+		meta["numComponents"] = sol::property(&PointGraph::getNumComponents);
+		meta["freeze"] = &PointGraph::freeze;
+		meta["save"] = &PointGraph::save;
+		meta["load"] = &PointGraph::load;
+		meta["isFrozen"] = sol::property(&PointGraph::getIsFrozen);
+		meta["computeLandmarks"] = &PointGraph::computeLandmarks;
+		meta["numLandmarks"] = sol::property(&PointGraph::getNumLandmarks);
+	}
+
+	{
+		auto meta = state->new_usertype<RoadGraph>(
+		    "RoadGraph", sol::constructors<RoadGraph()>());
+		meta["numLanes"] = sol::property(&RoadGraph::getNumLanes);
+		meta["numIntersections"] = sol::property(&RoadGraph::getNumIntersections);
+		meta["getLane"] = &RoadGraph::getLane;
+		meta["getLanePoints"] = &RoadGraph::getLanePoints;
+		meta["getLaneID"] = &RoadGraph::getLaneID;
+		meta["findRoute"] = &RoadGraph::findRoute;
+		meta["getNearestLane"] = &RoadGraph::getNearestLane;
+		meta["getIntersectionDistance"] = &RoadGraph::getIntersectionDistance;
+		meta["findIntersectionRoute"] = &RoadGraph::findIntersectionRoute;
 	}
 
 	{
@@ -185,17 +210,33 @@ void defineThreadSafeAPIs(sol::state* state) {
 		    "SQLite", sol::constructors<SQLite(const char*)>());
 		meta["close"] = &SQLite::close;
 		meta["query"] = &SQLite::query;
+		meta["prepare"] = &SQLite::prepare;
+	}
+
+	{
+		auto meta = state->new_usertype<SQLiteStatement>("SQLiteStatement",
+		                                                 sol::no_constructor);
+		meta["close"] = &SQLiteStatement::close;
+		meta["query"] = &SQLiteStatement::query;
+		meta["sql"] = sol::property(&SQLiteStatement::getSQL);
 	}
 
 	{
 		auto meta = state->new_usertype<TCPClient>(
 		    "TCPClient",
 		    sol::constructors<TCPClient(std::string_view, std::string_view)>());
+		meta["connect"] = &TCPClient::connectAsync;
+		meta["setDNSCacheTTL"] = &TCPClient::setDNSCacheTTL;
+		meta["clearDNSCache"] = &TCPClient::clearDNSCache;
 		meta["close"] = &TCPClient::close;
+		meta["poll"] = &TCPClient::poll;
 		meta["send"] = &TCPClient::send;
 		meta["receive"] = &TCPClient::receive;
 
 		meta["isOpen"] = sol::property(&TCPClient::isOpen);
+		meta["fileDescriptor"] = sol::property(&TCPClient::getFileDescriptor);
+		meta["state"] = sol::property(&TCPClient::getState);
+		meta["error"] = sol::property(&TCPClient::getError);
 	}
 
 	{
@@ -205,6 +246,7 @@ void defineThreadSafeAPIs(sol::state* state) {
 		meta["accept"] = &TCPServer::accept;
 
 		meta["isOpen"] = sol::property(&TCPServer::isOpen);
+		meta["fileDescriptor"] = sol::property(&TCPServer::getFileDescriptor);
 	}
 
 	{
@@ -219,6 +261,22 @@ void defineThreadSafeAPIs(sol::state* state) {
 		meta["address"] = sol::property(&TCPServerConnection::getAddress);
 	}
 
+	{
+		auto meta = state->new_usertype<UDPSocket>(
+		    "UDPSocket",
+		    sol::constructors<UDPSocket(), UDPSocket(unsigned short)>());
+		meta["close"] = &UDPSocket::close;
+		meta["send"] = &UDPSocket::send;
+		meta["sendMany"] = &UDPSocket::sendMany;
+		meta["receive"] = &UDPSocket::receive;
+		meta["receiveMany"] = &UDPSocket::receiveMany;
+
+		meta["isOpen"] = sol::property(&UDPSocket::isOpen);
+		meta["fileDescriptor"] = sol::property(&UDPSocket::getFileDescriptor);
+		meta["port"] = sol::property(&UDPSocket::getPort);
+		meta["numTruncated"] = sol::property(&UDPSocket::getNumTruncated);
+	}
+
 	(*state)["print"] = Lua::print;
 
 	(*state)["Vector"] = sol::overload(Lua::Vector_, Lua::Vector_3f);
@@ -238,6 +296,125 @@ void defineThreadSafeAPIs(sol::state* state) {
 		httpTable["postSync"] = Lua::http::postSync;
 	}
 
+	{
+		auto meta = state->new_usertype<SharedBuffer>(
+		    "SharedBuffer", sol::constructors<SharedBuffer(std::string_view)>());
+		meta["readU8"] = &SharedBuffer::readU8;
+		meta["readI8"] = &SharedBuffer::readI8;
+		meta["readU16"] = &SharedBuffer::readU16;
+		meta["readI16"] = &SharedBuffer::readI16;
+		meta["readU32"] = &SharedBuffer::readU32;
+		meta["readI32"] = &SharedBuffer::readI32;
+		meta["readFloat"] = &SharedBuffer::readFloat;
+		meta["readDouble"] = &SharedBuffer::readDouble;
+		meta["sub"] = &SharedBuffer::sub;
+		meta["toString"] = &SharedBuffer::toString;
+		meta["size"] = sol::property(&SharedBuffer::getSize);
+		meta["address"] = sol::property(&SharedBuffer::getAddress);
+		meta["useCount"] = sol::property(&SharedBuffer::getUseCount);
+	}
+
+	{
+		auto meta = state->new_usertype<SerialBuffer>(
+		    "SerialBuffer", sol::constructors<SerialBuffer()>());
+		meta["clear"] = &SerialBuffer::clear;
+		meta["toString"] = &SerialBuffer::toString;
+		meta["toSharedBuffer"] = &SerialBuffer::toSharedBuffer;
+		meta["size"] = sol::property(&SerialBuffer::getSize);
+		meta["address"] = sol::property(&SerialBuffer::getAddress);
+	}
+
+	{
+		auto meta =
+		    state->new_usertype<SharedDict>("SharedDict", sol::no_constructor);
+		meta["open"] = &SharedDict::open;
+		meta["get"] = &SharedDict::get;
+		meta["set"] = &SharedDict::set;
+		meta["remove"] = &SharedDict::remove;
+		meta["incr"] = &SharedDict::incr;
+		meta["cas"] = &SharedDict::compareAndSwap;
+		meta["getKeys"] = &SharedDict::getKeys;
+		meta["clear"] = &SharedDict::clear;
+		meta["version"] = sol::property(&SharedDict::getVersion);
+		meta["size"] = sol::property(&SharedDict::getSize);
+	}
+
+	{
+		auto meta = state->new_usertype<WorldSnapshot>(
+		    "WorldSnapshot", sol::constructors<WorldSnapshot()>());
+		meta["cdef"] = sol::var(WorldSnapshot::cdef);
+		meta["getLatestTick"] = &WorldSnapshot::getLatestTick;
+		meta["update"] = &WorldSnapshot::update;
+		meta["tick"] = sol::property(&WorldSnapshot::getTick);
+		meta["ticksSinceReset"] =
+		    sol::property(&WorldSnapshot::getTicksSinceReset);
+		meta["numActiveHumans"] =
+		    sol::property(&WorldSnapshot::getNumActiveHumans);
+		meta["numActiveVehicles"] =
+		    sol::property(&WorldSnapshot::getNumActiveVehicles);
+		meta["address"] = sol::property(&WorldSnapshot::getAddress);
+		meta["size"] = sol::property(&WorldSnapshot::getSize);
+		meta["isHumanActive"] = &WorldSnapshot::isHumanActive;
+		meta["isHumanAlive"] = &WorldSnapshot::isHumanAlive;
+		meta["getHumanPlayerID"] = &WorldSnapshot::getHumanPlayerID;
+		meta["getHumanTeam"] = &WorldSnapshot::getHumanTeam;
+		meta["getHumanHealth"] = &WorldSnapshot::getHumanHealth;
+		meta["getHumanVehicleID"] = &WorldSnapshot::getHumanVehicleID;
+		meta["getHumanPos"] = &WorldSnapshot::getHumanPos;
+		meta["getHumanVel"] = &WorldSnapshot::getHumanVel;
+		meta["getHumanView"] = &WorldSnapshot::getHumanView;
+		meta["isVehicleActive"] = &WorldSnapshot::isVehicleActive;
+		meta["getVehicleType"] = &WorldSnapshot::getVehicleType;
+		meta["getVehicleHealth"] = &WorldSnapshot::getVehicleHealth;
+		meta["getVehicleLastDriverPlayerID"] =
+		    &WorldSnapshot::getVehicleLastDriverPlayerID;
+		meta["getVehiclePos"] = &WorldSnapshot::getVehiclePos;
+		meta["getVehicleVel"] = &WorldSnapshot::getVehicleVel;
+		meta["getVehicleRot"] = &WorldSnapshot::getVehicleRot;
+	}
+
+	{
+		auto serialTable = state->create_table();
+		(*state)["serial"] = serialTable;
+		serialTable["encode"] = Lua::serial::encode;
+		serialTable["encodeInto"] = Lua::serial::encodeInto;
+		serialTable["decode"] = Lua::serial::decode;
+	}
+
+	{
+		auto meta =
+		    state->new_usertype<Metrics::Counter>("new", sol::no_constructor);
+		meta["add"] = sol::overload(
+		    [](Metrics::Counter* self) { self->add(); },
+		    [](Metrics::Counter* self, uint64_t amount) { self->add(amount); });
+		meta["value"] = sol::property(&Metrics::Counter::get);
+	}
+
+	{
+		auto meta = state->new_usertype<Metrics::Gauge>("new", sol::no_constructor);
+		meta["set"] = &Metrics::Gauge::set;
+		meta["add"] = &Metrics::Gauge::add;
+		meta["value"] = sol::property(&Metrics::Gauge::get);
+	}
+
+	{
+		auto meta =
+		    state->new_usertype<Metrics::Histogram>("new", sol::no_constructor);
+		meta["observe"] = &Metrics::Histogram::observe;
+		meta["count"] = sol::property(&Metrics::Histogram::getCount);
+		meta["sum"] = sol::property(&Metrics::Histogram::getSum);
+	}
+
+	{
+		auto metricsTable = state->create_table();
+		(*state)["metrics"] = metricsTable;
+		metricsTable["counter"] = Lua::metrics::counter;
+		metricsTable["gauge"] = Lua::metrics::gauge;
+		metricsTable["histogram"] = Lua::metrics::histogram;
+		metricsTable["render"] = Metrics::render;
+		metricsTable["listen"] = Metrics::listen;
+	}
+
 	{
 		auto lz4table = state->create_table();
 		(*state)["lz4"] = lz4table;
@@ -328,6 +505,11 @@ void luaInit(bool redo) {
 			}
 		}
 
+		Lua::http::clearCallbacks();
+		PathRequests::clearCallbacks();
+		SQLite::clearCallbacks();
+		HTTPServer::stopAll();
+
 		delete lua;
 	} else {
 		Console::log(LUA_PREFIX "Initializing state...\n");
@@ -434,9 +616,13 @@ void luaInit(bool redo) {
 		    sol::property(&Connection::getPlayer, &Connection::setPlayer);
 		meta["spectatingHuman"] = sol::property(&Connection::getSpectatingHuman);
 		meta["cameraPos"] = sol::property(&Connection::getCameraPosition);
+		meta["bytesSent"] = sol::property(&Connection::getBytesSent);
+		meta["packetsSent"] = sol::property(&Connection::getPacketsSent);
+		meta["bytesPerSecond"] = sol::property(&Connection::getBytesPerSecond);
 
 		meta["getEarShot"] = &Connection::getEarShot;
 		meta["hasReceivedEvent"] = &Connection::hasReceivedEvent;
+		meta["getPacketTypeCounts"] = &Connection::getPacketTypeCounts;
 	}
 
 	{
@@ -929,6 +1115,64 @@ void luaInit(bool redo) {
 		meta["stop"] = &Worker::stop;
 		meta["sendMessage"] = &Worker::sendMessage;
 		meta["receiveMessage"] = &Worker::receiveMessage;
+		meta["receiveMessages"] = &Worker::receiveMessages;
+		meta["numSendDropped"] = sol::property(&Worker::getNumSendDropped);
+		meta["numReceiveDropped"] = sol::property(&Worker::getNumReceiveDropped);
+		meta["sendHighWater"] = sol::property(&Worker::getSendHighWater);
+		meta["receiveHighWater"] = sol::property(&Worker::getReceiveHighWater);
+	}
+
+	{
+		auto meta = lua->new_usertype<WorkerPool>(
+		    "WorkerPool",
+		    sol::constructors<WorkerPool(unsigned int, std::string)>());
+		meta["submit"] = &WorkerPool::submit;
+		meta["map"] = &WorkerPool::map;
+		meta["poll"] = &WorkerPool::poll;
+		meta["numPending"] = sol::property(&WorkerPool::getNumPending);
+		meta["numThreads"] = sol::property(&WorkerPool::getNumThreads);
+	}
+
+	{
+		auto meta = lua->new_usertype<HTTPClient>(
+		    "HTTPClient",
+		    sol::constructors<HTTPClient(std::string),
+		                      HTTPClient(std::string, unsigned int)>());
+		meta["getSync"] = &HTTPClient::getSync;
+		meta["postSync"] = &HTTPClient::postSync;
+		meta["get"] = &HTTPClient::get;
+		meta["post"] = &HTTPClient::post;
+		meta["close"] = &HTTPClient::close;
+		meta["host"] = sol::property(&HTTPClient::getHost);
+		meta["numNewConnections"] =
+		    sol::property(&HTTPClient::getNumNewConnections);
+		meta["numReusedConnections"] =
+		    sol::property(&HTTPClient::getNumReusedConnections);
+		meta["numIdleConnections"] =
+		    sol::property(&HTTPClient::getNumIdleConnections);
+	}
+
+	{
+		auto meta = lua->new_usertype<HTTPServer>(
+		    "HTTPServer",
+		    sol::constructors<HTTPServer(std::string, unsigned short)>());
+		meta["route"] = &HTTPServer::route;
+		meta["removeRoute"] = &HTTPServer::removeRoute;
+		meta["publish"] = &HTTPServer::publish;
+		meta["unpublish"] = &HTTPServer::unpublish;
+		meta["stop"] = &HTTPServer::stop;
+		meta["isRunning"] = sol::property(&HTTPServer::isRunning);
+		meta["numQueued"] = sol::property(&HTTPServer::getNumQueued);
+	}
+
+	{
+		auto meta =
+		    lua->new_usertype<HTTPServerResponse>("new", sol::no_constructor);
+		meta["setHeader"] = &HTTPServerResponse::setHeader;
+		meta["send"] = &HTTPServerResponse::send;
+		meta["status"] = sol::property(&HTTPServerResponse::getStatus,
+		                               &HTTPServerResponse::setStatus);
+		meta["isSent"] = sol::property(&HTTPServerResponse::isSent);
 	}
 
 	{
@@ -939,12 +1183,26 @@ void luaInit(bool redo) {
 		meta["terminate"] = &ChildProcess::terminate;
 		meta["getExitCode"] = &ChildProcess::getExitCode;
 		meta["receiveMessage"] = &ChildProcess::receiveMessage;
+		meta["receiveMessages"] = &ChildProcess::receiveMessages;
 		meta["sendMessage"] = &ChildProcess::sendMessage;
 		meta["setCPULimit"] = &ChildProcess::setCPULimit;
 		meta["setMemoryLimit"] = &ChildProcess::setMemoryLimit;
 		meta["setFileSizeLimit"] = &ChildProcess::setFileSizeLimit;
 		meta["getPriority"] = &ChildProcess::getPriority;
 		meta["setPriority"] = &ChildProcess::setPriority;
+		meta["release"] = &ChildProcess::release;
+	}
+
+	{
+		auto meta = lua->new_usertype<ChildProcessPool>(
+		    "ChildProcessPool",
+		    sol::constructors<ChildProcessPool(unsigned int,
+		                                       sol::optional<int>)>());
+		meta["checkout"] = &ChildProcessPool::checkout;
+		meta["checkoutChunk"] = &ChildProcessPool::checkoutChunk;
+		meta["numIdle"] = sol::property(&ChildProcessPool::getNumIdle);
+		meta["size"] = sol::property(&ChildProcessPool::getSize);
+		meta["lastError"] = sol::property(&ChildProcessPool::getLastError);
 	}
 
 	{
@@ -1116,6 +1374,15 @@ void luaInit(bool redo) {
 
 	(*lua)["flagStateForReset"] = Lua::flagStateForReset;
 
+	(*lua)["http"]["get"] = Lua::http::get;
+	(*lua)["http"]["post"] = Lua::http::post;
+
+	(*lua)["PointGraph"]["findPathAsync"] = PathRequests::findPathAsync;
+	(*lua)["PointGraph"]["findPathsBatch"] = PathRequests::findPathsBatch;
+
+	(*lua)["SQLite"]["queryAsync"] = &SQLite::queryAsync;
+	(*lua)["SQLite"]["flush"] = &SQLite::flush;
+
 	{
 		auto hookTable = lua->create_table();
 		(*lua)["hook"] = hookTable;
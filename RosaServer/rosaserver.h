@@ -11,14 +11,25 @@
 #include "engine.h"
 #include "filewatcher.h"
 #include "hooks.h"
+#include "httpclient.h"
+#include "httpserver.h"
 #include "image.h"
 #include "lz4impl.h"
+#include "metrics.h"
 #include "opusencoder.h"
+#include "pathrequests.h"
 #include "pointgraph.h"
+#include "roadgraph.h"
+#include "serial.h"
 #include "server.h"
+#include "sharedbuffer.h"
+#include "shareddict.h"
 #include "sol/sol.hpp"
 #include "sqlite.h"
 #include "subhook.h"
 #include "tcpclient.h"
 #include "tcpserver.h"
+#include "udpsocket.h"
 #include "worker.h"
+#include "workerpool.h"
+#include "worldsnapshot.h"
@@ -0,0 +1,307 @@
+#include "serial.h"
+
+#include <cmath>
+#include <cstring>
+#include <stdexcept>
+#include <unordered_map>
+
+// Wire format, after a one byte version header:
+//   tag byte, then
+//   nil / false / true: nothing
+//   integer: zigzag varint
+//   double: 8 bytes, little endian
+//   string: varint length, bytes
+//   table: varint array length, varint hash count, array values, then
+//          key/value pairs
+//   reference: varint index of a table already seen in this value
+// Tables are numbered in the order they are first seen, so shared references
+// and cycles come out as references instead of being encoded again.
+enum SerialTag : uint8_t {
+	nilTag,
+	falseTag,
+	trueTag,
+	integerTag,
+	doubleTag,
+	stringTag,
+	tableTag,
+	referenceTag,
+};
+
+static constexpr const char* errorMalformed = "Malformed serial data";
+
+namespace {
+class Encoder {
+	std::vector<uint8_t>& out;
+	std::unordered_map<const void*, uint64_t> tables;
+	unsigned int depth = 0;
+
+	void writeByte(uint8_t byte) { out.push_back(byte); }
+
+	void writeVarint(uint64_t value) {
+		while (value >= 0x80) {
+			out.push_back(static_cast<uint8_t>(value) | 0x80);
+			value >>= 7;
+		}
+		out.push_back(static_cast<uint8_t>(value));
+	}
+
+	void writeBytes(const void* data, size_t size) {
+		auto bytes = static_cast<const uint8_t*>(data);
+		out.insert(out.end(), bytes, bytes + size);
+	}
+
+	void writeNumber(double number) {
+		if (std::trunc(number) == number && number >= -9.2233720368547758e18 &&
+		    number < 9.2233720368547758e18) {
+			auto integer = static_cast<int64_t>(number);
+			writeByte(integerTag);
+			writeVarint((static_cast<uint64_t>(integer) << 1) ^
+			            static_cast<uint64_t>(integer >> 63));
+			return;
+		}
+
+		writeByte(doubleTag);
+		uint64_t bits;
+		std::memcpy(&bits, &number, sizeof(bits));
+		for (int i = 0; i < 8; i++) writeByte(bits >> (i * 8));
+	}
+
+	void writeTable(const sol::table& table) {
+		const void* pointer = table.pointer();
+
+		auto search = tables.find(pointer);
+		if (search != tables.end()) {
+			writeByte(referenceTag);
+			writeVarint(search->second);
+			return;
+		}
+
+		if (++depth > maxSerialDepth) {
+			throw std::runtime_error("Table is nested too deeply");
+		}
+
+		auto index = tables.size();
+		tables.emplace(pointer, index);
+
+		size_t arrayLength = table.size();
+		size_t hashCount = 0;
+		for (const auto& pair : table) {
+			if (!isArrayKey(pair.first, arrayLength)) hashCount++;
+		}
+
+		writeByte(tableTag);
+		writeVarint(arrayLength);
+		writeVarint(hashCount);
+
+		for (size_t i = 1; i <= arrayLength; i++) {
+			write(table.raw_get<sol::object>(i));
+		}
+
+		for (const auto& pair : table) {
+			if (isArrayKey(pair.first, arrayLength)) continue;
+			write(pair.first);
+			write(pair.second);
+		}
+
+		depth--;
+	}
+
+	static bool isArrayKey(const sol::object& key, size_t arrayLength) {
+		if (key.get_type() != sol::type::number) return false;
+
+		double number = key.as<double>();
+		return number >= 1 && number <= arrayLength &&
+		       std::trunc(number) == number;
+	}
+
+ public:
+	Encoder(std::vector<uint8_t>& out) : out(out) {}
+
+	void write(const sol::object& value) {
+		switch (value.get_type()) {
+			case sol::type::nil:
+			case sol::type::none:
+				writeByte(nilTag);
+				break;
+			case sol::type::boolean:
+				writeByte(value.as<bool>() ? trueTag : falseTag);
+				break;
+			case sol::type::number:
+				writeNumber(value.as<double>());
+				break;
+			case sol::type::string: {
+				auto string = value.as<std::string_view>();
+				writeByte(stringTag);
+				writeVarint(string.size());
+				writeBytes(string.data(), string.size());
+				break;
+			}
+			case sol::type::table:
+				writeTable(value.as<sol::table>());
+				break;
+			default:
+				throw std::invalid_argument(
+				    std::string("Cannot serialize a ") +
+				    sol::type_name(value.lua_state(), value.get_type()));
+		}
+	}
+};
+
+class Decoder {
+	sol::state_view lua;
+	const uint8_t* position;
+	const uint8_t* end;
+	std::vector<sol::table> tables;
+	unsigned int depth = 0;
+
+	uint8_t readByte() {
+		if (position == end) throw std::runtime_error(errorMalformed);
+		return *position++;
+	}
+
+	uint64_t readVarint() {
+		uint64_t value = 0;
+		for (int shift = 0; shift < 64; shift += 7) {
+			uint8_t byte = readByte();
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80)) return value;
+		}
+		throw std::runtime_error(errorMalformed);
+	}
+
+	sol::object readTable() {
+		if (++depth > maxSerialDepth) {
+			throw std::runtime_error(errorMalformed);
+		}
+
+		uint64_t arrayLength = readVarint();
+		uint64_t hashCount = readVarint();
+
+		// Every entry takes at least a byte, which bounds the preallocation
+		size_t remaining = end - position;
+		if (arrayLength > remaining || hashCount > remaining) {
+			throw std::runtime_error(errorMalformed);
+		}
+
+		sol::table table = lua.create_table(arrayLength, hashCount);
+		tables.push_back(table);
+
+		for (uint64_t i = 1; i <= arrayLength; i++) {
+			table.raw_set(i, read());
+		}
+
+		for (uint64_t i = 0; i < hashCount; i++) {
+			sol::object key = read();
+			if (key.get_type() == sol::type::nil) {
+				throw std::runtime_error(errorMalformed);
+			}
+			table.raw_set(key, read());
+		}
+
+		depth--;
+		return table;
+	}
+
+ public:
+	Decoder(sol::state_view lua, const uint8_t* data, size_t size)
+	    : lua(lua), position(data), end(data + size) {}
+
+	sol::object readValue() {
+		if (readByte() != serialFormatVersion) {
+			throw std::runtime_error("Unsupported serial format version");
+		}
+
+		auto value = read();
+		if (position != end) throw std::runtime_error(errorMalformed);
+		return value;
+	}
+
+	sol::object read() {
+		switch (readByte()) {
+			case nilTag:
+				return sol::make_object(lua, sol::nil);
+			case falseTag:
+				return sol::make_object(lua, false);
+			case trueTag:
+				return sol::make_object(lua, true);
+			case integerTag: {
+				uint64_t zigzag = readVarint();
+				auto integer =
+				    static_cast<int64_t>((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+				return sol::make_object(lua, static_cast<double>(integer));
+			}
+			case doubleTag: {
+				uint64_t bits = 0;
+				for (int i = 0; i < 8; i++) {
+					bits |= static_cast<uint64_t>(readByte()) << (i * 8);
+				}
+				double number;
+				std::memcpy(&number, &bits, sizeof(number));
+				return sol::make_object(lua, number);
+			}
+			case stringTag: {
+				uint64_t size = readVarint();
+				if (size > static_cast<size_t>(end - position)) {
+					throw std::runtime_error(errorMalformed);
+				}
+				std::string_view string(reinterpret_cast<const char*>(position),
+				                        size);
+				position += size;
+				return sol::make_object(lua, string);
+			}
+			case tableTag:
+				return readTable();
+			case referenceTag: {
+				uint64_t index = readVarint();
+				if (index >= tables.size()) throw std::runtime_error(errorMalformed);
+				return tables[index];
+			}
+			default:
+				throw std::runtime_error(errorMalformed);
+		}
+	}
+};
+}  // namespace
+
+namespace Lua {
+namespace serial {
+std::string encode(sol::object value) {
+	std::vector<uint8_t> bytes;
+	bytes.push_back(serialFormatVersion);
+	Encoder(bytes).write(value);
+	return std::string(bytes.begin(), bytes.end());
+}
+
+// Replaces the buffer's contents; its capacity is kept between calls.
+size_t encodeInto(SerialBuffer* buffer, sol::object value) {
+	buffer->bytes.clear();
+	buffer->bytes.push_back(serialFormatVersion);
+	Encoder(buffer->bytes).write(value);
+	return buffer->bytes.size();
+}
+
+// Accepts a string, SharedBuffer or SerialBuffer.
+sol::object decode(sol::object data, sol::this_state s) {
+	sol::state_view lua(s);
+
+	if (data.get_type() == sol::type::string) {
+		auto string = data.as<std::string_view>();
+		return Decoder(lua, reinterpret_cast<const uint8_t*>(string.data()),
+		               string.size())
+		    .readValue();
+	}
+
+	if (data.is<SharedBuffer>()) {
+		const auto& buffer = data.as<const SharedBuffer&>();
+		return Decoder(lua, buffer.data(), buffer.getSize()).readValue();
+	}
+
+	if (data.is<SerialBuffer>()) {
+		const auto& buffer = data.as<const SerialBuffer&>();
+		return Decoder(lua, buffer.bytes.data(), buffer.bytes.size()).readValue();
+	}
+
+	throw std::invalid_argument("Expected a string or buffer");
+}
+}  // namespace serial
+}  // namespace Lua
@@ -0,0 +1,36 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sharedbuffer.h"
+#include "sol/sol.hpp"
+
+static constexpr uint8_t serialFormatVersion = 1;
+static constexpr unsigned int maxSerialDepth = 256;
+
+// A reusable output buffer for serial.encodeInto, so encoding every tick
+// doesn't create a new Lua string each time.
+class SerialBuffer {
+ public:
+	std::vector<uint8_t> bytes;
+
+	size_t getSize() const { return bytes.size(); }
+	void* getAddress() { return bytes.data(); }
+	void clear() { bytes.clear(); }
+	std::string toString() const {
+		return std::string(bytes.begin(), bytes.end());
+	}
+	SharedBuffer toSharedBuffer() const {
+		return SharedBuffer(std::string_view(
+		    reinterpret_cast<const char*>(bytes.data()), bytes.size()));
+	}
+};
+
+namespace Lua {
+namespace serial {
+std::string encode(sol::object value);
+size_t encodeInto(SerialBuffer* buffer, sol::object value);
+sol::object decode(sol::object data, sol::this_state s);
+}  // namespace serial
+}  // namespace Lua
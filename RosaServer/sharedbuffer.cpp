@@ -0,0 +1,82 @@
+#include "sharedbuffer.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+
+static constexpr const char* errorOutOfRange = "Index out of range";
+
+SharedBuffer::Block::Block(size_t size) : size(size) {
+	// aligned_alloc wants a multiple of the alignment, and never zero
+	size_t allocationSize =
+	    (size + sharedBufferAlignment - 1) / sharedBufferAlignment *
+	    sharedBufferAlignment;
+	if (allocationSize == 0) allocationSize = sharedBufferAlignment;
+
+	data = static_cast<uint8_t*>(
+	    std::aligned_alloc(sharedBufferAlignment, allocationSize));
+	if (!data) throw std::bad_alloc();
+}
+
+SharedBuffer::Block::~Block() { std::free(data); }
+
+SharedBuffer::SharedBuffer(std::string_view data) {
+	auto newBlock = std::make_shared<Block>(data.size());
+	std::memcpy(newBlock->data, data.data(), data.size());
+	block = std::move(newBlock);
+}
+
+template <typename T>
+T SharedBuffer::read(size_t offset) const {
+	if (offset > block->size || block->size - offset < sizeof(T)) {
+		throw std::invalid_argument(errorOutOfRange);
+	}
+
+	T value;
+	std::memcpy(&value, block->data + offset, sizeof(T));
+	return value;
+}
+
+uint8_t SharedBuffer::readU8(size_t offset) const {
+	return read<uint8_t>(offset);
+}
+
+int8_t SharedBuffer::readI8(size_t offset) const { return read<int8_t>(offset); }
+
+uint16_t SharedBuffer::readU16(size_t offset) const {
+	return read<uint16_t>(offset);
+}
+
+int16_t SharedBuffer::readI16(size_t offset) const {
+	return read<int16_t>(offset);
+}
+
+uint32_t SharedBuffer::readU32(size_t offset) const {
+	return read<uint32_t>(offset);
+}
+
+int32_t SharedBuffer::readI32(size_t offset) const {
+	return read<int32_t>(offset);
+}
+
+float SharedBuffer::readFloat(size_t offset) const {
+	return read<float>(offset);
+}
+
+double SharedBuffer::readDouble(size_t offset) const {
+	return read<double>(offset);
+}
+
+std::string SharedBuffer::sub(size_t offset, size_t length) const {
+	if (offset > block->size || block->size - offset < length) {
+		throw std::invalid_argument(errorOutOfRange);
+	}
+
+	return std::string(reinterpret_cast<const char*>(block->data) + offset,
+	                   length);
+}
+
+std::string SharedBuffer::toString() const {
+	return std::string(reinterpret_cast<const char*>(block->data), block->size);
+}
@@ -0,0 +1,46 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "sol/sol.hpp"
+
+static constexpr size_t sharedBufferAlignment = 64;
+
+// An immutable block of bytes shared between Lua states by reference. Copying
+// a SharedBuffer (including passing it to a worker) only bumps a reference
+// count; the bytes are freed once the last state lets go of it.
+class SharedBuffer {
+	struct Block {
+		uint8_t* data;
+		size_t size;
+
+		Block(size_t size);
+		~Block();
+	};
+
+	std::shared_ptr<const Block> block;
+
+	template <typename T>
+	T read(size_t offset) const;
+
+ public:
+	SharedBuffer(std::string_view data);
+
+	size_t getSize() const { return block->size; }
+	const uint8_t* data() const { return block->data; }
+	void* getAddress() const { return const_cast<uint8_t*>(block->data); }
+	long getUseCount() const { return block.use_count(); }
+
+	uint8_t readU8(size_t offset) const;
+	int8_t readI8(size_t offset) const;
+	uint16_t readU16(size_t offset) const;
+	int16_t readI16(size_t offset) const;
+	uint32_t readU32(size_t offset) const;
+	int32_t readI32(size_t offset) const;
+	float readFloat(size_t offset) const;
+	double readDouble(size_t offset) const;
+	std::string sub(size_t offset, size_t length) const;
+	std::string toString() const;
+};
@@ -0,0 +1,241 @@
+#include "shareddict.h"
+
+#include <stdexcept>
+
+std::mutex SharedDict::storesMutex;
+std::unordered_map<std::string, std::shared_ptr<SharedDict::Store>>
+    SharedDict::stores;
+
+static constexpr const char* errorInvalidValue =
+    "Value must be a boolean, number or string";
+
+template <typename Value>
+static bool toValue(const sol::object& object, Value& out) {
+	switch (object.get_type()) {
+		case sol::type::boolean:
+			out = object.as<bool>();
+			return true;
+		case sol::type::number:
+			out = object.as<double>();
+			return true;
+		case sol::type::string:
+			out = object.as<std::string>();
+			return true;
+		default:
+			return false;
+	}
+}
+
+template <typename Value>
+static sol::object fromValue(sol::state_view lua, const Value& value) {
+	return std::visit([&](const auto& v) { return sol::make_object(lua, v); },
+	                  value);
+}
+
+static std::chrono::steady_clock::time_point getExpiry(
+    sol::optional<double> ttlSeconds) {
+	if (!ttlSeconds || *ttlSeconds <= 0) {
+		return std::chrono::steady_clock::time_point();
+	}
+
+	return std::chrono::steady_clock::now() +
+	       std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	           std::chrono::duration<double>(*ttlSeconds));
+}
+
+// Stores live for the rest of the process so every state that opens the same
+// name, now or after a reset, sees the same data.
+SharedDict SharedDict::open(std::string name) {
+	std::lock_guard<std::mutex> guard(storesMutex);
+
+	auto& store = stores[name];
+	if (!store) store = std::make_shared<Store>();
+
+	return SharedDict(store);
+}
+
+// Reads never take the write lock, so expired entries are freed by writers.
+void SharedDict::sweepExpired(Stripe& stripe, Clock::time_point now) {
+	if (++stripe.writesSinceSweep < sharedDictSweepInterval) return;
+	stripe.writesSinceSweep = 0;
+
+	for (auto it = stripe.entries.begin(); it != stripe.entries.end();) {
+		if (it->second.isExpired(now)) {
+			it = stripe.entries.erase(it);
+		} else {
+			++it;
+		}
+	}
+}
+
+SharedDict::Stripe& SharedDict::getStripe(std::string_view key) const {
+	return store->stripes[std::hash<std::string_view>()(key) %
+	                      sharedDictNumStripes];
+}
+
+sol::object SharedDict::get(std::string_view key, sol::this_state s) const {
+	sol::state_view lua(s);
+	auto& stripe = getStripe(key);
+
+	std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+
+	auto search = stripe.entries.find(std::string(key));
+	if (search == stripe.entries.end() ||
+	    search->second.isExpired(Clock::now())) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	return fromValue(lua, search->second.value);
+}
+
+// Setting nil removes the key.
+void SharedDict::set(std::string_view key, sol::object value,
+                     sol::optional<double> ttlSeconds) {
+	if (value.get_type() == sol::type::nil) {
+		remove(key);
+		return;
+	}
+
+	Entry entry;
+	if (!toValue(value, entry.value)) {
+		throw std::invalid_argument(errorInvalidValue);
+	}
+	entry.expiresAt = getExpiry(ttlSeconds);
+
+	auto& stripe = getStripe(key);
+	{
+		std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+		sweepExpired(stripe, Clock::now());
+		stripe.entries[std::string(key)] = std::move(entry);
+	}
+	store->version++;
+}
+
+bool SharedDict::remove(std::string_view key) {
+	auto& stripe = getStripe(key);
+
+	bool removed;
+	{
+		std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+		removed = stripe.entries.erase(std::string(key));
+	}
+
+	if (removed) store->version++;
+	return removed;
+}
+
+// Adds delta (default 1) to a number, treating a missing or expired key as 0.
+// A TTL, if given, is only applied when the key is created.
+double SharedDict::incr(std::string_view key, sol::optional<double> delta,
+                        sol::optional<double> ttlSeconds) {
+	auto& stripe = getStripe(key);
+	double result;
+
+	{
+		std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+		auto now = Clock::now();
+		sweepExpired(stripe, now);
+
+		auto search = stripe.entries.find(std::string(key));
+		if (search == stripe.entries.end() || search->second.isExpired(now)) {
+			search = stripe.entries
+			             .insert_or_assign(std::string(key),
+			                               Entry{0.0, getExpiry(ttlSeconds)})
+			             .first;
+		}
+
+		auto number = std::get_if<double>(&search->second.value);
+		if (!number) {
+			throw std::runtime_error("Value is not a number");
+		}
+
+		*number += delta.value_or(1);
+		result = *number;
+	}
+
+	store->version++;
+	return result;
+}
+
+// Sets the key to `desired` only if it currently holds `expected` (nil meaning
+// absent). Returns whether the swap happened.
+bool SharedDict::compareAndSwap(std::string_view key, sol::object expected,
+                                sol::object desired) {
+	bool expectAbsent = expected.get_type() == sol::type::nil;
+	Value expectedValue;
+	if (!expectAbsent && !toValue(expected, expectedValue)) {
+		throw std::invalid_argument(errorInvalidValue);
+	}
+
+	bool removeKey = desired.get_type() == sol::type::nil;
+	Value desiredValue;
+	if (!removeKey && !toValue(desired, desiredValue)) {
+		throw std::invalid_argument(errorInvalidValue);
+	}
+
+	auto& stripe = getStripe(key);
+	{
+		std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+		auto now = Clock::now();
+		sweepExpired(stripe, now);
+
+		auto search = stripe.entries.find(std::string(key));
+		bool present =
+		    search != stripe.entries.end() && !search->second.isExpired(now);
+
+		if (expectAbsent ? present
+		                 : !present || search->second.value != expectedValue) {
+			return false;
+		}
+
+		if (removeKey) {
+			if (present) stripe.entries.erase(search);
+		} else if (present) {
+			search->second.value = std::move(desiredValue);
+		} else {
+			stripe.entries.insert_or_assign(
+			    std::string(key),
+			    Entry{std::move(desiredValue), Clock::time_point()});
+		}
+	}
+
+	store->version++;
+	return true;
+}
+
+sol::table SharedDict::getKeys(sol::this_state s) const {
+	sol::state_view lua(s);
+	sol::table keys = lua.create_table();
+	auto now = Clock::now();
+
+	for (auto& stripe : store->stripes) {
+		std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+		for (const auto& [key, entry] : stripe.entries) {
+			if (!entry.isExpired(now)) keys.add(key);
+		}
+	}
+
+	return keys;
+}
+
+void SharedDict::clear() {
+	for (auto& stripe : store->stripes) {
+		std::unique_lock<std::shared_mutex> lock(stripe.mutex);
+		stripe.entries.clear();
+	}
+	store->version++;
+}
+
+size_t SharedDict::getSize() const {
+	size_t size = 0;
+	auto now = Clock::now();
+
+	for (auto& stripe : store->stripes) {
+		std::shared_lock<std::shared_mutex> lock(stripe.mutex);
+		for (const auto& [key, entry] : stripe.entries) {
+			if (!entry.isExpired(now)) size++;
+		}
+	}
+
+	return size;
+}
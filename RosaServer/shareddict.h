@@ -0,0 +1,71 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <variant>
+
+#include "sol/sol.hpp"
+
+static constexpr size_t sharedDictNumStripes = 16;
+static constexpr unsigned int sharedDictSweepInterval = 256;
+
+// A named key/value store visible to the main state and every worker. Keys
+// are spread over independently locked stripes so readers of one key never
+// wait on writers of another, and readers of the same stripe share the lock.
+class SharedDict {
+	using Value = std::variant<bool, double, std::string>;
+	using Clock = std::chrono::steady_clock;
+
+	struct Entry {
+		Value value;
+		// Never expires if zero
+		Clock::time_point expiresAt;
+
+		bool isExpired(Clock::time_point now) const {
+			return expiresAt != Clock::time_point() && expiresAt <= now;
+		}
+	};
+
+	struct Stripe {
+		std::shared_mutex mutex;
+		std::unordered_map<std::string, Entry> entries;
+		unsigned int writesSinceSweep = 0;
+	};
+
+	struct Store {
+		Stripe stripes[sharedDictNumStripes];
+		// Bumped on every change so readers can cheaply tell if anything moved
+		std::atomic_uint64_t version = 0;
+	};
+
+	static std::mutex storesMutex;
+	static std::unordered_map<std::string, std::shared_ptr<Store>> stores;
+
+	std::shared_ptr<Store> store;
+
+	SharedDict(std::shared_ptr<Store> store) : store(store) {}
+	Stripe& getStripe(std::string_view key) const;
+	static void sweepExpired(Stripe& stripe, Clock::time_point now);
+
+ public:
+	static SharedDict open(std::string name);
+
+	sol::object get(std::string_view key, sol::this_state s) const;
+	void set(std::string_view key, sol::object value,
+	         sol::optional<double> ttlSeconds);
+	bool remove(std::string_view key);
+	double incr(std::string_view key, sol::optional<double> delta,
+	            sol::optional<double> ttlSeconds);
+	bool compareAndSwap(std::string_view key, sol::object expected,
+	                    sol::object desired);
+	sol::table getKeys(sol::this_state s) const;
+	void clear();
+
+	uint64_t getVersion() const { return store->version.load(); }
+	size_t getSize() const;
+};
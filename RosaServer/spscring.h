@@ -0,0 +1,90 @@
+#pragma once
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <utility>
+
+// Bounded lock-free single-producer single-consumer ring. Exactly one thread
+// may push and exactly one (other) thread may pop. Values are moved in and
+// out, never copied.
+template <typename T>
+class SPSCRing {
+	static constexpr size_t cacheLineSize = 64;
+
+	const size_t mask;
+	std::unique_ptr<T[]> slots;
+
+	// Producer side
+	alignas(cacheLineSize) std::atomic_size_t tail = 0;
+	size_t cachedHead = 0;
+	std::atomic_size_t highWater = 0;
+	std::atomic_size_t numDropped = 0;
+
+	// Consumer side
+	alignas(cacheLineSize) std::atomic_size_t head = 0;
+	size_t cachedTail = 0;
+
+	static size_t roundUpToPowerOfTwo(size_t value) {
+		size_t result = 1;
+		while (result < value) result <<= 1;
+		return result;
+	}
+
+ public:
+	SPSCRing(size_t capacity)
+	    : mask(roundUpToPowerOfTwo(capacity) - 1), slots(new T[mask + 1]) {}
+
+	SPSCRing(const SPSCRing&) = delete;
+	SPSCRing& operator=(const SPSCRing&) = delete;
+
+	// Returns false and counts a drop if the ring is full.
+	bool push(T&& value) {
+		auto currentTail = tail.load(std::memory_order_relaxed);
+
+		if (currentTail - cachedHead > mask) {
+			cachedHead = head.load(std::memory_order_acquire);
+			if (currentTail - cachedHead > mask) {
+				numDropped.store(numDropped.load(std::memory_order_relaxed) + 1,
+				                 std::memory_order_relaxed);
+				return false;
+			}
+		}
+
+		slots[currentTail & mask] = std::move(value);
+		tail.store(currentTail + 1, std::memory_order_release);
+
+		auto size = currentTail + 1 - cachedHead;
+		if (size > highWater.load(std::memory_order_relaxed)) {
+			highWater.store(size, std::memory_order_relaxed);
+		}
+		return true;
+	}
+
+	bool pop(T& out) {
+		auto currentHead = head.load(std::memory_order_relaxed);
+
+		if (currentHead == cachedTail) {
+			cachedTail = tail.load(std::memory_order_acquire);
+			if (currentHead == cachedTail) {
+				return false;
+			}
+		}
+
+		out = std::move(slots[currentHead & mask]);
+		head.store(currentHead + 1, std::memory_order_release);
+		return true;
+	}
+
+	// Approximate unless called from the producer or consumer thread.
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) -
+		       head.load(std::memory_order_acquire);
+	}
+	size_t capacity() const { return mask + 1; }
+	size_t getHighWater() const {
+		return highWater.load(std::memory_order_relaxed);
+	}
+	size_t getNumDropped() const {
+		return numDropped.load(std::memory_order_relaxed);
+	}
+};
@@ -1,6 +1,35 @@
 #include "sqlite.h"
 
-SQLite::SQLite(const char* fileName) {
+#include <cmath>
+#include <optional>
+
+#include "api.h"
+#include "mpscqueue.h"
+
+static constexpr const char* errorClosed = "Database is closed";
+
+struct SQLiteResult {
+	unsigned int id;
+	bool failed = false;
+	std::string error;
+	int numColumns = 0;
+	std::vector<std::vector<SQLiteValue>> rows;
+	int numChanges = 0;
+};
+
+static MPSCQueue<SQLiteResult> sqliteResults;
+static std::unordered_map<unsigned int, sol::protected_function>
+    sqliteCallbacks;
+static unsigned int sqliteNextJobID = 0;
+
+static std::tuple<sol::object, sol::object> getError(sol::state_view lua,
+                                                     sqlite3* handle) {
+	return std::make_tuple(
+	    sol::make_object(lua, sol::nil),
+	    sol::make_object(lua, handle ? sqlite3_errmsg(handle) : errorClosed));
+}
+
+SQLiteConnection::SQLiteConnection(const char* fileName) {
 	int res = sqlite3_open(fileName, &handle);
 	if (res != SQLITE_OK || handle == nullptr) {
 		close();
@@ -8,116 +37,187 @@ SQLite::SQLite(const char* fileName) {
 	}
 }
 
-SQLite::~SQLite() { close(); }
+SQLiteConnection::~SQLiteConnection() { close(); }
+
+void SQLiteConnection::close() {
+	for (auto& [sql, statement] : cachedStatements) {
+		sqlite3_finalize(statement);
+	}
+	cachedBySQL.clear();
+	cachedStatements.clear();
 
-void SQLite::close() {
 	if (handle) {
-		sqlite3_close(handle);
+		// Closing is deferred until any statements from db:prepare are finalized
+		sqlite3_close_v2(handle);
 		handle = nullptr;
 	}
 }
 
-std::tuple<sol::object, sol::object> SQLite::query(const char* sql,
-                                                   sol::variadic_args arguments,
-                                                   sol::this_state s) {
-	sol::state_view lua(s);
-	sqlite3_stmt* statement;
+int SQLiteConnection::prepareCached(const char* sql,
+                                    sqlite3_stmt*& statement) {
+	if (!handle) return SQLITE_MISUSE;
 
-	{
-		int res = SQLITE_ERROR;
-		if (handle) {
-			res = sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr);
-		}
+	auto search = cachedBySQL.find(sql);
+	if (search != cachedBySQL.end()) {
+		cachedStatements.splice(cachedStatements.begin(), cachedStatements,
+		                        search->second);
+		statement = search->second->second;
+		return SQLITE_OK;
+	}
 
-		if (res != SQLITE_OK) {
-			return std::make_tuple(
-			    sol::make_object(lua, sol::nil),
-			    sol::make_object(
-			        lua, handle ? sqlite3_errmsg(handle) : sqlite3_errstr(res)));
-		}
+	int res = sqlite3_prepare_v2(handle, sql, -1, &statement, nullptr);
+	// Nothing to cache for empty SQL
+	if (res != SQLITE_OK || !statement) return res;
+
+	if (cachedStatements.size() >= sqliteStatementCacheSize) {
+		auto& [oldSQL, oldStatement] = cachedStatements.back();
+		sqlite3_finalize(oldStatement);
+		cachedBySQL.erase(oldSQL);
+		cachedStatements.pop_back();
 	}
 
-	int index = 0;
+	cachedStatements.emplace_front(sql, statement);
+	cachedBySQL.emplace(cachedStatements.front().first,
+	                    cachedStatements.begin());
+	return SQLITE_OK;
+}
 
-	for (sol::object arg : arguments) {
-		index++;
-
-		int res;
-		switch (arg.get_type()) {
-			case sol::type::nil:
-				res = sqlite3_bind_null(statement, index);
-				break;
-			case sol::type::string: {
-				auto string = arg.as<std::string>();
-				res = sqlite3_bind_text(statement, index, string.data(),
-				                        string.length(), SQLITE_TRANSIENT);
-			} break;
-			case sol::type::number:
-				res = sqlite3_bind_double(statement, index, arg.as<double>());
-				break;
-			case sol::type::boolean:
-				res = sqlite3_bind_int(statement, index, arg.as<bool>() ? 1 : 0);
-				break;
-			default:
-				res = SQLITE_OK;
-				break;
+// Lua only has doubles, but anything integral binds as an integer so keys and
+// large counts don't go through floating point.
+static SQLiteValue toValue(const sol::object& object) {
+	static constexpr double int64Limit = 0x1p63;
+
+	switch (object.get_type()) {
+		case sol::type::string:
+			return object.as<std::string>();
+		case sol::type::number: {
+			const double number = object.as<double>();
+			if (std::trunc(number) == number && number >= -int64Limit &&
+			    number < int64Limit) {
+				return static_cast<int64_t>(number);
+			}
+			return number;
 		}
+		case sol::type::boolean:
+			return static_cast<int64_t>(object.as<bool>() ? 1 : 0);
+		default:
+			return std::monostate();
+	}
+}
+
+static int bindValue(sqlite3_stmt* statement, int index,
+                     const SQLiteValue& value) {
+	if (auto integer = std::get_if<int64_t>(&value)) {
+		return sqlite3_bind_int64(statement, index, *integer);
+	}
+	if (auto number = std::get_if<double>(&value)) {
+		return sqlite3_bind_double(statement, index, *number);
+	}
+	if (auto string = std::get_if<std::string>(&value)) {
+		return sqlite3_bind_text(statement, index, string->data(),
+		                         string->length(), SQLITE_TRANSIENT);
+	}
+	return sqlite3_bind_null(statement, index);
+}
 
-		if (res != SQLITE_OK) {
-			sqlite3_finalize(statement);
-			return std::make_tuple(sol::make_object(lua, sol::nil),
-			                       sol::make_object(lua, sqlite3_errmsg(handle)));
+static SQLiteValue readColumn(sqlite3_stmt* statement, int column) {
+	switch (sqlite3_column_type(statement, column)) {
+		case SQLITE_INTEGER:
+			return static_cast<int64_t>(sqlite3_column_int64(statement, column));
+		case SQLITE_FLOAT:
+			return sqlite3_column_double(statement, column);
+		case SQLITE_BLOB:
+		case SQLITE_TEXT: {
+			auto data = sqlite3_column_blob(statement, column);
+			if (!data) return std::string();
+			auto size = sqlite3_column_bytes(statement, column);
+			return std::string(reinterpret_cast<const char*>(data), size);
 		}
+		default:
+			return std::monostate();
 	}
+}
 
-	sol::table rows;
-	int numColumns = sqlite3_column_count(statement);
-	if (numColumns) {
-		rows = lua.create_table();
+static sol::object toObject(sol::state_view lua, SQLiteValue&& value) {
+	if (auto integer = std::get_if<int64_t>(&value)) {
+		return sol::make_object(lua, *integer);
+	}
+	if (auto number = std::get_if<double>(&value)) {
+		return sol::make_object(lua, *number);
 	}
+	if (auto string = std::get_if<std::string>(&value)) {
+		return sol::make_object(lua, std::move(*string));
+	}
+	return sol::make_object(lua, sol::nil);
+}
 
-	while (true) {
+// Binds, steps and resets the statement, leaving it ready to run again, and
+// calls `onRow` for every row. Returns the error if it failed. Used by both
+// synchronous and asynchronous queries.
+template <typename OnRow>
+static std::optional<std::string> runStatement(
+    sqlite3* handle, sqlite3_stmt* statement,
+    const std::vector<SQLiteValue>& arguments, OnRow&& onRow) {
+	// Empty or only comments
+	if (!statement) return "No statement";
+
+	std::optional<std::string> error;
+
+	for (size_t i = 0; i < arguments.size(); i++) {
+		if (bindValue(statement, i + 1, arguments[i]) != SQLITE_OK) {
+			error = sqlite3_errmsg(handle);
+			break;
+		}
+	}
+
+	while (!error) {
 		int res = sqlite3_step(statement);
 		if (res == SQLITE_DONE) {
 			break;
 		}
 
 		if (res != SQLITE_ROW) {
-			sqlite3_finalize(statement);
-			return std::make_tuple(sol::make_object(lua, sol::nil),
-			                       sol::make_object(lua, sqlite3_errmsg(handle)));
+			error = sqlite3_errmsg(handle);
+			break;
 		}
 
+		onRow();
+	}
+
+	// Also ends any read transaction the statement was holding open
+	sqlite3_reset(statement);
+	sqlite3_clear_bindings(statement);
+
+	return error;
+}
+
+static std::tuple<sol::object, sol::object> runQuery(
+    sol::state_view lua, sqlite3* handle, sqlite3_stmt* statement,
+    sol::variadic_args& arguments) {
+	std::vector<SQLiteValue> values;
+	values.reserve(arguments.size());
+	for (sol::object arg : arguments) {
+		values.push_back(toValue(arg));
+	}
+
+	const int numColumns = statement ? sqlite3_column_count(statement) : 0;
+	sol::table rows;
+	if (numColumns) {
+		rows = lua.create_table();
+	}
+
+	auto error = runStatement(handle, statement, values, [&]() {
 		sol::table row = lua.create_table(numColumns);
 		for (int i = 0; i < numColumns; i++) {
-			switch (sqlite3_column_type(statement, i)) {
-				case SQLITE_INTEGER:
-					row.set(i + 1, sqlite3_column_int64(statement, i));
-					break;
-				case SQLITE_FLOAT:
-					row.set(i + 1, sqlite3_column_double(statement, i));
-					break;
-				case SQLITE_BLOB:
-				case SQLITE_TEXT: {
-					auto data = sqlite3_column_blob(statement, i);
-					if (data) {
-						auto size = sqlite3_column_bytes(statement, i);
-						std::string blob(reinterpret_cast<const char*>(data), size);
-						row.set(i + 1, blob);
-					} else {
-						row.set(i + 1, "");
-					}
-					break;
-				}
-				default:
-					row.set(i + 1, sol::nil);
-					break;
-			}
+			row[i + 1] = toObject(lua, readColumn(statement, i));
 		}
 		rows.add(row);
-	}
+	});
 
-	sqlite3_finalize(statement);
+	if (error) {
+		return std::make_tuple(sol::make_object(lua, sol::nil),
+		                       sol::make_object(lua, *error));
+	}
 
 	if (numColumns) {
 		return std::make_tuple(sol::make_object(lua, rows),
@@ -127,3 +227,272 @@ std::tuple<sol::object, sol::object> SQLite::query(const char* sql,
 	return std::make_tuple(sol::make_object(lua, sqlite3_changes(handle)),
 	                       sol::make_object(lua, sol::nil));
 }
+
+SQLite::SQLite(const char* fileName)
+    : fileName(fileName),
+      connection(std::make_shared<SQLiteConnection>(fileName)) {}
+
+// Usually from garbage collection, e.g. on a Lua reset, where throwing like
+// close() isn't an option. Queued writes would each wait out the worker's busy
+// timeout on the lock our open transaction holds, so the transaction is rolled
+// back first, which is what closing without committing would do anyway.
+SQLite::~SQLite() {
+	if (worker && connection->handle &&
+	    !sqlite3_get_autocommit(connection->handle)) {
+		sqlite3_exec(connection->handle, "ROLLBACK;", nullptr, nullptr, nullptr);
+	}
+}
+
+void SQLite::close() {
+	checkCanWait();
+	// Lets anything still queued finish first
+	worker.reset();
+	connection->close();
+}
+
+std::tuple<sol::object, sol::object> SQLite::query(const char* sql,
+                                                   sol::variadic_args arguments,
+                                                   sol::this_state s) {
+	sol::state_view lua(s);
+	sqlite3* handle = connection->handle;
+	sqlite3_stmt* statement;
+
+	if (connection->prepareCached(sql, statement) != SQLITE_OK) {
+		return getError(lua, handle);
+	}
+
+	return runQuery(lua, handle, statement, arguments);
+}
+
+std::tuple<sol::object, sol::object> SQLite::prepare(const char* sql,
+                                                     sol::this_state s) {
+	sol::state_view lua(s);
+	sqlite3* handle = connection->handle;
+	sqlite3_stmt* statement;
+
+	if (!handle || sqlite3_prepare_v3(handle, sql, -1, SQLITE_PREPARE_PERSISTENT,
+	                                  &statement, nullptr) != SQLITE_OK) {
+		return getError(lua, handle);
+	}
+
+	if (!statement) {
+		return std::make_tuple(sol::make_object(lua, sol::nil),
+		                       sol::make_object(lua, "No statement"));
+	}
+
+	return std::make_tuple(
+	    sol::make_object(lua, std::make_unique<SQLiteStatement>(connection,
+	                                                            statement)),
+	    sol::make_object(lua, sol::nil));
+}
+
+SQLiteStatement::~SQLiteStatement() { close(); }
+
+void SQLiteStatement::close() {
+	if (statement) {
+		sqlite3_finalize(statement);
+		statement = nullptr;
+	}
+}
+
+std::tuple<sol::object, sol::object> SQLiteStatement::query(
+    sol::variadic_args arguments, sol::this_state s) {
+	sol::state_view lua(s);
+
+	if (!statement || !connection->handle) return getError(lua, nullptr);
+
+	return runQuery(lua, connection->handle, statement, arguments);
+}
+
+const char* SQLiteStatement::getSQL() const {
+	return statement ? sqlite3_sql(statement) : "";
+}
+
+// Same as runQuery, but into native values on the worker thread.
+static SQLiteResult runJob(SQLiteConnection& connection, SQLiteJob& job) {
+	SQLiteResult result;
+	result.id = job.id;
+	sqlite3* handle = connection.handle;
+
+	sqlite3_stmt* statement;
+	if (connection.prepareCached(job.sql.c_str(), statement) != SQLITE_OK) {
+		result.failed = true;
+		result.error = sqlite3_errmsg(handle);
+		return result;
+	}
+
+	result.numColumns = statement ? sqlite3_column_count(statement) : 0;
+
+	auto error = runStatement(handle, statement, job.arguments, [&]() {
+		auto& row = result.rows.emplace_back();
+		row.reserve(result.numColumns);
+		for (int i = 0; i < result.numColumns; i++) {
+			row.push_back(readColumn(statement, i));
+		}
+	});
+
+	if (error) {
+		result.failed = true;
+		result.error = std::move(*error);
+		result.rows.clear();
+		return result;
+	}
+
+	result.numChanges = sqlite3_changes(handle);
+	return result;
+}
+
+SQLiteWorker::SQLiteWorker(const char* fileName) : connection(fileName) {
+	// The game's own connection may be holding the write lock
+	sqlite3_busy_timeout(connection.handle, sqliteWorkerBusyTimeoutMs);
+	// Readers and the writer don't block each other. This stays set in the file,
+	// and if it fails the database still works with rollback journals.
+	sqlite3_exec(connection.handle, "PRAGMA journal_mode=WAL;", nullptr, nullptr,
+	             nullptr);
+	thread = std::thread(&SQLiteWorker::run, this);
+}
+
+SQLiteWorker::~SQLiteWorker() {
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		stopping = true;
+	}
+	wake.notify_one();
+	thread.join();
+}
+
+void SQLiteWorker::run() {
+	while (true) {
+		SQLiteJob job;
+		{
+			std::unique_lock<std::mutex> lock(mutex);
+			wake.wait(lock, [this] { return stopping || !jobs.empty(); });
+			if (jobs.empty()) return;
+
+			job = std::move(jobs.front());
+			jobs.pop_front();
+			isRunningJob = true;
+		}
+
+		SQLiteResult result = runJob(connection, job);
+		if (job.hasCallback) sqliteResults.push(std::move(result));
+
+		{
+			std::lock_guard<std::mutex> guard(mutex);
+			isRunningJob = false;
+			if (jobs.empty()) idle.notify_all();
+		}
+	}
+}
+
+void SQLiteWorker::push(SQLiteJob job) {
+	{
+		std::lock_guard<std::mutex> guard(mutex);
+		jobs.push_back(std::move(job));
+	}
+	wake.notify_one();
+}
+
+void SQLiteWorker::flush() {
+	std::unique_lock<std::mutex> lock(mutex);
+	idle.wait(lock, [this] { return jobs.empty() && !isRunningJob; });
+}
+
+bool SQLiteWorker::hasJobs() {
+	std::lock_guard<std::mutex> guard(mutex);
+	return !jobs.empty() || isRunningJob;
+}
+
+// The last argument is the callback, if it's a function. Everything else is
+// copied into native values here, so nothing from Lua reaches the worker.
+void SQLite::queryAsync(const char* sql, sol::variadic_args arguments) {
+	if (!connection->handle) throw std::runtime_error(errorClosed);
+
+	if (!worker) {
+		// A second connection to these would be a different database
+		if (fileName.empty() || fileName == ":memory:") {
+			throw std::invalid_argument(
+			    "In-memory databases can't be queried asynchronously");
+		}
+		worker = std::make_unique<SQLiteWorker>(fileName.c_str());
+		// Writes on the worker's connection now briefly hold the write lock
+		sqlite3_busy_timeout(connection->handle, sqliteBusyTimeoutMs);
+	}
+
+	SQLiteJob job{sqliteNextJobID++, false, sql, {}};
+
+	int numArguments = arguments.size();
+	sol::protected_function callback;
+	if (numArguments > 0) {
+		sol::object last = arguments[numArguments - 1];
+		if (last.get_type() == sol::type::function) {
+			callback = last.as<sol::protected_function>();
+			job.hasCallback = true;
+			numArguments--;
+		}
+	}
+
+	job.arguments.reserve(numArguments);
+	for (int i = 0; i < numArguments; i++) {
+		job.arguments.push_back(toValue(arguments[i]));
+	}
+
+	if (job.hasCallback) sqliteCallbacks.emplace(job.id, std::move(callback));
+	worker->push(std::move(job));
+}
+
+// Blocks until every queryAsync so far has run. Their callbacks still wait for
+// the next logic tick.
+void SQLite::flush() {
+	checkCanWait();
+	if (worker) worker->flush();
+}
+
+void SQLite::checkCanWait() {
+	if (!worker || !connection->handle) return;
+
+	// Each queued write would wait out the worker's whole busy timeout
+	if (!sqlite3_get_autocommit(connection->handle) && worker->hasJobs()) {
+		throw std::runtime_error(
+		    "Can't wait for async queries during a transaction");
+	}
+}
+
+// Called at the start of every logic tick on the main thread.
+void SQLite::processResults() {
+	SQLiteResult result;
+	while (sqliteResults.pop(result)) {
+		auto search = sqliteCallbacks.find(result.id);
+		if (search == sqliteCallbacks.end()) {
+			// Queued by a Lua state that has since been reset
+			continue;
+		}
+
+		auto callback = std::move(search->second);
+		sqliteCallbacks.erase(search);
+
+		sol::state_view state(*lua);
+		sol::protected_function_result res;
+
+		if (result.failed) {
+			res = callback(sol::nil, result.error);
+		} else if (result.numColumns) {
+			sol::table rows = state.create_table(result.rows.size());
+			for (size_t i = 0; i < result.rows.size(); i++) {
+				auto& values = result.rows[i];
+				sol::table row = state.create_table(values.size());
+				for (size_t j = 0; j < values.size(); j++) {
+					row[j + 1] = toObject(state, std::move(values[j]));
+				}
+				rows[i + 1] = row;
+			}
+			res = callback(rows);
+		} else {
+			res = callback(result.numChanges);
+		}
+
+		noLuaCallError(&res);
+	}
+}
+
+void SQLite::clearCallbacks() { sqliteCallbacks.clear(); }
@@ -1,17 +1,122 @@
 #pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
 #include <tuple>
+#include <unordered_map>
+#include <variant>
+#include <vector>
 
 #include "sol/sol.hpp"
 #include "sqlite3.h"
 
+static constexpr size_t sqliteStatementCacheSize = 64;
+static constexpr int sqliteWorkerBusyTimeoutMs = 5000;
+// Only writes wait on the worker in WAL mode, so the game doesn't wait long
+static constexpr int sqliteBusyTimeoutMs = 100;
+
+// A bound argument or column value, copied out of Lua so it can cross threads
+using SQLiteValue = std::variant<std::monostate, int64_t, double, std::string>;
+
+// An open database, shared with any statements prepared on it so it can't be
+// freed out from under them.
+class SQLiteConnection {
+	// Most recently used first
+	std::list<std::pair<std::string, sqlite3_stmt*>> cachedStatements;
+	std::unordered_map<std::string_view, decltype(cachedStatements)::iterator>
+	    cachedBySQL;
+
+ public:
+	sqlite3* handle = nullptr;
+
+	SQLiteConnection(const char* fileName);
+	~SQLiteConnection();
+	void close();
+	// The statement stays owned by the cache, and is reset when done with
+	int prepareCached(const char* sql, sqlite3_stmt*& statement);
+};
+
+struct SQLiteJob {
+	unsigned int id;
+	bool hasCallback;
+	std::string sql;
+	std::vector<SQLiteValue> arguments;
+};
+
+// Runs queries in order on its own thread and its own connection to the same
+// database, so a slow write never holds up the game. Starting one puts the
+// database in WAL mode, so reads on the game's connection don't wait for it.
+class SQLiteWorker {
+	SQLiteConnection connection;
+	std::thread thread;
+
+	std::mutex mutex;
+	std::condition_variable wake;
+	std::condition_variable idle;
+	std::deque<SQLiteJob> jobs;
+	bool isRunningJob = false;
+	bool stopping = false;
+
+	void run();
+
+ public:
+	SQLiteWorker(const char* fileName);
+	// Finishes every queued job first
+	~SQLiteWorker();
+	void push(SQLiteJob job);
+	void flush();
+	bool hasJobs();
+};
+
 class SQLite {
-	sqlite3* handle;
+	std::string fileName;
+	std::shared_ptr<SQLiteConnection> connection;
+	// Started on the first queryAsync
+	std::unique_ptr<SQLiteWorker> worker;
+
+	// Throws instead of waiting on queued queries that can't get a lock held by
+	// this connection's own open transaction.
+	void checkCanWait();
 
  public:
 	SQLite(const char* fileName);
+	// Rolls back any open transaction before finishing queued queries
 	~SQLite();
 	void close();
 	std::tuple<sol::object, sol::object> query(const char* sql,
 	                                           sol::variadic_args arguments,
 	                                           sol::this_state s);
+	std::tuple<sol::object, sol::object> prepare(const char* sql,
+	                                             sol::this_state s);
+	void queryAsync(const char* sql, sol::variadic_args arguments);
+	void flush();
+
+	// Runs queryAsync callbacks on the main thread
+	static void processResults();
+	static void clearCallbacks();
+};
+
+// A statement prepared once and run as many times as needed.
+class SQLiteStatement {
+	std::shared_ptr<SQLiteConnection> connection;
+	sqlite3_stmt* statement;
+
+ public:
+	SQLiteStatement(std::shared_ptr<SQLiteConnection> connection,
+	                sqlite3_stmt* statement)
+	    : connection(std::move(connection)), statement(statement) {}
+	~SQLiteStatement();
+	SQLiteStatement(const SQLiteStatement&) = delete;
+	SQLiteStatement& operator=(const SQLiteStatement&) = delete;
+
+	void close();
+	std::tuple<sol::object, sol::object> query(sol::variadic_args arguments,
+	                                           sol::this_state s);
+	const char* getSQL() const;
 };
@@ -135,6 +135,10 @@ struct Connection {
 	Human* getSpectatingHuman() const;
 	Vector getCameraPosition() const { return cameraPosition; }
 	bool hasReceivedEvent(Event* event) const;
+	uint64_t getBytesSent() const;
+	uint64_t getPacketsSent() const;
+	double getBytesPerSecond() const;
+	sol::table getPacketTypeCounts() const;
 };
 
 // 112 bytes (70)
@@ -3,22 +3,129 @@
 #include <arpa/inet.h>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <poll.h>
 #include <sys/fcntl.h>
 #include <sys/socket.h>
 #include <sys/unistd.h>
 #include <unistd.h>
 
 #include <cstring>
+#include <mutex>
 #include <stdexcept>
+#include <unordered_map>
+
+#include "threadpool.h"
 
 static constexpr const char* errorNotOpen = "Socket is not open";
+static constexpr const char* errorFailedToConnect = "Failed to connect!";
+static constexpr unsigned int numResolverThreads = 2;
 
 static inline void throwSafe() {
 	char error[256];
 	throw std::runtime_error(strerror_r(errno, error, sizeof(error)));
 }
 
-ssize_t TCPClient::send(std::string_view data) const {
+struct CachedResolution {
+	std::vector<ResolvedAddress> addresses;
+	std::chrono::steady_clock::time_point expiresAt;
+};
+
+// getaddrinfo doesn't tell us the record's TTL, so cached results live for a
+// fixed amount of time.
+static std::atomic_uint dnsCacheTTLSeconds = 60;
+static std::mutex dnsCacheMutex;
+static std::unordered_map<std::string, CachedResolution> dnsCache;
+
+static ThreadPool& getResolverPool() {
+	// Intentionally leaked: a resolver stuck in getaddrinfo must not hold up
+	// process exit by being joined in a static destructor.
+	static ThreadPool* pool = new ThreadPool(numResolverThreads);
+	return *pool;
+}
+
+static inline std::string getCacheKey(std::string_view address,
+                                      std::string_view port) {
+	std::string key(address);
+	key += ':';
+	key += port;
+	return key;
+}
+
+static bool lookupDNSCache(const std::string& key,
+                           std::vector<ResolvedAddress>& out) {
+	std::lock_guard<std::mutex> guard(dnsCacheMutex);
+
+	auto search = dnsCache.find(key);
+	if (search == dnsCache.end()) {
+		return false;
+	}
+
+	if (search->second.expiresAt < std::chrono::steady_clock::now()) {
+		dnsCache.erase(search);
+		return false;
+	}
+
+	out = search->second.addresses;
+	return true;
+}
+
+static void storeDNSCache(const std::string& key,
+                          const std::vector<ResolvedAddress>& addresses) {
+	auto ttl = std::chrono::seconds(dnsCacheTTLSeconds.load());
+	if (ttl.count() == 0) return;
+
+	std::lock_guard<std::mutex> guard(dnsCacheMutex);
+	dnsCache[key] = {addresses, std::chrono::steady_clock::now() + ttl};
+}
+
+static bool resolve(const std::string& address, const std::string& port,
+                    std::vector<ResolvedAddress>& out, std::string& error) {
+	addrinfo hintInfo{};
+	hintInfo.ai_family = AF_UNSPEC;
+	hintInfo.ai_socktype = SOCK_STREAM;
+	hintInfo.ai_flags = 0;
+	hintInfo.ai_protocol = 0;
+
+	addrinfo* resultAddress;
+	auto resultErr =
+	    getaddrinfo(address.c_str(), port.c_str(), &hintInfo, &resultAddress);
+	if (resultErr != 0) {
+		error = gai_strerror(resultErr);
+		return false;
+	}
+
+	for (addrinfo* addrIter = resultAddress; addrIter != nullptr;
+	     addrIter = addrIter->ai_next) {
+		ResolvedAddress resolved{};
+		resolved.family =
+		    addrIter->ai_family == AF_UNSPEC ? AF_INET : addrIter->ai_family;
+		resolved.addressLength = addrIter->ai_addrlen;
+		std::memcpy(&resolved.address, addrIter->ai_addr, addrIter->ai_addrlen);
+		out.push_back(resolved);
+	}
+
+	freeaddrinfo(resultAddress);
+
+	if (out.empty()) {
+		error = errorFailedToConnect;
+		return false;
+	}
+
+	return true;
+}
+
+ssize_t TCPClient::send(std::string_view data) {
+	if (state == State::resolving || state == State::connecting) {
+		update();
+		if (state != State::connected && state != State::failed) {
+			return 0;
+		}
+	}
+
+	if (state == State::failed) {
+		throw std::runtime_error(error);
+	}
+
 	if (socketDescriptor == -1) {
 		throw std::runtime_error(errorNotOpen);
 	}
@@ -39,12 +146,23 @@ ssize_t TCPClient::send(std::string_view data) const {
 }
 
 sol::object TCPClient::receive(size_t size, sol::this_state s) {
+	sol::state_view lua(s);
+
+	if (state == State::resolving || state == State::connecting) {
+		update();
+		if (state != State::connected && state != State::failed) {
+			return sol::make_object(lua, sol::nil);
+		}
+	}
+
+	if (state == State::failed) {
+		throw std::runtime_error(error);
+	}
+
 	if (socketDescriptor == -1) {
 		throw std::runtime_error(errorNotOpen);
 	}
 
-	sol::state_view lua(s);
-
 	constexpr auto maxToRecv = sizeof(receiveBuffer);
 	auto bytesRead =
 	    read(socketDescriptor, receiveBuffer, std::min(size, maxToRecv));
@@ -64,52 +182,213 @@ sol::object TCPClient::receive(size_t size, sol::this_state s) {
 }
 
 TCPClient::TCPClient(std::string_view address, std::string_view port) {
-	addrinfo hintInfo{};
-	hintInfo.ai_family = AF_UNSPEC;
-	hintInfo.ai_socktype = SOCK_STREAM;
-	hintInfo.ai_flags = 0;
-	hintInfo.ai_protocol = 0;
+	auto key = getCacheKey(address, port);
 
-	addrinfo* resultAddress;
-	auto resultErr =
-	    getaddrinfo(address.data(), port.data(), &hintInfo, &resultAddress);
-	if (resultErr != 0) {
-		throw std::runtime_error(gai_strerror(resultErr));
+	std::vector<ResolvedAddress> resolved;
+	if (!lookupDNSCache(key, resolved)) {
+		std::string resolveError;
+		if (!resolve(std::string(address), std::string(port), resolved,
+		             resolveError)) {
+			throw std::runtime_error(resolveError);
+		}
+		storeDNSCache(key, resolved);
 	}
 
-	addrinfo* addrIter;
-	for (addrIter = resultAddress; addrIter != nullptr;
-	     addrIter = resultAddress->ai_next) {
-		auto family = addrIter->ai_family;
-		if (family == AF_UNSPEC) {
-			family = AF_INET;
+	deadline = std::chrono::steady_clock::now() +
+	           std::chrono::milliseconds(defaultConnectTimeoutMs);
+	startConnecting(std::move(resolved));
+
+	if (state == State::failed) throw std::runtime_error(error);
+}
+
+// Resolution happens on a resolver thread and the connect is non-blocking, so
+// this never stalls the calling hook. Progress is made whenever the state is
+// checked or the socket is used.
+std::shared_ptr<TCPClient> TCPClient::connectAsync(
+    std::string_view address, std::string_view port,
+    sol::optional<unsigned int> timeoutMs) {
+	auto client = std::make_shared<TCPClient>();
+	client->deadline =
+	    std::chrono::steady_clock::now() +
+	    std::chrono::milliseconds(timeoutMs.value_or(defaultConnectTimeoutMs));
+
+	auto key = getCacheKey(address, port);
+
+	std::vector<ResolvedAddress> cached;
+	if (lookupDNSCache(key, cached)) {
+		client->startConnecting(std::move(cached));
+		return client;
+	}
+
+	client->state = State::resolving;
+	client->resolution = std::make_shared<PendingResolution>();
+
+	getResolverPool().push([resolution = client->resolution,
+	                        address = std::string(address),
+	                        port = std::string(port), key]() {
+		std::vector<ResolvedAddress> resolved;
+		if (resolve(address, port, resolved, resolution->error)) {
+			storeDNSCache(key, resolved);
+			resolution->addresses = std::move(resolved);
 		}
+		resolution->done.store(true, std::memory_order_release);
+	});
+
+	return client;
+}
+
+void TCPClient::setDNSCacheTTL(unsigned int seconds) {
+	dnsCacheTTLSeconds = seconds;
+	if (seconds == 0) clearDNSCache();
+}
+
+void TCPClient::clearDNSCache() {
+	std::lock_guard<std::mutex> guard(dnsCacheMutex);
+	dnsCache.clear();
+}
+
+void TCPClient::startConnecting(std::vector<ResolvedAddress> resolved) {
+	addresses = std::move(resolved);
+	addressIndex = 0;
+	state = State::connecting;
+	tryNextAddress();
+}
+
+void TCPClient::tryNextAddress() {
+	while (addressIndex < addresses.size()) {
+		const auto& candidate = addresses[addressIndex++];
 
-		socketDescriptor = socket(family, SOCK_STREAM | SOCK_NONBLOCK, 0);
+		socketDescriptor =
+		    socket(candidate.family, SOCK_STREAM | SOCK_NONBLOCK, 0);
 		if (socketDescriptor == -1) continue;
 
-		if (connect(socketDescriptor, addrIter->ai_addr, addrIter->ai_addrlen) == 0)
-			break;
-		if (errno == EINPROGRESS) break;
+		if (connect(socketDescriptor,
+		            reinterpret_cast<const sockaddr*>(&candidate.address),
+		            candidate.addressLength) == 0) {
+			state = State::connected;
+			return;
+		}
+
+		if (errno == EINPROGRESS) {
+			state = State::connecting;
+			return;
+		}
 
 		::close(socketDescriptor);
+		socketDescriptor = -1;
 	}
 
-	if (addrIter == nullptr) throw std::runtime_error("Failed to connect!");
-	freeaddrinfo(resultAddress);
+	fail(errorFailedToConnect);
+}
+
+void TCPClient::fail(std::string_view message) {
+	if (socketDescriptor != -1) {
+		::close(socketDescriptor);
+		socketDescriptor = -1;
+	}
+
+	resolution.reset();
+	state = State::failed;
+	error = message;
+}
+
+void TCPClient::update() {
+	auto now = std::chrono::steady_clock::now();
+
+	if (state == State::resolving) {
+		if (!resolution->done.load(std::memory_order_acquire)) {
+			if (now > deadline) fail("Timed out resolving address");
+			return;
+		}
+
+		auto finished = std::move(resolution);
+		if (finished->addresses.empty()) {
+			fail(finished->error);
+			return;
+		}
+
+		startConnecting(std::move(finished->addresses));
+	}
+
+	while (state == State::connecting) {
+		pollfd descriptor{socketDescriptor, POLLOUT, 0};
+
+		int numReady = ::poll(&descriptor, 1, 0);
+		if (numReady == -1) {
+			if (errno == EINTR) continue;
+			throwSafe();
+		}
+
+		if (numReady == 0) {
+			if (now > deadline) fail("Connection timed out");
+			return;
+		}
+
+		int socketError = 0;
+		socklen_t socketErrorLength = sizeof(socketError);
+		if (getsockopt(socketDescriptor, SOL_SOCKET, SO_ERROR, &socketError,
+		               &socketErrorLength) == -1) {
+			throwSafe();
+		}
+
+		if (socketError == 0) {
+			state = State::connected;
+			return;
+		}
+
+		::close(socketDescriptor);
+		socketDescriptor = -1;
+		tryNextAddress();
+	}
+}
+
+const char* TCPClient::poll() {
+	update();
+
+	switch (state) {
+		case State::resolving:
+			return "resolving";
+		case State::connecting:
+			return "connecting";
+		case State::connected:
+			return "connected";
+		case State::failed:
+			return "failed";
+		default:
+			return "closed";
+	}
+}
+
+const char* TCPClient::getState() { return poll(); }
+
+sol::object TCPClient::getError(sol::this_state s) const {
+	sol::state_view lua(s);
+
+	if (state != State::failed) {
+		return sol::make_object(lua, sol::nil);
+	}
+
+	return sol::make_object(lua, error);
 }
 
 void TCPClient::close() {
+	if (state == State::resolving) {
+		resolution.reset();
+		state = State::closed;
+		return;
+	}
+
 	if (socketDescriptor == -1) {
 		throw std::runtime_error(errorNotOpen);
 	}
 
 	::close(socketDescriptor);
 	socketDescriptor = -1;
+	state = State::closed;
 }
 
 TCPClient::~TCPClient() {
 	if (socketDescriptor != -1) {
-		close();
+		::close(socketDescriptor);
 	}
 }
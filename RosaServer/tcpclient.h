@@ -1,5 +1,9 @@
 #pragma once
 
+#include <sys/socket.h>
+
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <string>
 #include <vector>
@@ -7,18 +11,58 @@
 #include "sol/sol.hpp"
 
 static constexpr size_t maxClientReadSize = 16384;
+static constexpr unsigned int defaultConnectTimeoutMs = 10000;
+
+struct ResolvedAddress {
+	int family;
+	sockaddr_storage address;
+	socklen_t addressLength;
+};
+
+// Filled in by a resolver thread; `done` is set last.
+struct PendingResolution {
+	std::atomic_bool done = false;
+	std::vector<ResolvedAddress> addresses;
+	std::string error;
+};
 
 class TCPClient {
-	int socketDescriptor;
+	enum class State { resolving, connecting, connected, failed, closed };
+
+	int socketDescriptor = -1;
+	State state = State::closed;
+	std::string error;
+
+	std::shared_ptr<PendingResolution> resolution;
+	std::vector<ResolvedAddress> addresses;
+	size_t addressIndex = 0;
+	std::chrono::steady_clock::time_point deadline;
+
 	char receiveBuffer[maxClientReadSize];
 
+	void startConnecting(std::vector<ResolvedAddress> resolved);
+	void tryNextAddress();
+	void fail(std::string_view message);
+	void update();
+
  public:
+	TCPClient() = default;
 	TCPClient(std::string_view address, std::string_view port);
 	~TCPClient();
 
+	static std::shared_ptr<TCPClient> connectAsync(
+	    std::string_view address, std::string_view port,
+	    sol::optional<unsigned int> timeoutMs);
+	static void setDNSCacheTTL(unsigned int seconds);
+	static void clearDNSCache();
+
 	void close();
 	bool isOpen() const { return socketDescriptor != -1; }
+	int getFileDescriptor() const { return socketDescriptor; }
+	const char* poll();
+	const char* getState();
+	sol::object getError(sol::this_state s) const;
 
-	ssize_t send(std::string_view data) const;
+	ssize_t send(std::string_view data);
 	sol::object receive(size_t size, sol::this_state state);
 };
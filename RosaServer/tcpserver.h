@@ -46,4 +46,5 @@ class TCPServer {
 	sol::object accept(sol::this_state s);
 
 	bool isOpen() const { return socketDescriptor != -1; }
+	int getFileDescriptor() const { return socketDescriptor; }
 };
@@ -0,0 +1,52 @@
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(unsigned int numThreads) {
+	threads.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		threads.emplace_back(&ThreadPool::runThread, this);
+	}
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(taskQueueMutex);
+		stopping = true;
+	}
+	taskCondition.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+void ThreadPool::runThread() {
+	while (true) {
+		std::function<void()> task;
+
+		{
+			std::unique_lock<std::mutex> lock(taskQueueMutex);
+			taskCondition.wait(lock,
+			                   [this] { return stopping || !taskQueue.empty(); });
+
+			if (stopping && taskQueue.empty()) return;
+
+			task = std::move(taskQueue.front());
+			taskQueue.pop();
+		}
+
+		task();
+	}
+}
+
+void ThreadPool::push(std::function<void()> task) {
+	{
+		std::lock_guard<std::mutex> guard(taskQueueMutex);
+		taskQueue.push(std::move(task));
+	}
+	taskCondition.notify_one();
+}
+
+size_t ThreadPool::getNumQueued() {
+	std::lock_guard<std::mutex> guard(taskQueueMutex);
+	return taskQueue.size();
+}
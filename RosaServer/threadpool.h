@@ -0,0 +1,27 @@
+#pragma once
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+// A fixed number of threads pulling tasks off a shared FIFO. Tasks must not
+// touch any Lua state; hand results back to the main thread instead.
+class ThreadPool {
+	std::vector<std::thread> threads;
+
+	std::queue<std::function<void()>> taskQueue;
+	std::mutex taskQueueMutex;
+	std::condition_variable taskCondition;
+	bool stopping = false;
+
+	void runThread();
+
+ public:
+	ThreadPool(unsigned int numThreads);
+	~ThreadPool();
+	void push(std::function<void()> task);
+	size_t getNumQueued();
+	unsigned int getNumThreads() const { return threads.size(); }
+};
@@ -0,0 +1,291 @@
+#include "udpsocket.h"
+
+#include <arpa/inet.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+static constexpr const char* errorNotOpen = "Socket is not open";
+static constexpr const char* errorInvalidAddress = "Invalid IPv4 address";
+
+static inline void throwSafe() {
+	char error[256];
+	throw std::runtime_error(strerror_r(errno, error, sizeof(error)));
+}
+
+static inline void fillAddress(sockaddr_in& out, std::string_view address,
+                               unsigned short port) {
+	// inet_pton needs a terminated string
+	char addressString[INET_ADDRSTRLEN];
+	if (address.size() >= sizeof(addressString)) {
+		throw std::invalid_argument(errorInvalidAddress);
+	}
+	std::memcpy(addressString, address.data(), address.size());
+	addressString[address.size()] = '\0';
+
+	out = {};
+	out.sin_family = AF_INET;
+	out.sin_port = htons(port);
+	if (inet_pton(AF_INET, addressString, &out.sin_addr) != 1) {
+		throw std::invalid_argument(errorInvalidAddress);
+	}
+}
+
+UDPSocket::UDPSocket() : UDPSocket(0) {}
+
+UDPSocket::UDPSocket(unsigned short port)
+    : receiveBuffer(maxDatagramBatchSize * maxDatagramReadSize) {
+	socketDescriptor = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+	if (socketDescriptor == -1) {
+		throwSafe();
+	}
+
+	{
+		int reuseAddress = 1;
+		if (setsockopt(socketDescriptor, SOL_SOCKET, SO_REUSEADDR, &reuseAddress,
+		               sizeof(reuseAddress)) == -1) {
+			::close(socketDescriptor);
+			throwSafe();
+		}
+	}
+
+	sockaddr_in bindAddress{};
+	bindAddress.sin_family = AF_INET;
+	bindAddress.sin_port = htons(port);
+	bindAddress.sin_addr.s_addr = INADDR_ANY;
+
+	if (bind(socketDescriptor, reinterpret_cast<sockaddr*>(&bindAddress),
+	         sizeof(bindAddress)) == -1) {
+		::close(socketDescriptor);
+		throwSafe();
+	}
+}
+
+void UDPSocket::close() {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	::close(socketDescriptor);
+	socketDescriptor = -1;
+}
+
+UDPSocket::~UDPSocket() {
+	if (socketDescriptor != -1) {
+		close();
+	}
+}
+
+uint16_t UDPSocket::getPort() const {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	sockaddr_in address;
+	socklen_t addressLength = sizeof(address);
+	if (getsockname(socketDescriptor, reinterpret_cast<sockaddr*>(&address),
+	                &addressLength) == -1) {
+		throwSafe();
+	}
+
+	return ntohs(address.sin_port);
+}
+
+ssize_t UDPSocket::send(std::string_view address, unsigned short port,
+                        std::string_view data) {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	sockaddr_in destination;
+	fillAddress(destination, address, port);
+
+	auto bytesWritten =
+	    sendto(socketDescriptor, data.data(), data.size(), 0,
+	           reinterpret_cast<sockaddr*>(&destination), sizeof(destination));
+	if (bytesWritten == -1) {
+		if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return 0;
+		}
+		throwSafe();
+	}
+
+	return bytesWritten;
+}
+
+int UDPSocket::flushSendBatch(unsigned int count) {
+	unsigned int numSent = 0;
+
+	while (numSent < count) {
+		int res = sendmmsg(socketDescriptor, &sendHeaders[numSent],
+		                   count - numSent, MSG_DONTWAIT);
+		if (res == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			throwSafe();
+		}
+		numSent += res;
+	}
+
+	return numSent;
+}
+
+// Each entry of the list is {address, port, data}. Returns how many datagrams
+// were handed to the kernel; anything after that was not sent because the
+// socket buffer is full.
+int UDPSocket::sendMany(sol::table list) {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	int totalSent = 0;
+	unsigned int count = 0;
+
+	const size_t size = list.size();
+	for (size_t i = 1; i <= size; i++) {
+		sol::table entry = list[i];
+		std::string_view address = entry[1];
+		unsigned short port = entry[2];
+		std::string_view data = entry[3];
+
+		fillAddress(sendAddresses[count], address, port);
+
+		// The strings stay referenced by the list until we return
+		sendVectors[count].iov_base = const_cast<char*>(data.data());
+		sendVectors[count].iov_len = data.size();
+
+		msghdr& header = sendHeaders[count].msg_hdr;
+		header = {};
+		header.msg_name = &sendAddresses[count];
+		header.msg_namelen = sizeof(sockaddr_in);
+		header.msg_iov = &sendVectors[count];
+		header.msg_iovlen = 1;
+
+		if (++count == maxDatagramBatchSize) {
+			int numSent = flushSendBatch(count);
+			totalSent += numSent;
+			if (static_cast<unsigned int>(numSent) != count) {
+				return totalSent;
+			}
+			count = 0;
+		}
+	}
+
+	if (count) {
+		totalSent += flushSendBatch(count);
+	}
+
+	return totalSent;
+}
+
+std::tuple<sol::object, sol::object, sol::object> UDPSocket::receive(
+    sol::this_state s) {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	sol::state_view lua(s);
+
+	sockaddr_in address;
+	ssize_t bytesRead;
+
+	while (true) {
+		socklen_t addressLength = sizeof(address);
+
+		// MSG_TRUNC makes this return the real length of the datagram
+		bytesRead = recvfrom(socketDescriptor, receiveBuffer.data(),
+		                     maxDatagramReadSize, MSG_TRUNC,
+		                     reinterpret_cast<sockaddr*>(&address), &addressLength);
+		if (bytesRead == -1) {
+			if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				return std::make_tuple(sol::make_object(lua, sol::nil),
+				                       sol::make_object(lua, sol::nil),
+				                       sol::make_object(lua, sol::nil));
+			}
+			throwSafe();
+		}
+
+		if (static_cast<size_t>(bytesRead) <= maxDatagramReadSize) break;
+		numTruncated++;
+	}
+
+	char addressString[INET_ADDRSTRLEN];
+	inet_ntop(AF_INET, &address.sin_addr, addressString, INET_ADDRSTRLEN);
+
+	return std::make_tuple(
+	    sol::make_object(lua, std::string_view(receiveBuffer.data(), bytesRead)),
+	    sol::make_object(lua, addressString),
+	    sol::make_object(lua, ntohs(address.sin_port)));
+}
+
+// Receives up to `max` datagrams with a single recvmmsg call. If a table is
+// passed it is refilled in place (including its entry tables) instead of
+// creating new ones, so a per-tick poll produces no garbage.
+sol::table UDPSocket::receiveMany(unsigned int max,
+                                  sol::optional<sol::table> reuse,
+                                  sol::this_state s) {
+	if (socketDescriptor == -1) {
+		throw std::runtime_error(errorNotOpen);
+	}
+
+	sol::state_view lua(s);
+	sol::table results = reuse ? reuse.value() : lua.create_table();
+
+	unsigned int count = std::min(max, maxDatagramBatchSize);
+	for (unsigned int i = 0; i < count; i++) {
+		receiveVectors[i].iov_base = &receiveBuffer[i * maxDatagramReadSize];
+		receiveVectors[i].iov_len = maxDatagramReadSize;
+
+		msghdr& header = receiveHeaders[i].msg_hdr;
+		header = {};
+		header.msg_name = &receiveAddresses[i];
+		header.msg_namelen = sizeof(sockaddr_in);
+		header.msg_iov = &receiveVectors[i];
+		header.msg_iovlen = 1;
+	}
+
+	int numReceived = 0;
+	if (count) {
+		numReceived = recvmmsg(socketDescriptor, receiveHeaders, count,
+		                       MSG_DONTWAIT, nullptr);
+		if (numReceived == -1) {
+			if (errno != EAGAIN && errno != EWOULDBLOCK) {
+				throwSafe();
+			}
+			numReceived = 0;
+		}
+	}
+
+	int numKept = 0;
+	for (int i = 0; i < numReceived; i++) {
+		if (receiveHeaders[i].msg_hdr.msg_flags & MSG_TRUNC) {
+			numTruncated++;
+			continue;
+		}
+
+		int index = ++numKept;
+		sol::optional<sol::table> existing = results[index];
+		sol::table entry = existing ? existing.value() : lua.create_table(0, 3);
+
+		char addressString[INET_ADDRSTRLEN];
+		inet_ntop(AF_INET, &receiveAddresses[i].sin_addr, addressString,
+		          INET_ADDRSTRLEN);
+
+		entry["data"] = std::string_view(&receiveBuffer[i * maxDatagramReadSize],
+		                                 receiveHeaders[i].msg_len);
+		entry["address"] = addressString;
+		entry["port"] = ntohs(receiveAddresses[i].sin_port);
+
+		if (!existing) results[index] = entry;
+	}
+
+	// Trim whatever was left over from a bigger previous batch
+	for (size_t i = numKept + 1; results[i].valid(); i++) {
+		results[i] = sol::nil;
+	}
+
+	return results;
+}
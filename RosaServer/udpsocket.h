@@ -0,0 +1,50 @@
+#pragma once
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include <string>
+#include <vector>
+
+#include "sol/sol.hpp"
+
+static constexpr unsigned int maxDatagramBatchSize = 64;
+static constexpr size_t maxDatagramReadSize = 4096;
+
+class UDPSocket {
+	int socketDescriptor;
+	// Datagrams longer than maxDatagramReadSize are dropped rather than cut off
+	unsigned int numTruncated = 0;
+
+	// Reused by every receiveMany/sendMany call, so a batch never allocates
+	// anything on the native side.
+	std::vector<char> receiveBuffer;
+	mmsghdr receiveHeaders[maxDatagramBatchSize];
+	iovec receiveVectors[maxDatagramBatchSize];
+	sockaddr_in receiveAddresses[maxDatagramBatchSize];
+
+	mmsghdr sendHeaders[maxDatagramBatchSize];
+	iovec sendVectors[maxDatagramBatchSize];
+	sockaddr_in sendAddresses[maxDatagramBatchSize];
+
+	int flushSendBatch(unsigned int count);
+
+ public:
+	UDPSocket();
+	UDPSocket(unsigned short port);
+	~UDPSocket();
+
+	void close();
+	bool isOpen() const { return socketDescriptor != -1; }
+	int getFileDescriptor() const { return socketDescriptor; }
+	uint16_t getPort() const;
+	unsigned int getNumTruncated() const { return numTruncated; }
+
+	ssize_t send(std::string_view address, unsigned short port,
+	             std::string_view data);
+	int sendMany(sol::table list);
+	std::tuple<sol::object, sol::object, sol::object> receive(
+	    sol::this_state s);
+	sol::table receiveMany(unsigned int max, sol::optional<sol::table> reuse,
+	                       sol::this_state s);
+};
@@ -1,39 +1,88 @@
 #include "worker.h"
 
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstring>
 #include <mutex>
+#include <stdexcept>
 #include <thread>
 
 #include "api.h"
 
-// runThread uses a while true loop; this is for how many milliseconds it sleeps
-// per iteration.
-const long long THREAD_LOOP_SLEEP_TIME = 1000;
+std::unordered_set<Worker*> Worker::liveWorkers;
+
+static inline void throwSafe() {
+	char error[256];
+	throw std::runtime_error(strerror_r(errno, error, sizeof(error)));
+}
+
+Worker::Worker(std::string fileName)
+    : sendMessageQueue(workerMessageQueueSize),
+      receiveMessageQueue(workerMessageQueueSize) {
+	wakeDescriptor = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	if (wakeDescriptor == -1) {
+		throwSafe();
+	}
 
-Worker::Worker(std::string fileName) {
 	workerThread = std::thread(&Worker::runThread, this, fileName);
+	liveWorkers.insert(this);
 }
 
 Worker::~Worker() {
+	liveWorkers.erase(this);
 	stop();
 	workerThread.join();
+	::close(wakeDescriptor);
+}
+
+void Worker::sumQueueSizes(size_t& toWorkers, size_t& fromWorkers) {
+	toWorkers = 0;
+	fromWorkers = 0;
+	for (Worker* worker : liveWorkers) {
+		toWorkers += worker->sendMessageQueue.size();
+		fromWorkers += worker->receiveMessageQueue.size();
+	}
 }
 
 void Worker::runThread(std::string fileName) {
 	sol::state state;
 	defineThreadSafeAPIs(&state);
 
-	state["sendMessage"] = [this](std::string message) {
-		this->l_sendMessage(message);
+	state["sendMessage"] = [this](sol::object message) {
+		return this->l_sendMessage(message);
+	};
+
+	state["receiveMessage"] = [this](sol::optional<int> timeoutMs,
+	                                 sol::this_state s) {
+		return this->l_receiveMessage(timeoutMs, s);
+	};
+
+	state["receiveMessages"] = [this](unsigned int max,
+	                                  sol::optional<sol::table> reuse,
+	                                  sol::this_state s) {
+		return this->l_receiveMessages(max, reuse, s);
+	};
+
+	state["addTimer"] = [this](unsigned int ms, sol::optional<bool> repeating) {
+		return this->l_addTimer(ms, repeating);
 	};
 
-	state["receiveMessage"] = [this](sol::this_state s) {
-		return this->l_receiveMessage(s);
+	state["removeTimer"] = [this](int id) { this->l_removeTimer(id); };
+
+	state["wait"] = [this](sol::optional<int> timeoutMs,
+	                       sol::optional<sol::table> fileDescriptors,
+	                       sol::this_state s) {
+		return this->l_wait(timeoutMs, fileDescriptors, s);
 	};
 
 	state["sleep"] = [this](unsigned int ms) -> bool {
 		{
 			std::unique_lock<std::mutex> lock(destructionMutex);
-			stopCondition.wait_for(lock, std::chrono::milliseconds(ms));
+			stopCondition.wait_for(lock, std::chrono::milliseconds(ms),
+			                       [this] { return this->stopped.load(); });
 		}
 
 		if (this->stopped) return true;
@@ -48,32 +97,217 @@ void Worker::runThread(std::string fileName) {
 		}
 	}
 
-	while (!stopped) {
-		std::unique_lock<std::mutex> lock(destructionMutex);
-		stopCondition.wait_for(lock,
-		                       std::chrono::milliseconds(THREAD_LOOP_SLEEP_TIME));
+	for (int timer : timers) ::close(timer);
+	timers.clear();
+
+	std::unique_lock<std::mutex> lock(destructionMutex);
+	stopCondition.wait(lock, [this] { return this->stopped.load(); });
+}
+
+void Worker::wake() {
+	// Pairs with the fence in pollWithWake so either the worker sees the new
+	// message before blocking, or we see it waiting and wake it
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+	if (!waiting.load(std::memory_order_relaxed)) return;
+
+	uint64_t one = 1;
+	write(wakeDescriptor, &one, sizeof(one));
+}
+
+// Blocks in poll() on the given descriptors plus the wake eventfd, which is
+// always descriptors[0]. Returns immediately if a message is already queued or
+// the worker is stopping.
+void Worker::pollWithWake(std::vector<pollfd>& descriptors, int timeoutMs) {
+	descriptors[0] = {wakeDescriptor, POLLIN, 0};
+
+	waiting.store(true, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_seq_cst);
+
+	if (sendMessageQueue.size() || stopped) {
+		timeoutMs = 0;
+	}
+
+	while (::poll(descriptors.data(), descriptors.size(), timeoutMs) == -1) {
+		if (errno != EINTR) {
+			waiting.store(false, std::memory_order_relaxed);
+			throwSafe();
+		}
+	}
+
+	waiting.store(false, std::memory_order_relaxed);
+
+	if (descriptors[0].revents & POLLIN) {
+		uint64_t count;
+		read(wakeDescriptor, &count, sizeof(count));
+	}
+}
+
+WorkerMessage toWorkerMessage(const sol::object& object) {
+	if (object.is<SharedBuffer>()) {
+		return object.as<SharedBuffer>();
+	}
+
+	if (object.get_type() != sol::type::string) {
+		throw std::invalid_argument("Message must be a string or a SharedBuffer");
+	}
+
+	return object.as<std::string>();
+}
+
+sol::object fromWorkerMessage(sol::state_view state, WorkerMessage&& message) {
+	if (auto buffer = std::get_if<SharedBuffer>(&message)) {
+		return sol::make_object(state, std::move(*buffer));
+	}
+
+	return sol::make_object(state, std::move(std::get<std::string>(message)));
+}
+
+// Pops up to `max` messages into a table, refilling `reuse` in place if given.
+static sol::table drainMessages(SPSCRing<WorkerMessage>& queue,
+                                unsigned int max,
+                                sol::optional<sol::table> reuse,
+                                sol::this_state s) {
+	sol::state_view state(s);
+	sol::table messages = reuse ? reuse.value() : state.create_table();
+
+	WorkerMessage message;
+	size_t count = 0;
+	while (count < max && queue.pop(message)) {
+		messages[++count] = fromWorkerMessage(state, std::move(message));
+	}
+
+	// Trim whatever was left over from a bigger previous batch
+	for (size_t i = count + 1; messages[i].valid(); i++) {
+		messages[i] = sol::nil;
+	}
+
+	return messages;
+}
+
+bool Worker::l_sendMessage(sol::object message) {
+	return receiveMessageQueue.push(toWorkerMessage(message));
+}
+
+// With a timeout, blocks until a message arrives, the timeout passes (a
+// negative timeout waits forever) or the worker is stopped.
+sol::object Worker::l_receiveMessage(sol::optional<int> timeoutMs,
+                                     sol::this_state s) {
+	sol::state_view state(s);
+
+	auto deadline = std::chrono::steady_clock::now() +
+	                std::chrono::milliseconds(timeoutMs.value_or(0));
+
+	WorkerMessage message;
+	while (!sendMessageQueue.pop(message)) {
+		if (!timeoutMs || stopped) {
+			return sol::make_object(state, sol::nil);
+		}
+
+		int remaining = -1;
+		if (*timeoutMs >= 0) {
+			auto left = std::chrono::duration_cast<std::chrono::milliseconds>(
+			    deadline - std::chrono::steady_clock::now());
+			if (left.count() <= 0) {
+				return sol::make_object(state, sol::nil);
+			}
+			remaining = left.count();
+		}
+
+		std::vector<pollfd> descriptors(1);
+		pollWithWake(descriptors, remaining);
+	}
+
+	return fromWorkerMessage(state, std::move(message));
+}
+
+int Worker::l_addTimer(unsigned int ms, sol::optional<bool> repeating) {
+	int timer = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+	if (timer == -1) {
+		throwSafe();
+	}
+
+	itimerspec spec{};
+	spec.it_value.tv_sec = ms / 1000;
+	spec.it_value.tv_nsec = (ms % 1000) * 1000000L;
+	// A zero it_value would disarm the timer
+	if (ms == 0) spec.it_value.tv_nsec = 1;
+	if (repeating.value_or(false)) spec.it_interval = spec.it_value;
+
+	if (timerfd_settime(timer, 0, &spec, nullptr) == -1) {
+		::close(timer);
+		throwSafe();
 	}
+
+	timers.insert(timer);
+	return timer;
 }
 
-void Worker::l_sendMessage(std::string message) {
-	std::lock_guard<std::mutex> guard(receiveMessageQueueMutex);
-	receiveMessageQueue.push(message);
-	if (receiveMessageQueue.size() > 2047) receiveMessageQueue.pop();
+void Worker::l_removeTimer(int id) {
+	if (!timers.erase(id)) {
+		throw std::invalid_argument("Invalid timer");
+	}
+
+	::close(id);
 }
 
-sol::object Worker::l_receiveMessage(sol::this_state s) {
+// Waits until there is a message, a timer fires or one of the given file
+// descriptors is readable. Returns a list of {type = "message"},
+// {type = "timer", id = id, expirations = n} and {type = "fd", fd = fd}
+// events, which is empty on timeout, or nil if the worker is being stopped.
+sol::object Worker::l_wait(sol::optional<int> timeoutMs,
+                           sol::optional<sol::table> fileDescriptors,
+                           sol::this_state s) {
 	sol::state_view state(s);
 
-	sendMessageQueueMutex.lock();
-	if (sendMessageQueue.empty()) {
-		sendMessageQueueMutex.unlock();
+	std::vector<pollfd> descriptors(1);
+	for (int timer : timers) {
+		descriptors.push_back({timer, POLLIN, 0});
+	}
+
+	size_t firstFileDescriptor = descriptors.size();
+	if (fileDescriptors) {
+		for (const auto& pair : fileDescriptors.value()) {
+			descriptors.push_back({pair.second.as<int>(), POLLIN, 0});
+		}
+	}
+
+	pollWithWake(descriptors, timeoutMs.value_or(-1));
+
+	if (stopped) {
 		return sol::make_object(state, sol::nil);
 	}
 
-	auto message = sendMessageQueue.front();
-	sendMessageQueue.pop();
-	sendMessageQueueMutex.unlock();
-	return sol::make_object(state, message);
+	sol::table events = state.create_table();
+
+	if (sendMessageQueue.size()) {
+		events.add(state.create_table_with("type", "message"));
+	}
+
+	for (size_t i = 1; i < descriptors.size(); i++) {
+		if (!descriptors[i].revents) continue;
+
+		if (i < firstFileDescriptor) {
+			uint64_t expirations = 0;
+			if (read(descriptors[i].fd, &expirations, sizeof(expirations)) == -1) {
+				continue;
+			}
+
+			events.add(state.create_table_with("type", "timer", "id",
+			                                   descriptors[i].fd, "expirations",
+			                                   expirations));
+		} else {
+			events.add(
+			    state.create_table_with("type", "fd", "fd", descriptors[i].fd));
+		}
+	}
+
+	return sol::make_object(state, events);
+}
+
+sol::table Worker::l_receiveMessages(unsigned int max,
+                                     sol::optional<sol::table> reuse,
+                                     sol::this_state s) {
+	return drainMessages(sendMessageQueue, max, reuse, s);
 }
 
 void Worker::stop() {
@@ -82,27 +316,32 @@ void Worker::stop() {
 		stopped = true;
 	}
 	stopCondition.notify_all();
+	wake();
 }
 
-void Worker::sendMessage(std::string message) {
-	if (stopped) return;
+// Returns false if the worker's queue is full and the message was dropped.
+bool Worker::sendMessage(sol::object message) {
+	if (stopped) return false;
+
+	if (!sendMessageQueue.push(toWorkerMessage(message))) return false;
 
-	std::lock_guard<std::mutex> guard(sendMessageQueueMutex);
-	sendMessageQueue.push(message);
-	if (sendMessageQueue.size() > 2047) sendMessageQueue.pop();
+	wake();
+	return true;
 }
 
 sol::object Worker::receiveMessage(sol::this_state s) {
 	sol::state_view state(s);
 
-	receiveMessageQueueMutex.lock();
-	if (receiveMessageQueue.empty()) {
-		receiveMessageQueueMutex.unlock();
+	WorkerMessage message;
+	if (!receiveMessageQueue.pop(message)) {
 		return sol::make_object(state, sol::nil);
 	}
 
-	auto message = receiveMessageQueue.front();
-	receiveMessageQueue.pop();
-	receiveMessageQueueMutex.unlock();
-	return sol::make_object(state, message);
+	return fromWorkerMessage(state, std::move(message));
+}
+
+sol::table Worker::receiveMessages(unsigned int max,
+                                   sol::optional<sol::table> reuse,
+                                   sol::this_state s) {
+	return drainMessages(receiveMessageQueue, max, reuse, s);
 }
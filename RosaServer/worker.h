@@ -1,32 +1,84 @@
 #pragma once
+#include <poll.h>
+
 #include <atomic>
 #include <condition_variable>
 #include <mutex>
-#include <queue>
 #include <string>
+#include <thread>
+#include <unordered_set>
+#include <variant>
+#include <vector>
 
+#include "sharedbuffer.h"
 #include "sol/sol.hpp"
+#include "spscring.h"
+
+static constexpr size_t workerMessageQueueSize = 2048;
+
+// Strings are moved through the queue; shared buffers only by reference
+using WorkerMessage = std::variant<std::string, SharedBuffer>;
+
+WorkerMessage toWorkerMessage(const sol::object& object);
+sol::object fromWorkerMessage(sol::state_view state, WorkerMessage&& message);
 
 class Worker {
-	std::atomic_bool stopped;
+	std::atomic_bool stopped = false;
 	std::mutex destructionMutex;
 	std::condition_variable stopCondition;
 	std::thread workerThread;
 
-	std::queue<std::string> sendMessageQueue;
-	std::mutex sendMessageQueueMutex;
+	// Written to wake the worker thread when it is blocked waiting, either for
+	// a message or on stop(). Only signalled while `waiting` is set.
+	int wakeDescriptor;
+	std::atomic_bool waiting = false;
+	// timerfds created by the worker script, only touched on its thread
+	std::unordered_set<int> timers;
 
-	std::queue<std::string> receiveMessageQueue;
-	std::mutex receiveMessageQueueMutex;
+	// Main thread -> worker
+	SPSCRing<WorkerMessage> sendMessageQueue;
+	// Worker -> main thread
+	SPSCRing<WorkerMessage> receiveMessageQueue;
+
+	// Workers are only created and destroyed on the main thread
+	static std::unordered_set<Worker*> liveWorkers;
+
+	void wake();
+	void pollWithWake(std::vector<pollfd>& descriptors, int timeoutMs);
 
 	void runThread(std::string fileName);
-	void l_sendMessage(std::string message);
-	sol::object l_receiveMessage(sol::this_state s);
+	bool l_sendMessage(sol::object message);
+	sol::object l_receiveMessage(sol::optional<int> timeoutMs,
+	                             sol::this_state s);
+	int l_addTimer(unsigned int ms, sol::optional<bool> repeating);
+	void l_removeTimer(int id);
+	sol::object l_wait(sol::optional<int> timeoutMs,
+	                   sol::optional<sol::table> fileDescriptors,
+	                   sol::this_state s);
+	sol::table l_receiveMessages(unsigned int max,
+	                             sol::optional<sol::table> reuse,
+	                             sol::this_state s);
 
  public:
 	Worker(std::string fileName);
 	~Worker();
 	void stop();
-	void sendMessage(std::string message);
+	bool sendMessage(sol::object message);
 	sol::object receiveMessage(sol::this_state s);
+	sol::table receiveMessages(unsigned int max, sol::optional<sol::table> reuse,
+	                           sol::this_state s);
+
+	size_t getNumSendDropped() const {
+		return sendMessageQueue.getNumDropped();
+	}
+	size_t getNumReceiveDropped() const {
+		return receiveMessageQueue.getNumDropped();
+	}
+	size_t getSendHighWater() const { return sendMessageQueue.getHighWater(); }
+	size_t getReceiveHighWater() const {
+		return receiveMessageQueue.getHighWater();
+	}
+
+	// Messages waiting in every live worker's queues, in each direction
+	static void sumQueueSizes(size_t& toWorkers, size_t& fromWorkers);
 };
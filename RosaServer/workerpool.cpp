@@ -0,0 +1,221 @@
+#include "workerpool.h"
+
+#include <stdexcept>
+
+#include "api.h"
+
+static JobValue toJobValue(const sol::object& object) {
+	switch (object.get_type()) {
+		case sol::type::nil:
+		case sol::type::none:
+			return std::monostate();
+		case sol::type::boolean:
+			return object.as<bool>();
+		case sol::type::number:
+			return object.as<double>();
+		case sol::type::string:
+			return object.as<std::string>();
+		default:
+			if (object.is<SharedBuffer>()) return object.as<SharedBuffer>();
+
+			throw std::invalid_argument(
+			    "Job values must be nil, a boolean, a number, a string or a "
+			    "SharedBuffer");
+	}
+}
+
+static sol::object fromJobValue(sol::state_view state, JobValue& value) {
+	switch (value.index()) {
+		case 1:
+			return sol::make_object(state, std::get<bool>(value));
+		case 2:
+			return sol::make_object(state, std::get<double>(value));
+		case 3:
+			return sol::make_object(state, std::move(std::get<std::string>(value)));
+		case 4:
+			return sol::make_object(state, std::get<SharedBuffer>(value));
+		default:
+			return sol::make_object(state, sol::nil);
+	}
+}
+
+WorkerPool::WorkerPool(unsigned int numThreads, std::string moduleFile)
+    : moduleFile(moduleFile) {
+	if (numThreads == 0) {
+		throw std::invalid_argument("Pool needs at least one thread");
+	}
+
+	deques.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		deques.push_back(std::make_unique<JobDeque>());
+	}
+
+	threads.reserve(numThreads);
+	for (unsigned int i = 0; i < numThreads; i++) {
+		threads.emplace_back(&WorkerPool::runThread, this, i);
+	}
+}
+
+WorkerPool::~WorkerPool() {
+	{
+		std::lock_guard<std::mutex> guard(idleMutex);
+		stopping = true;
+	}
+	idleCondition.notify_all();
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+bool WorkerPool::takeJob(unsigned int index, PoolJob& job) {
+	{
+		auto& own = *deques[index];
+		std::lock_guard<std::mutex> guard(own.mutex);
+		if (!own.jobs.empty()) {
+			job = std::move(own.jobs.back());
+			own.jobs.pop_back();
+			numQueued--;
+			return true;
+		}
+	}
+
+	for (size_t offset = 1; offset < deques.size(); offset++) {
+		auto& victim = *deques[(index + offset) % deques.size()];
+		std::lock_guard<std::mutex> guard(victim.mutex);
+		if (!victim.jobs.empty()) {
+			job = std::move(victim.jobs.front());
+			victim.jobs.pop_front();
+			numQueued--;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+// Each thread owns a Lua state that is set up once and reused for every job.
+void WorkerPool::runThread(unsigned int index) {
+	sol::state state;
+	defineThreadSafeAPIs(&state);
+
+	sol::table module = state.globals();
+	std::string loadError;
+
+	sol::load_result load = state.load_file(moduleFile);
+	if (noLuaCallError(&load)) {
+		sol::protected_function_result res = load();
+		if (noLuaCallError(&res)) {
+			if (res.get_type() == sol::type::table) module = res.get<sol::table>();
+		} else {
+			loadError = "Module failed to run";
+		}
+	} else {
+		loadError = "Module failed to load";
+	}
+
+	while (true) {
+		PoolJob job;
+		if (!takeJob(index, job)) {
+			std::unique_lock<std::mutex> lock(idleMutex);
+			idleCondition.wait(lock, [this] { return stopping || numQueued > 0; });
+			if (stopping) return;
+			continue;
+		}
+
+		PoolJobResult result{job.id, false};
+
+		if (!loadError.empty()) {
+			result.error = loadError;
+		} else {
+			sol::optional<sol::protected_function> function =
+			    module[job.functionName];
+			if (!function) {
+				result.error = "No function named " + job.functionName;
+			} else {
+				auto res = (*function)(fromJobValue(state, job.payload));
+				if (res.valid()) {
+					try {
+						result.value = toJobValue(res.get<sol::object>());
+						result.succeeded = true;
+					} catch (const std::exception& e) {
+						result.error = e.what();
+					}
+				} else {
+					sol::error err = res;
+					result.error = err.what();
+				}
+			}
+		}
+
+		results.push(std::move(result));
+	}
+}
+
+unsigned int WorkerPool::push(std::string functionName, JobValue payload) {
+	auto id = nextJobID++;
+
+	// Spread submissions round robin; stealing evens out the rest
+	auto& deque = *deques[nextDeque];
+	nextDeque = (nextDeque + 1) % deques.size();
+
+	{
+		std::lock_guard<std::mutex> guard(deque.mutex);
+		deque.jobs.push_back({id, std::move(functionName), std::move(payload)});
+	}
+
+	numQueued++;
+	numPending++;
+
+	{ std::lock_guard<std::mutex> guard(idleMutex); }
+	idleCondition.notify_one();
+
+	return id;
+}
+
+unsigned int WorkerPool::submit(std::string functionName,
+                                sol::object payload) {
+	return push(std::move(functionName), toJobValue(payload));
+}
+
+// Submits one job per list element. Returns their job IDs in list order.
+sol::table WorkerPool::map(std::string functionName, sol::table list,
+                           sol::this_state s) {
+	sol::state_view state(s);
+	sol::table ids = state.create_table(list.size(), 0);
+
+	const size_t size = list.size();
+	for (size_t i = 1; i <= size; i++) {
+		ids[i] = push(functionName, toJobValue(list[i]));
+	}
+
+	return ids;
+}
+
+// Returns completed jobs as {id = id, result = value} or
+// {id = id, error = message}, in completion order.
+sol::table WorkerPool::poll(sol::optional<unsigned int> max,
+                            sol::this_state s) {
+	sol::state_view state(s);
+	sol::table completed = state.create_table();
+
+	unsigned int limit = max.value_or(-1);
+	unsigned int count = 0;
+
+	PoolJobResult result;
+	while (count < limit && results.pop(result)) {
+		count++;
+		numPending--;
+
+		sol::table entry = state.create_table(0, 2);
+		entry["id"] = result.id;
+		if (result.succeeded) {
+			entry["result"] = fromJobValue(state, result.value);
+		} else {
+			entry["error"] = result.error;
+		}
+		completed[count] = entry;
+	}
+
+	return completed;
+}
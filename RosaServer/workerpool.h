@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <variant>
+#include <vector>
+
+#include "mpscqueue.h"
+#include "sharedbuffer.h"
+#include "sol/sol.hpp"
+
+// What can be passed to and returned from a pool job
+using JobValue =
+    std::variant<std::monostate, bool, double, std::string, SharedBuffer>;
+
+struct PoolJob {
+	unsigned int id;
+	std::string functionName;
+	JobValue payload;
+};
+
+struct PoolJobResult {
+	unsigned int id;
+	bool succeeded;
+	JobValue value;
+	std::string error;
+};
+
+class WorkerPool {
+	// The owning thread pops from the back, idle threads steal from the front
+	struct JobDeque {
+		std::mutex mutex;
+		std::deque<PoolJob> jobs;
+	};
+
+	std::string moduleFile;
+	std::vector<std::unique_ptr<JobDeque>> deques;
+	std::vector<std::thread> threads;
+
+	std::atomic_uint numQueued = 0;
+	std::mutex idleMutex;
+	std::condition_variable idleCondition;
+	bool stopping = false;
+
+	MPSCQueue<PoolJobResult> results;
+
+	// Only touched by the thread that owns the pool
+	unsigned int nextJobID = 0;
+	unsigned int nextDeque = 0;
+	unsigned int numPending = 0;
+
+	bool takeJob(unsigned int index, PoolJob& job);
+	void runThread(unsigned int index);
+	unsigned int push(std::string functionName, JobValue payload);
+
+ public:
+	WorkerPool(unsigned int numThreads, std::string moduleFile);
+	~WorkerPool();
+
+	unsigned int submit(std::string functionName, sol::object payload);
+	sol::table map(std::string functionName, sol::table list, sol::this_state s);
+	sol::table poll(sol::optional<unsigned int> max, sol::this_state s);
+
+	unsigned int getNumPending() const { return numPending; }
+	unsigned int getNumThreads() const { return threads.size(); }
+};
@@ -0,0 +1,229 @@
+#include "worldsnapshot.h"
+
+#include <atomic>
+#include <cstring>
+#include <stdexcept>
+
+#include "engine.h"
+
+static constexpr const char* errorOutOfRange = "Index out of range";
+
+struct alignas(64) SnapshotBuffer {
+	// Odd while the main thread is writing into this buffer
+	std::atomic_uint32_t sequence = 0;
+	SnapshotData data;
+};
+
+static SnapshotBuffer buffers[2];
+static std::atomic_int publishedIndex = -1;
+static std::atomic_uint64_t latestTick = 0;
+
+const char* WorldSnapshot::cdef = R"(
+typedef struct { float x, y, z; } SnapshotVector;
+typedef struct {
+	float x1, y1, z1;
+	float x2, y2, z2;
+	float x3, y3, z3;
+} SnapshotRotMatrix;
+typedef struct {
+	int32_t active;
+	int32_t isAlive;
+	int32_t playerID;
+	int32_t team;
+	int32_t health;
+	int32_t vehicleID;
+	SnapshotVector pos;
+	SnapshotVector vel;
+	float viewYaw;
+	float viewPitch;
+} SnapshotHuman;
+typedef struct {
+	int32_t active;
+	uint32_t type;
+	int32_t health;
+	int32_t lastDriverPlayerID;
+	SnapshotVector pos;
+	SnapshotVector vel;
+	SnapshotRotMatrix rot;
+} SnapshotVehicle;
+typedef struct {
+	uint64_t tick;
+	int32_t ticksSinceReset;
+	int32_t numActiveHumans;
+	int32_t numActiveVehicles;
+	SnapshotHuman humans[256];
+	SnapshotVehicle vehicles[512];
+} SnapshotData;
+)";
+
+static_assert(maxNumberOfHumans == 256 && maxNumberOfVehicles == 512,
+              "WorldSnapshot::cdef array sizes are out of date");
+
+void WorldSnapshot::capture() {
+	int index = publishedIndex.load(std::memory_order_relaxed) == 0 ? 1 : 0;
+	SnapshotBuffer& buffer = buffers[index];
+
+	uint32_t sequence = buffer.sequence.load(std::memory_order_relaxed);
+	buffer.sequence.store(sequence + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	SnapshotData& out = buffer.data;
+	out.tick = latestTick.load(std::memory_order_relaxed) + 1;
+	out.ticksSinceReset = *Engine::ticksSinceReset;
+	out.numActiveHumans = 0;
+	out.numActiveVehicles = 0;
+
+	for (int i = 0; i < maxNumberOfHumans; i++) {
+		const Human& human = Engine::humans[i];
+		SnapshotHuman& entry = out.humans[i];
+
+		entry = {};
+		if (!human.active) continue;
+
+		out.numActiveHumans++;
+		entry.active = 1;
+		entry.isAlive = human.getIsAlive();
+		entry.playerID = human.playerID;
+		entry.team = -1;
+		if (human.playerID >= 0) {
+			entry.team = static_cast<int32_t>(Engine::players[human.playerID].team);
+		}
+		entry.health = human.health;
+		entry.vehicleID = human.vehicleID;
+		entry.pos = human.pos;
+		entry.vel = human.getRigidBody(0)->vel;
+		entry.viewYaw = human.viewYaw;
+		entry.viewPitch = human.viewPitch;
+	}
+
+	for (int i = 0; i < maxNumberOfVehicles; i++) {
+		const Vehicle& vehicle = Engine::vehicles[i];
+		SnapshotVehicle& entry = out.vehicles[i];
+
+		entry = {};
+		if (!vehicle.active) continue;
+
+		out.numActiveVehicles++;
+		entry.active = 1;
+		entry.type = vehicle.type;
+		entry.health = vehicle.health;
+		entry.lastDriverPlayerID = vehicle.lastDriverPlayerID;
+		entry.pos = vehicle.pos;
+		entry.vel = vehicle.vel;
+		entry.rot = vehicle.rot;
+	}
+
+	buffer.sequence.store(sequence + 2, std::memory_order_release);
+	publishedIndex.store(index, std::memory_order_release);
+	latestTick.store(out.tick, std::memory_order_release);
+}
+
+uint64_t WorldSnapshot::getLatestTick() {
+	return latestTick.load(std::memory_order_acquire);
+}
+
+WorldSnapshot::WorldSnapshot() : data(std::make_unique<SnapshotData>()) {
+	update();
+}
+
+// Copies the newest complete capture into this snapshot. Returns false if
+// there was nothing newer than what it already holds.
+bool WorldSnapshot::update() {
+	if (latestTick.load(std::memory_order_acquire) == data->tick) {
+		return false;
+	}
+
+	while (true) {
+		int index = publishedIndex.load(std::memory_order_acquire);
+		const SnapshotBuffer& buffer = buffers[index];
+
+		// Only odd if the main thread has lapped us and is rewriting this one;
+		// the published index will already point at the other buffer.
+		uint32_t before = buffer.sequence.load(std::memory_order_acquire);
+		if (before & 1) continue;
+
+		std::memcpy(data.get(), &buffer.data, sizeof(SnapshotData));
+		std::atomic_thread_fence(std::memory_order_acquire);
+
+		if (buffer.sequence.load(std::memory_order_relaxed) == before) {
+			return true;
+		}
+	}
+}
+
+const SnapshotHuman& WorldSnapshot::human(unsigned int index) const {
+	if (index >= maxNumberOfHumans) throw std::invalid_argument(errorOutOfRange);
+	return data->humans[index];
+}
+
+const SnapshotVehicle& WorldSnapshot::vehicle(unsigned int index) const {
+	if (index >= maxNumberOfVehicles) {
+		throw std::invalid_argument(errorOutOfRange);
+	}
+	return data->vehicles[index];
+}
+
+bool WorldSnapshot::isHumanActive(unsigned int index) const {
+	return human(index).active;
+}
+
+bool WorldSnapshot::isHumanAlive(unsigned int index) const {
+	return human(index).isAlive;
+}
+
+int WorldSnapshot::getHumanPlayerID(unsigned int index) const {
+	return human(index).playerID;
+}
+
+int WorldSnapshot::getHumanTeam(unsigned int index) const {
+	return human(index).team;
+}
+
+int WorldSnapshot::getHumanHealth(unsigned int index) const {
+	return human(index).health;
+}
+
+int WorldSnapshot::getHumanVehicleID(unsigned int index) const {
+	return human(index).vehicleID;
+}
+
+Vector WorldSnapshot::getHumanPos(unsigned int index) const {
+	return human(index).pos;
+}
+
+Vector WorldSnapshot::getHumanVel(unsigned int index) const {
+	return human(index).vel;
+}
+
+std::tuple<float, float> WorldSnapshot::getHumanView(unsigned int index) const {
+	auto& entry = human(index);
+	return std::make_tuple(entry.viewYaw, entry.viewPitch);
+}
+
+bool WorldSnapshot::isVehicleActive(unsigned int index) const {
+	return vehicle(index).active;
+}
+
+unsigned int WorldSnapshot::getVehicleType(unsigned int index) const {
+	return vehicle(index).type;
+}
+
+int WorldSnapshot::getVehicleHealth(unsigned int index) const {
+	return vehicle(index).health;
+}
+
+int WorldSnapshot::getVehicleLastDriverPlayerID(unsigned int index) const {
+	return vehicle(index).lastDriverPlayerID;
+}
+
+Vector WorldSnapshot::getVehiclePos(unsigned int index) const {
+	return vehicle(index).pos;
+}
+
+Vector WorldSnapshot::getVehicleVel(unsigned int index) const {
+	return vehicle(index).vel;
+}
+
+RotMatrix WorldSnapshot::getVehicleRot(unsigned int index) const {
+	return vehicle(index).rot;
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+
+#include "sol/sol.hpp"
+#include "structs.h"
+
+// Plain layouts so scripts can also read a snapshot through FFI; keep
+// WorldSnapshot::cdef in sync with these.
+struct SnapshotHuman {
+	int32_t active;
+	int32_t isAlive;
+	int32_t playerID;
+	int32_t team;
+	int32_t health;
+	int32_t vehicleID;
+	Vector pos;
+	Vector vel;
+	float viewYaw;
+	float viewPitch;
+};
+
+struct SnapshotVehicle {
+	int32_t active;
+	uint32_t type;
+	int32_t health;
+	int32_t lastDriverPlayerID;
+	Vector pos;
+	Vector vel;
+	RotMatrix rot;
+};
+
+struct SnapshotData {
+	uint64_t tick;
+	int32_t ticksSinceReset;
+	int32_t numActiveHumans;
+	int32_t numActiveVehicles;
+	SnapshotHuman humans[maxNumberOfHumans];
+	SnapshotVehicle vehicles[maxNumberOfVehicles];
+};
+
+// A read-only copy of the world that any Lua state can hold. The main thread
+// captures humans and vehicles once per tick into one of two buffers and then
+// flips which one is published; readers copy the published buffer out under a
+// sequence check, so neither side ever takes a lock or waits on the other.
+class WorldSnapshot {
+	std::unique_ptr<SnapshotData> data;
+
+	const SnapshotHuman& human(unsigned int index) const;
+	const SnapshotVehicle& vehicle(unsigned int index) const;
+
+ public:
+	static const char* cdef;
+
+	// Main thread only, right after the engine's physics step.
+	static void capture();
+	static uint64_t getLatestTick();
+
+	WorldSnapshot();
+
+	bool update();
+	uint64_t getTick() const { return data->tick; }
+	int getTicksSinceReset() const { return data->ticksSinceReset; }
+	int getNumActiveHumans() const { return data->numActiveHumans; }
+	int getNumActiveVehicles() const { return data->numActiveVehicles; }
+	void* getAddress() const { return data.get(); }
+	size_t getSize() const { return sizeof(SnapshotData); }
+
+	bool isHumanActive(unsigned int index) const;
+	bool isHumanAlive(unsigned int index) const;
+	int getHumanPlayerID(unsigned int index) const;
+	int getHumanTeam(unsigned int index) const;
+	int getHumanHealth(unsigned int index) const;
+	int getHumanVehicleID(unsigned int index) const;
+	Vector getHumanPos(unsigned int index) const;
+	Vector getHumanVel(unsigned int index) const;
+	std::tuple<float, float> getHumanView(unsigned int index) const;
+
+	bool isVehicleActive(unsigned int index) const;
+	unsigned int getVehicleType(unsigned int index) const;
+	int getVehicleHealth(unsigned int index) const;
+	int getVehicleLastDriverPlayerID(unsigned int index) const;
+	Vector getVehiclePos(unsigned int index) const;
+	Vector getVehicleVel(unsigned int index) const;
+	RotMatrix getVehicleRot(unsigned int index) const;
+};
@@ -1,19 +1,24 @@
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include <chrono>
+#include <memory>
 #include <thread>
 
+#include "satellite.h"
 #include "sol/sol.hpp"
 
 static constexpr int CODE_INVALID_USAGE = 1;
 static constexpr int CODE_FILE_INVALID = 2;
 static constexpr int CODE_FILE_RUNTIME_ERROR = 3;
+static constexpr int CODE_SHARED_MEMORY_INVALID = 4;
 
-static constexpr const char* ERR_WRITING_MESSAGE =
-    "Couldn't write full message to pipe";
-
-static int fdFromParent;
-static int fdToParent;
+static SatelliteControl* control;
+static std::unique_ptr<SharedMemoryRing> fromParent;
+static std::unique_ptr<SharedMemoryRing> toParent;
 
 static double l_os_realClock() {
 	auto now = std::chrono::steady_clock::now();
@@ -26,44 +31,73 @@ static double l_os_realClock() {
 static sol::object l_receiveMessage(sol::this_state s) {
 	sol::state_view lua(s);
 
-	unsigned int length;
+	sol::object message = sol::make_object(lua, sol::nil);
+	fromParent->read([&](std::string_view data) {
+		message = sol::make_object(lua, data);
+	});
 
-	auto bytesRead = read(fdFromParent, &length, sizeof(length));
-	if (bytesRead == -1) {
-		if (errno != EAGAIN) {
-			throw std::runtime_error(strerror(errno));
-		}
-	} else if (bytesRead == sizeof(length)) {
-		std::string message(length, ' ');
-		bytesRead = read(fdFromParent, message.data(), length);
-		if (bytesRead == -1) {
-			if (errno != EAGAIN) {
-				throw std::runtime_error(strerror(errno));
-			}
-		} else if (bytesRead == length) {
-			return sol::make_object(lua, message);
-		}
+	return message;
+}
+
+static sol::table l_receiveMessages(unsigned int max,
+                                    sol::optional<sol::table> reuse,
+                                    sol::this_state s) {
+	sol::state_view lua(s);
+	sol::table messages = reuse ? reuse.value() : lua.create_table();
+
+	size_t count = 0;
+	fromParent->readMany(max, [&](std::string_view data) {
+		messages[++count] = data;
+	});
+
+	// Trim whatever was left over from a bigger previous batch
+	for (size_t i = count + 1; messages[i].valid(); i++) {
+		messages[i] = sol::nil;
 	}
 
-	return sol::make_object(lua, sol::nil);
+	return messages;
 }
 
-static void l_sendMessage(std::string message) {
-	unsigned int length = static_cast<unsigned int>(message.length());
-
-	auto bytesWritten = write(fdToParent, &length, sizeof(length));
-	if (bytesWritten == -1) {
-		throw std::runtime_error(strerror(errno));
-	} else if (bytesWritten != sizeof(length)) {
-		throw std::runtime_error(ERR_WRITING_MESSAGE);
-	} else {
-		bytesWritten = write(fdToParent, message.data(), length);
-		if (bytesWritten == -1) {
-			throw std::runtime_error(strerror(errno));
-		} else if (bytesWritten != length) {
-			throw std::runtime_error(ERR_WRITING_MESSAGE);
-		}
+// Sleeps until a message arrives or the timeout passes (negative or no
+// timeout waits forever), using no CPU in between.
+static sol::object l_waitMessage(sol::optional<int> timeoutMs,
+                                 sol::this_state s) {
+	sol::state_view lua(s);
+
+	if (!fromParent->waitReadable(timeoutMs.value_or(-1))) {
+		return sol::make_object(lua, sol::nil);
 	}
+
+	return l_receiveMessage(s);
+}
+
+// Waits for room if the parent has fallen behind, like a full pipe would.
+static void l_sendMessage(std::string_view message) {
+	toParent->write(message, -1);
+}
+
+static bool mapSharedMemory(int fd) {
+	struct stat info;
+	if (fstat(fd, &info) == -1) return false;
+
+	size_t regionSize = info.st_size;
+	void* region =
+	    mmap(nullptr, regionSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (region == MAP_FAILED) return false;
+
+	SatelliteLayout layout(regionSize);
+	try {
+		control = layout.getControl(region);
+		fromParent = std::make_unique<SharedMemoryRing>(layout.getToChild(region),
+		                                                layout.ringRegionSize);
+		toParent = std::make_unique<SharedMemoryRing>(layout.getToParent(region),
+		                                              layout.ringRegionSize);
+	} catch (std::exception&) {
+		return false;
+	}
+
+	return true;
 }
 
 // https://github.com/moonjit/moonjit/blob/master/doc/c_api.md#luajit_setmodel-idx-luajit_mode_wrapcfuncflag
@@ -80,15 +114,21 @@ static int wrapExceptions(lua_State* L, lua_CFunction f) {
 	return lua_error(L);
 }
 
-int main(int argc, const char* argv[]) {
-	if (argc < 4) return CODE_INVALID_USAGE;
+static int runScript(sol::load_result& load) {
+	if (!load.valid()) {
+		return CODE_FILE_INVALID;
+	}
 
-	fdFromParent = atoi(argv[1]);
-	fdToParent = atoi(argv[2]);
-	const char* fileName = argv[3];
+	sol::protected_function script = load;
+	sol::protected_function_result res = script();
+	if (!res.valid()) {
+		return CODE_FILE_RUNTIME_ERROR;
+	}
 
-	sol::state lua;
+	return 0;
+}
 
+static void setupState(sol::state& lua) {
 	lua_pushlightuserdata(lua, (void*)wrapExceptions);
 	luaJIT_setmode(lua, -1, LUAJIT_MODE_WRAPCFUNC | LUAJIT_MODE_ON);
 	lua_pop(lua, 1);
@@ -109,21 +149,76 @@ int main(int argc, const char* argv[]) {
 	lua["os"]["realClock"] = l_os_realClock;
 
 	lua["receiveMessage"] = l_receiveMessage;
+	lua["receiveMessages"] = l_receiveMessages;
+	lua["waitMessage"] = l_waitMessage;
 	lua["sendMessage"] = l_sendMessage;
 
 	lua["sleep"] = [](unsigned int ms) {
 		std::this_thread::sleep_for(std::chrono::milliseconds(ms));
 	};
+}
+
+// Runs one job after another for a ChildProcessPool. Every job gets a whole
+// new state, so nothing a job changes, including the standard libraries and
+// package.loaded, can reach the next one. The next state is set up while
+// waiting for the next job.
+static void runPooled() {
+	auto lua = std::make_unique<sol::state>();
+	setupState(*lua);
 
-	sol::load_result load = lua.load_file(fileName);
-	if (load.valid()) {
-		sol::protected_function_result res = load();
-		if (!res.valid()) {
-			return CODE_FILE_RUNTIME_ERROR;
+	control->setState(SatelliteState::idle);
+
+	while (true) {
+		control->waitForState(SatelliteState::running);
+
+		std::string job;
+		fromParent->read([&](std::string_view data) { job = data; });
+
+		int code = CODE_INVALID_USAGE;
+		if (!job.empty()) {
+			std::string_view payload = std::string_view(job).substr(1);
+
+			if (job[0] == satelliteJobFile) {
+				sol::load_result load = lua->load_file(std::string(payload));
+				code = runScript(load);
+			} else if (job[0] == satelliteJobChunk) {
+				sol::load_result load = lua->load(payload);
+				code = runScript(load);
+			}
 		}
-	} else {
-		return CODE_FILE_INVALID;
+
+		// Stay off the rings until the server has reset them and set us idle
+		control->exitStatus.store(code << 8);
+		control->setState(SatelliteState::finished);
+
+		lua.reset();
+		lua = std::make_unique<sol::state>();
+		setupState(*lua);
+	}
+}
+
+int main(int argc, const char* argv[]) {
+	if (argc < 2) return CODE_INVALID_USAGE;
+
+	const char* parentPID = getenv(satelliteParentPIDVariable);
+	if (!parentPID) return CODE_INVALID_USAGE;
+
+	// Nothing else would ever wake us up if we're blocked on a ring. If the
+	// server already died, we've been reparented and the signal won't come.
+	prctl(PR_SET_PDEATHSIG, SIGTERM);
+	if (getppid() != atoi(parentPID)) return 0;
+
+	if (!mapSharedMemory(atoi(argv[1]))) return CODE_SHARED_MEMORY_INVALID;
+	const char* fileName = argc > 2 ? argv[2] : nullptr;
+
+	if (fileName) {
+		sol::state lua;
+		setupState(lua);
+
+		sol::load_result load = lua.load_file(fileName);
+		return runScript(load);
 	}
 
+	runPooled();
 	return 0;
 }
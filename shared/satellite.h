@@ -0,0 +1,77 @@
+#pragma once
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "sharedmemoryring.h"
+
+// The satellite always finds its shared memory at this descriptor.
+static constexpr int satelliteSharedFD = 3;
+// Set to the server's pid, so the satellite can tell if it was orphaned before
+// it could ask to be killed with the server.
+static constexpr const char* satelliteParentPIDVariable =
+    "ROSASERVER_PARENT_PID";
+
+// A pooled satellite waits for a job: one message starting with one of these,
+// followed by a file name or Lua source.
+static constexpr char satelliteJobFile = 'f';
+static constexpr char satelliteJobChunk = 'c';
+
+enum class SatelliteState : uint32_t { starting, idle, running, finished };
+
+// A pooled satellite only touches its rings while a job is running; between
+// jobs it sleeps on `state`, which lets the server reset the rings safely.
+struct alignas(64) SatelliteControl {
+	std::atomic_uint32_t state;
+	// Status of the last pooled job, in the same form waitpid would give
+	std::atomic_int32_t exitStatus;
+
+	SatelliteState getState() const {
+		return static_cast<SatelliteState>(state.load(std::memory_order_acquire));
+	}
+
+	void setState(SatelliteState newState) {
+		state.store(static_cast<uint32_t>(newState), std::memory_order_release);
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state), FUTEX_WAKE, 1,
+		        nullptr, nullptr, 0);
+	}
+
+	void waitForState(SatelliteState wanted) {
+		uint32_t current;
+		while ((current = state.load(std::memory_order_acquire)) !=
+		       static_cast<uint32_t>(wanted)) {
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&state), FUTEX_WAIT,
+			        current, nullptr, nullptr, 0);
+		}
+	}
+};
+
+// The memfd holds the control block, then the parent-to-child ring, then the
+// child-to-parent ring, both with the same capacity.
+struct SatelliteLayout {
+	size_t ringRegionSize;
+
+	SatelliteLayout(size_t regionSize)
+	    : ringRegionSize((regionSize - sizeof(SatelliteControl)) / 2) {}
+
+	static size_t getRegionSize(uint32_t capacity) {
+		return sizeof(SatelliteControl) +
+		       SharedMemoryRing::getRegionSize(capacity) * 2;
+	}
+
+	SatelliteControl* getControl(void* region) const {
+		return static_cast<SatelliteControl*>(region);
+	}
+
+	void* getToChild(void* region) const {
+		return static_cast<uint8_t*>(region) + sizeof(SatelliteControl);
+	}
+
+	void* getToParent(void* region) const {
+		return static_cast<uint8_t*>(getToChild(region)) + ringRegionSize;
+	}
+};
@@ -0,0 +1,264 @@
+#pragma once
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+static constexpr uint32_t sharedMemoryRingMagic = 0x52534d52;  // RSMR
+
+struct SharedMemoryRingHeader {
+	uint32_t magic;
+	uint32_t capacity;
+
+	alignas(64) std::atomic_uint64_t writePosition;
+	std::atomic_uint32_t readSignal;
+	std::atomic_uint32_t numReadWaiters;
+
+	alignas(64) std::atomic_uint64_t readPosition;
+	std::atomic_uint32_t writeSignal;
+	std::atomic_uint32_t numWriteWaiters;
+};
+
+static_assert(std::atomic_uint64_t::is_always_lock_free &&
+                  std::atomic_uint32_t::is_always_lock_free,
+              "Atomics shared between processes must be lock free");
+
+// A single-producer single-consumer message ring living in memory that is
+// mapped into two processes. Records are a 4-byte length followed by the
+// payload, padded to 4 bytes so a length never wraps around the end. Reading
+// and writing is plain memory access; the futex syscalls only happen when the
+// other side is actually asleep waiting for us.
+//
+// Positions count up forever and are masked on every access, so even if the
+// other process scribbles over the header we never touch memory outside the
+// region.
+class SharedMemoryRing {
+	SharedMemoryRingHeader* header;
+	uint8_t* data;
+	uint32_t capacity;
+	uint32_t mask;
+
+	// Only used when a payload wraps around the end of the ring
+	std::string scratch;
+
+	static size_t getRecordSize(size_t length) {
+		return (sizeof(uint32_t) + length + 3) & ~size_t(3);
+	}
+
+	void copyIn(uint64_t position, const void* source, size_t length) {
+		size_t offset = position & mask;
+		size_t first = std::min<size_t>(length, capacity - offset);
+		std::memcpy(data + offset, source, first);
+		std::memcpy(data, static_cast<const uint8_t*>(source) + first,
+		            length - first);
+	}
+
+	void copyOut(uint64_t position, void* destination, size_t length) const {
+		size_t offset = position & mask;
+		size_t first = std::min<size_t>(length, capacity - offset);
+		std::memcpy(destination, data + offset, first);
+		std::memcpy(static_cast<uint8_t*>(destination) + first, data,
+		            length - first);
+	}
+
+	static void wake(std::atomic_uint32_t& signal,
+	                 std::atomic_uint32_t& numWaiters) {
+		if (numWaiters.load(std::memory_order_seq_cst) == 0) return;
+		signal.fetch_add(1, std::memory_order_seq_cst);
+		syscall(SYS_futex, reinterpret_cast<uint32_t*>(&signal), FUTEX_WAKE, 1,
+		        nullptr, nullptr, 0);
+	}
+
+	template <typename Predicate>
+	static bool waitFor(std::atomic_uint32_t& signal,
+	                    std::atomic_uint32_t& numWaiters, Predicate ready,
+	                    int timeoutMs) {
+		auto deadline =
+		    std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+		while (!ready()) {
+			uint32_t observed = signal.load(std::memory_order_seq_cst);
+			numWaiters.fetch_add(1, std::memory_order_seq_cst);
+
+			// Checked again after announcing ourselves, otherwise a write
+			// landing in between would never wake us.
+			if (ready()) {
+				numWaiters.fetch_sub(1, std::memory_order_seq_cst);
+				return true;
+			}
+
+			timespec remaining{};
+			if (timeoutMs >= 0) {
+				auto left = deadline - std::chrono::steady_clock::now();
+				if (left <= std::chrono::nanoseconds::zero()) {
+					numWaiters.fetch_sub(1, std::memory_order_seq_cst);
+					return false;
+				}
+				auto nanoseconds =
+				    std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+				remaining.tv_sec = nanoseconds / 1000000000;
+				remaining.tv_nsec = nanoseconds % 1000000000;
+			}
+
+			syscall(SYS_futex, reinterpret_cast<uint32_t*>(&signal), FUTEX_WAIT,
+			        observed, timeoutMs >= 0 ? &remaining : nullptr, nullptr, 0);
+			numWaiters.fetch_sub(1, std::memory_order_seq_cst);
+		}
+
+		return true;
+	}
+
+ public:
+	static size_t getRegionSize(uint32_t capacity) {
+		return sizeof(SharedMemoryRingHeader) + capacity;
+	}
+
+	// Capacity must be a power of two and at least 4 bytes.
+	static void initialize(void* region, uint32_t capacity) {
+		auto newHeader = new (region) SharedMemoryRingHeader();
+		newHeader->capacity = capacity;
+		newHeader->writePosition = 0;
+		newHeader->readSignal = 0;
+		newHeader->numReadWaiters = 0;
+		newHeader->readPosition = 0;
+		newHeader->writeSignal = 0;
+		newHeader->numWriteWaiters = 0;
+		newHeader->magic = sharedMemoryRingMagic;
+	}
+
+	// The capacity is taken from the header and must fit within `regionSize`.
+	SharedMemoryRing(void* region, size_t regionSize)
+	    : header(static_cast<SharedMemoryRingHeader*>(region)),
+	      data(static_cast<uint8_t*>(region) + sizeof(SharedMemoryRingHeader)),
+	      capacity(header->capacity),
+	      mask(capacity - 1) {
+		if (header->magic != sharedMemoryRingMagic || capacity < 4 ||
+		    (capacity & mask) != 0 || regionSize < getRegionSize(capacity)) {
+			throw std::runtime_error("Invalid shared memory ring");
+		}
+	}
+
+	uint32_t getCapacity() const { return capacity; }
+
+	bool isEmpty() const {
+		return header->readPosition.load(std::memory_order_relaxed) ==
+		       header->writePosition.load(std::memory_order_acquire);
+	}
+
+	bool canFit(size_t length) const {
+		uint64_t used = header->writePosition.load(std::memory_order_relaxed) -
+		                header->readPosition.load(std::memory_order_acquire);
+		return used <= capacity && capacity - used >= getRecordSize(length);
+	}
+
+	// Returns false without writing anything if there isn't room right now.
+	bool tryWrite(std::string_view message) {
+		if (getRecordSize(message.size()) > capacity) {
+			throw std::runtime_error("Message is larger than the buffer");
+		}
+
+		if (!canFit(message.size())) return false;
+
+		uint64_t position = header->writePosition.load(std::memory_order_relaxed);
+		uint32_t length = static_cast<uint32_t>(message.size());
+		copyIn(position, &length, sizeof(length));
+		copyIn(position + sizeof(length), message.data(), message.size());
+
+		header->writePosition.store(position + getRecordSize(message.size()),
+		                            std::memory_order_seq_cst);
+		wake(header->readSignal, header->numReadWaiters);
+		return true;
+	}
+
+	// Blocks until there is room, or until the timeout (negative waits forever).
+	bool write(std::string_view message, int timeoutMs) {
+		while (!tryWrite(message)) {
+			if (!waitFor(
+			        header->writeSignal, header->numWriteWaiters,
+			        [&]() { return canFit(message.size()); }, timeoutMs)) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// Hands up to `max` messages to `callback`, each as a view straight into
+	// the ring unless it wraps, then frees their space with a single store.
+	// Returns how many were read.
+	template <typename Callback>
+	size_t readMany(size_t max, Callback&& callback) {
+		uint64_t start = header->readPosition.load(std::memory_order_relaxed);
+		uint64_t end = header->writePosition.load(std::memory_order_acquire);
+		if (end - start > capacity) {
+			throw std::runtime_error("Shared memory ring is corrupted");
+		}
+
+		uint64_t position = start;
+		size_t count = 0;
+
+		auto publish = [&]() {
+			if (position == start) return;
+			header->readPosition.store(position, std::memory_order_seq_cst);
+			wake(header->writeSignal, header->numWriteWaiters);
+		};
+
+		try {
+			while (count < max && position != end) {
+				uint64_t available = end - position;
+
+				uint32_t length;
+				if (available < sizeof(length)) {
+					throw std::runtime_error("Shared memory ring is corrupted");
+				}
+				copyOut(position, &length, sizeof(length));
+				if (length > available || getRecordSize(length) > available) {
+					throw std::runtime_error("Shared memory ring is corrupted");
+				}
+
+				size_t offset = (position + sizeof(length)) & mask;
+				if (offset + length <= capacity) {
+					callback(std::string_view(
+					    reinterpret_cast<const char*>(data + offset), length));
+				} else {
+					scratch.resize(length);
+					copyOut(position + sizeof(length), scratch.data(), length);
+					callback(std::string_view(scratch));
+				}
+
+				position += getRecordSize(length);
+				count++;
+			}
+		} catch (...) {
+			// Don't hand out the messages already delivered a second time
+			publish();
+			throw;
+		}
+
+		publish();
+		return count;
+	}
+
+	template <typename Callback>
+	bool read(Callback&& callback) {
+		return readMany(1, std::forward<Callback>(callback)) != 0;
+	}
+
+	// Blocks until a message is available, or until the timeout (negative
+	// waits forever).
+	bool waitReadable(int timeoutMs) {
+		return waitFor(
+		    header->readSignal, header->numReadWaiters,
+		    [this]() { return !isEmpty(); }, timeoutMs);
+	}
+};
@@ -14,26 +14,37 @@ local function runTests()
 	requireTest("tests.bonds")
 	requireTest("tests.bullets")
 	requireTest("tests.chat")
+	requireTest("tests.childProcessPool")
 	requireTest("tests.crypto")
 	requireTest("tests.events")
 	requireTest("tests.fileWatcher")
 	requireTest("tests.http")
+	requireTest("tests.httpServer")
 	requireTest("tests.humans")
 	requireTest("tests.image")
 	requireTest("tests.items")
 	requireTest("tests.itemTypes")
 	requireTest("tests.memory")
+	requireTest("tests.metrics")
 	requireTest("tests.os")
 	requireTest("tests.physics")
 	requireTest("tests.players")
+	requireTest("tests.pointGraph")
 	requireTest("tests.rigidBodies")
+	requireTest("tests.roadGraph")
 	requireTest("tests.rotMatrix")
+	requireTest("tests.serial")
 	requireTest("tests.server")
+	requireTest("tests.sharedBuffer")
+	requireTest("tests.sharedDict")
 	requireTest("tests.sqlite")
 	requireTest("tests.streets")
+	requireTest("tests.udpSocket")
 	requireTest("tests.vector")
 	requireTest("tests.vehicles")
 	requireTest("tests.worker")
+	requireTest("tests.workerPool")
+	requireTest("tests.worldSnapshot")
 	requireTest("tests.lz4")
 end
 
@@ -0,0 +1,81 @@
+return function()
+	local pool = ChildProcessPool.new(1)
+	assert(pool.size == 1)
+
+	local maxTicks = 600
+	local ticks = 0
+
+	local second
+
+	local function trySecond()
+		ticks = ticks + 1
+
+		local status = second:getExitCode()
+		if status then
+			-- The first job's changes didn't carry over
+			assert(status == 0, "job saw changes from the previous job")
+			assert(second:receiveMessage() == "clean")
+			second:release()
+		else
+			assert(ticks < maxTicks)
+			nextTick(trySecond)
+		end
+	end
+
+	local function checkoutSecond()
+		ticks = ticks + 1
+
+		second = pool:checkoutChunk([[
+			assert(string.mutated == nil)
+			assert(string.rep)
+			assert(leaked == nil)
+			assert(package.loaded.leaked == nil)
+			sendMessage("clean")
+		]])
+		if second then
+			ticks = 0
+			nextTick(trySecond)
+		else
+			assert(ticks < maxTicks)
+			nextTick(checkoutSecond)
+		end
+	end
+
+	local first
+
+	local function tryFirst()
+		ticks = ticks + 1
+
+		local status = first:getExitCode()
+		if status then
+			assert(status == 0)
+			first:release()
+
+			ticks = 0
+			nextTick(checkoutSecond)
+		else
+			assert(ticks < maxTicks)
+			nextTick(tryFirst)
+		end
+	end
+
+	local function checkoutFirst()
+		ticks = ticks + 1
+
+		first = pool:checkoutChunk([[
+			string.mutated = true
+			string.rep = nil
+			_G.leaked = true
+			package.loaded.leaked = true
+		]])
+		if first then
+			ticks = 0
+			nextTick(tryFirst)
+		else
+			assert(ticks < maxTicks, pool.lastError)
+			nextTick(checkoutFirst)
+		end
+	end
+
+	nextTick(checkoutFirst)
+end
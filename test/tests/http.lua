@@ -13,4 +13,39 @@ return function()
 		end
 	end
 	assert(foundContentType)
+
+	local client = HTTPClient.new("https://github.com")
+	for _ = 1, 2 do
+		local clientRes = assert(client:getSync("/robots.txt", {}))
+		assert(clientRes.status >= 200 and clientRes.status <= 299)
+	end
+	assert(client.numNewConnections == 1)
+	assert(client.numReusedConnections == 1)
+	assert(client.numIdleConnections == 1)
+	client:close()
+	assert(client.numIdleConnections == 0)
+
+	local asyncRes, asyncErr
+	assert(http.get("https://github.com", "/robots.txt", {}, function(res, err)
+		asyncRes = res
+		asyncErr = err
+	end))
+
+	local maxTicks = 600
+	local ticks = 0
+
+	local function try()
+		ticks = ticks + 1
+
+		if asyncRes then
+			assert(asyncRes.status >= 200 and asyncRes.status <= 299)
+			assert(asyncRes.body:find("Disallow"))
+		else
+			assert(not asyncErr, asyncErr)
+			assert(ticks < maxTicks)
+			nextTick(try)
+		end
+	end
+
+	nextTick(try)
 end
@@ -0,0 +1,46 @@
+return function()
+	local server = HTTPServer.new("127.0.0.1", 28090)
+	assert(server.isRunning)
+
+	server:publish("/status.json", '{"ok":true}', "application/json")
+
+	local res = assert(http.getSync("http://127.0.0.1:28090", "/status.json", {}))
+	assert(res.status == 200)
+	assert(res.body == '{"ok":true}')
+
+	server:route("POST", "/echo", function(req, response)
+		assert(req.method == "POST")
+		response.status = 201
+		response:send(req.body)
+		assert(response.isSent)
+	end)
+
+	local routeRes, missingRes
+	assert(http.post("http://127.0.0.1:28090", "/echo", {}, "hello", "text/plain", function(res)
+		routeRes = res
+	end))
+	assert(http.get("http://127.0.0.1:28090", "/missing", {}, function(res)
+		missingRes = res
+	end))
+
+	local maxTicks = 60
+	local ticks = 0
+
+	local function try()
+		ticks = ticks + 1
+
+		if routeRes and missingRes then
+			assert(routeRes.status == 201)
+			assert(routeRes.body == "hello")
+			assert(missingRes.status == 404)
+
+			server:stop()
+			assert(not server.isRunning)
+		else
+			assert(ticks < maxTicks)
+			nextTick(try)
+		end
+	end
+
+	nextTick(try)
+end
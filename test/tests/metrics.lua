@@ -0,0 +1,35 @@
+return function()
+	local counter = metrics.counter("test_events_total", "Events counted by the test")
+	counter:add()
+	counter:add(4)
+	assert(counter.value == 5)
+	assert(metrics.counter("test_events_total").value == 5)
+
+	local gauge = metrics.gauge('test_level{kind="a"}')
+	gauge:set(2.5)
+	gauge:add(-1)
+	assert(gauge.value == 1.5)
+
+	local histogram = metrics.histogram("test_duration_seconds", nil, { 0.1, 1 })
+	histogram:observe(0.05)
+	histogram:observe(5)
+	assert(histogram.count == 2)
+
+	-- Large and tiny values are rendered exactly
+	metrics.gauge("test_heap_bytes"):set(12345678)
+	local tinyHistogram = metrics.histogram("test_tiny_seconds", nil, { 1e-7, 2e-7 })
+	tinyHistogram:observe(1e-8)
+
+	assert(not pcall(metrics.gauge, "test_events_total"))
+
+	local text = metrics.render()
+	assert(text:find("# TYPE test_events_total counter\ntest_events_total 5\n", 1, true))
+	assert(text:find('test_level{kind="a"} 1.5', 1, true))
+	assert(text:find('test_duration_seconds_bucket{le="+Inf"} 2', 1, true))
+	assert(text:find("test_heap_bytes 12345678\n", 1, true))
+	assert(text:find('test_tiny_seconds_bucket{le="1e-07"} 1', 1, true))
+	assert(text:find('test_tiny_seconds_bucket{le="2e-07"} 1', 1, true))
+	assert(text:find("test_tiny_seconds_sum 1e-08\n", 1, true))
+	assert(text:find("rosaserver_hook_calls_total{hook=\"Logic\"}", 1, true))
+	assert(text:find("# TYPE rosaserver_bytes_sent_total counter", 1, true))
+end
@@ -0,0 +1,159 @@
+return function()
+	local graph = PointGraph.new(1024)
+
+	-- A square where going around the long way is cheaper than the diagonal
+	graph:addNode(0, 0, 0)
+	graph:addNode(10, 0, 0)
+	graph:addNode(10, 0, 10)
+	graph:addNode(0, 0, 10)
+	graph:addNode(50, 0, 50)
+	assert(graph:getSize() == 5)
+
+	graph:addLink(0, 1, 10)
+	graph:addLink(1, 2, 10)
+	graph:addLink(0, 3, 10)
+	graph:addLink(3, 2, 15)
+	graph:addLink(0, 2, 100)
+
+	local path = assert(graph:findShortestPath(0, 2))
+	assert(#path == 3)
+	assert(path[1] == 0 and path[2] == 1 and path[3] == 2)
+
+	assert(#graph:findShortestPath(2, 2) == 1)
+	assert(graph:findShortestPath(2, 0) == nil)
+	assert(graph:findShortestPath(0, 4) == nil)
+	assert(not pcall(graph.findShortestPath, graph, 0, 5))
+
+	assert(graph:getNodeByPoint(10, 0, 10) == 2)
+	assert(graph:getNodeByPoint(1, 2, 3) == nil)
+
+	do
+		-- Links far cheaper than the distance they cover still give the cheapest
+		-- path without a heuristic weight
+		local cheap = PointGraph.new(0)
+		cheap:addNode(0, 0, 0)
+		cheap:addNode(100, 0, 0)
+		cheap:addNode(0, 0, 100)
+		cheap:addLink(0, 1, 50)
+		cheap:addLink(0, 2, 1)
+		cheap:addLink(2, 1, 1)
+
+		local cheapPath = assert(cheap:findShortestPath(0, 1))
+		assert(#cheapPath == 3 and cheapPath[2] == 2)
+
+		cheap:freeze()
+		cheapPath = assert(cheap:findShortestPath(0, 1))
+		assert(#cheapPath == 3 and cheapPath[2] == 2)
+
+		assert(not pcall(PointGraph.new, 0, -1))
+
+		-- Nodes further apart than an int can hold
+		local far = PointGraph.new(0, 1)
+		far:addNode(-2147483647, 0, 0)
+		far:addNode(2147483647, 0, 0)
+		far:addLink(0, 1, 1)
+
+		local farPath = assert(far:findShortestPath(0, 1))
+		assert(#farPath == 2 and farPath[2] == 1)
+	end
+
+	assert(not graph.isFrozen)
+	assert(not pcall(graph.getNearestNode, graph, 0, 0, 0))
+	graph:freeze()
+	assert(graph.isFrozen)
+	assert(graph:getSize() == 5)
+	assert(not pcall(graph.addNode, graph, 1, 2, 3))
+	assert(not pcall(graph.addLink, graph, 4, 0, 10))
+
+	path = assert(graph:findShortestPath(0, 2))
+	assert(#path == 3)
+	assert(path[1] == 0 and path[2] == 1 and path[3] == 2)
+	assert(graph:findShortestPath(0, 4) == nil)
+	assert(graph:getNodeByPoint(50, 0, 50) == 4)
+
+	assert(graph:getNearestNode(9, 0, 1) == 1)
+	assert(graph:getNearestNode(40.5, 0, 40.5, 5) == nil)
+	assert(graph:getNearestNode(40.5, 0, 40.5, 20) == 4)
+
+	local nearby = graph:getNodesInRadius(0, 0, 0, 11)
+	assert(#nearby == 3)
+	assert(nearby[1] == 0)
+	assert(#graph:getNodesInRadius(100, 100, 100, 1) == 0)
+
+	-- No links lead back, so every node is its own component
+	assert(graph.numComponents == 5)
+	local component = graph:getNodeComponent(2)
+	assert(graph:getNearestNode(49, 0, 49, nil, component) == 2)
+	assert(#graph:getNodesInRadius(0, 0, 0, 100, component) == 1)
+
+	local asyncPath, asyncPaths
+	assert(graph:findPathAsync(0, 2, function(found)
+		asyncPath = found
+	end))
+	assert(graph:findPathsBatch({ { 0, 2 }, { 0, 4 }, { 3, 2 } }, function(found)
+		asyncPaths = found
+	end))
+	assert(not pcall(graph.findPathAsync, graph, 0, 5, function() end))
+
+	local unfrozen = PointGraph.new(0)
+	unfrozen:addNode(0, 0, 0)
+	assert(not pcall(unfrozen.findPathAsync, unfrozen, 0, 0, function() end))
+
+	local fileName = "pointGraph.bin"
+	graph:save(fileName)
+
+	local loaded = PointGraph.load(fileName, 1024)
+	assert(loaded.isFrozen)
+	assert(loaded:getSize() == 5)
+	assert(loaded:getNodeByPoint(10, 0, 10) == 2)
+
+	local x, y, z = loaded:getNodePoint(3)
+	assert(x == 0 and y == 0 and z == 10)
+
+	path = assert(loaded:findShortestPath(0, 2))
+	assert(#path == 3)
+	assert(path[1] == 0 and path[2] == 1 and path[3] == 2)
+
+	assert(os.remove(fileName))
+	assert(not pcall(PointGraph.load, fileName))
+
+	assert(not pcall(PointGraph.new(0).computeLandmarks, PointGraph.new(0), 2))
+	assert(not pcall(loaded.computeLandmarks, loaded, 0))
+
+	assert(loaded.numLandmarks == 0)
+	loaded:computeLandmarks(2)
+
+	local maxTicks = 600
+	local ticks = 0
+
+	local function try()
+		ticks = ticks + 1
+
+		if loaded.numLandmarks == 0 or not asyncPath or not asyncPaths then
+			assert(ticks < maxTicks)
+			nextTick(try)
+			return
+		end
+
+		assert(loaded.numLandmarks == 2)
+
+		assert(#asyncPath == 3 and asyncPath[2] == 1)
+		assert(#asyncPaths == 3)
+		assert(#asyncPaths[1] == 3)
+		assert(asyncPaths[2] == false)
+		assert(#asyncPaths[3] == 2)
+
+		path = assert(loaded:findShortestPath(0, 2))
+		assert(#path == 3)
+		assert(path[1] == 0 and path[2] == 1 and path[3] == 2)
+		assert(loaded:findShortestPath(0, 4) == nil)
+
+		loaded:save(fileName)
+		local reloaded = PointGraph.load(fileName)
+		assert(reloaded.numLandmarks == 2)
+		assert(#reloaded:findShortestPath(0, 2) == 3)
+		assert(os.remove(fileName))
+	end
+
+	nextTick(try)
+end
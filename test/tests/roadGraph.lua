@@ -0,0 +1,83 @@
+return function()
+	local roads = RoadGraph.new()
+	assert(roads.numIntersections == intersections.getCount())
+
+	local numLanes = 0
+	for _, street in ipairs(streets.getAll()) do
+		numLanes = numLanes + street.numLanes
+	end
+	assert(roads.numLanes == numLanes)
+
+	for id = 0, roads.numLanes - 1 do
+		local streetIndex, laneIndex, from, to = roads:getLane(id)
+		assert(roads:getLaneID(streetIndex, laneIndex) == id)
+		assert(from ~= to)
+
+		local route = assert(roads:findRoute(id, id))
+		assert(#route == 1 and route[1] == id)
+
+		local start = roads:getLanePoints(id)
+		local nearest, distance = roads:getNearestLane(start)
+		assert(nearest)
+		assert(distance < 0.01)
+
+		assert(roads:getIntersectionDistance(from, to) > 0)
+		local intersectionRoute = assert(roads:findIntersectionRoute(from, to))
+		assert(intersectionRoute[1] == from)
+		assert(intersectionRoute[#intersectionRoute] == to)
+	end
+
+	local lanes = {}
+	local streetsLeaving = {}
+	local shortestLanes = {}
+	for id = 0, roads.numLanes - 1 do
+		local streetIndex, _, from, to = roads:getLane(id)
+		local start, finish = roads:getLanePoints(id)
+		lanes[id] = { street = streetIndex, from = from, to = to }
+
+		streetsLeaving[from] = streetsLeaving[from] or {}
+		streetsLeaving[from][streetIndex] = true
+
+		local key = from .. " " .. to
+		shortestLanes[key] = math.min(shortestLanes[key] or math.huge, start:dist(finish))
+	end
+
+	-- Driving down a single lane costs just its length
+	for key, length in pairs(shortestLanes) do
+		local from, to = key:match("(%d+) (%d+)")
+		local distance = roads:getIntersectionDistance(tonumber(from), tonumber(to))
+		assert(distance <= length + 0.01)
+	end
+
+	-- Turning straight into a lane leaving the intersection a lane leads to is
+	-- always the cheapest route, unless it's a U-turn where another street
+	-- could be taken instead
+	local numTurns = 0
+	for id, lane in pairs(lanes) do
+		local hasOtherStreet = false
+		for streetIndex in pairs(streetsLeaving[lane.to] or {}) do
+			if streetIndex ~= lane.street then
+				hasOtherStreet = true
+			end
+		end
+
+		for nextID, nextLane in pairs(lanes) do
+			if nextID ~= id and nextLane.from == lane.to then
+				local route = roads:findRoute(id, nextID)
+				if nextLane.street ~= lane.street or not hasOtherStreet then
+					assert(route and #route == 2)
+					assert(route[1] == id and route[2] == nextID)
+					numTurns = numTurns + 1
+				else
+					assert(route == nil or #route > 2)
+				end
+			end
+		end
+	end
+	assert(numTurns > 0)
+
+	assert(roads:getIntersectionDistance(0, 0) == 0)
+	assert(roads:getNearestLane(Vector(1e6, 0, 1e6), 10) == nil)
+	assert(not pcall(roads.getLane, roads, roads.numLanes))
+	assert(not pcall(roads.getIntersectionDistance, roads, 0, roads.numIntersections))
+end
@@ -0,0 +1,39 @@
+return function()
+	local shared = { name = "shared" }
+	local value = {
+		1,
+		2.5,
+		"three",
+		true,
+		nested = { a = shared, b = shared, big = 2 ^ 40, negative = -7 },
+		[false] = "key",
+	}
+	value.self = value
+
+	local bytes = serial.encode(value)
+	local decoded = serial.decode(bytes)
+
+	assert(decoded[1] == 1)
+	assert(decoded[2] == 2.5)
+	assert(decoded[3] == "three")
+	assert(decoded[4] == true)
+	assert(decoded[false] == "key")
+	assert(decoded.nested.big == 2 ^ 40)
+	assert(decoded.nested.negative == -7)
+	assert(decoded.nested.a.name == "shared")
+	assert(decoded.nested.a == decoded.nested.b)
+	assert(decoded.self == decoded)
+
+	assert(serial.decode(serial.encode(nil)) == nil)
+	assert(serial.decode(serial.encode("plain")) == "plain")
+
+	local buffer = SerialBuffer.new()
+	assert(serial.encodeInto(buffer, value) == #bytes)
+	assert(buffer:toString() == bytes)
+	assert(serial.decode(buffer).nested.a.name == "shared")
+	assert(serial.decode(buffer:toSharedBuffer())[3] == "three")
+
+	assert(not pcall(serial.encode, print))
+	assert(not pcall(serial.decode, "\1\6"))
+	assert(not pcall(serial.decode, "\99\0"))
+end
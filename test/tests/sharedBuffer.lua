@@ -0,0 +1,17 @@
+return function()
+	local buffer = SharedBuffer.new(string.char(1, 2, 3, 4, 255) .. "hello")
+
+	assert(buffer.size == 10)
+	assert(buffer:readU8(0) == 1)
+	assert(buffer:readU32(0) == 0x04030201)
+	assert(buffer:readI8(4) == -1)
+	assert(buffer:sub(5, 5) == "hello")
+	assert(buffer:toString():sub(6) == "hello")
+	assert(not pcall(buffer.readU32, buffer, 8))
+	assert(buffer.useCount == 1)
+
+	local ffi = require("ffi")
+	local bytes = ffi.cast("const uint8_t*", buffer.address)
+	assert(bytes[1] == 2)
+	assert(tonumber(ffi.cast("uintptr_t", buffer.address)) % 64 == 0)
+end
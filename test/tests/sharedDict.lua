@@ -0,0 +1,38 @@
+return function()
+	local dict = SharedDict.open("tests.sharedDict")
+	dict:clear()
+
+	local version = dict.version
+
+	dict:set("name", "rosa")
+	dict:set("enabled", true)
+	assert(dict:get("name") == "rosa")
+	assert(dict:get("enabled") == true)
+	assert(dict:get("missing") == nil)
+	assert(dict.version > version)
+
+	assert(dict:incr("count") == 1)
+	assert(dict:incr("count", 4) == 5)
+	assert(not pcall(dict.incr, dict, "name"))
+
+	assert(dict:cas("count", 5, 6))
+	assert(not dict:cas("count", 5, 7))
+	assert(dict:get("count") == 6)
+	assert(dict:cas("new", nil, "created"))
+	assert(not dict:cas("new", nil, "again"))
+
+	-- Same store from a second handle
+	assert(SharedDict.open("tests.sharedDict"):get("new") == "created")
+
+	dict:set("temporary", 1, 0.01)
+	assert(dict:get("temporary") == 1)
+
+	assert(dict:remove("name"))
+	assert(not dict:remove("name"))
+	assert(dict.size == 4)
+
+	nextTick(function()
+		assert(dict:get("temporary") == nil)
+		assert(dict.size == 3)
+	end, 5)
+end
@@ -44,5 +44,154 @@ return function()
 		assert(row[4] == "ACGT\0ACGT\1")
 	end
 
+	do
+		local rows = assert(db:query("select typeof(?), typeof(?);", 7, 7.5))
+		assert(rows[1][1] == "integer")
+		assert(rows[1][2] == "real")
+	end
+
+	do
+		local rows = assert(db:query("select typeof(?), ?;", -2 ^ 63, -2 ^ 63))
+		assert(rows[1][1] == "integer")
+		assert(rows[1][2] == -2 ^ 63)
+	end
+
+	do
+		local _, err = db:query("-- nothing")
+		assert(err == "No statement")
+	end
+
+	do
+		-- The same SQL again comes from the statement cache
+		for age = 60, 62 do
+			assert(db:query("insert into people (age) values (?);", age) == 1)
+		end
+
+		local rows = assert(db:query("select count(*) from people where age >= ?;", 60))
+		assert(rows[1][1] == 3)
+	end
+
+	do
+		local _, err = db:prepare("hello")
+		assert(err == 'near "hello": syntax error')
+
+		local statement = assert(db:prepare("select name from people where age = ?;"))
+		assert(statement.sql == "select name from people where age = ?;")
+
+		local rows = assert(statement:query(50))
+		assert(#rows == 1 and rows[1][1] == "John Smith")
+
+		rows = assert(statement:query(25))
+		assert(#rows == 1 and rows[1][1] == nil)
+
+		statement:close()
+		local _, closedErr = statement:query(50)
+		assert(closedErr)
+	end
+
+	local statement = assert(db:prepare("select 1;"))
+
 	db:close()
+
+	local _, closedErr = db:query("select 1;")
+	assert(closedErr)
+	assert(not statement:query())
+
+	do
+		local _, memoryErr = pcall(function()
+			SQLite.new(":memory:"):queryAsync("select 1;")
+		end)
+		assert(memoryErr)
+	end
+
+	local fileName = "sqliteAsync.db"
+	os.remove(fileName)
+
+	local asyncDB = SQLite.new(fileName)
+	local results = {}
+
+	asyncDB:queryAsync("create table people (name text, age integer);")
+	for age = 1, 3 do
+		asyncDB:queryAsync("insert into people (name, age) values (?, ?);", "Person " .. age, age, function(changes)
+			table.insert(results, changes)
+		end)
+	end
+	asyncDB:queryAsync("select name, age from people order by age;", function(rows)
+		table.insert(results, rows)
+	end)
+	asyncDB:queryAsync("hello", function(rows, err)
+		table.insert(results, err)
+	end)
+	asyncDB:queryAsync("-- nothing", function(rows, err)
+		table.insert(results, err)
+	end)
+
+	-- Everything has been written, but callbacks wait for the next tick
+	asyncDB:flush()
+	assert(#results == 0)
+	local rows = assert(asyncDB:query("select count(*) from people;"))
+	assert(rows[1][1] == 3)
+
+	do
+		local walFileName = "sqliteWAL.db"
+		os.remove(walFileName)
+
+		local walDB = SQLite.new(walFileName)
+		walDB:queryAsync("create table counts (n integer);")
+		walDB:flush()
+
+		-- Reads on the game's connection don't fail while the worker is writing
+		local lastCount = 0
+		for n = 1, 200 do
+			walDB:queryAsync("insert into counts (n) values (?);", n)
+			local countRows = assert(walDB:query("select count(*) from counts;"))
+			assert(countRows[1][1] >= lastCount and countRows[1][1] <= n)
+			lastCount = countRows[1][1]
+		end
+
+		local modeRows = assert(walDB:query("pragma journal_mode;"))
+		assert(modeRows[1][1] == "wal")
+
+		walDB:flush()
+		local countRows = assert(walDB:query("select count(*) from counts;"))
+		assert(countRows[1][1] == 200)
+
+		-- The queued insert can't commit until this transaction ends
+		assert(walDB:query("begin immediate;"))
+		walDB:queryAsync("insert into counts (n) values (?);", 201)
+		assert(not pcall(walDB.flush, walDB))
+		assert(not pcall(walDB.close, walDB))
+		assert(walDB:query("rollback;"))
+
+		walDB:close()
+
+		-- Collecting it mid-transaction rolls back instead of waiting on the queue
+		local collectedDB = SQLite.new(walFileName)
+		collectedDB:queryAsync("insert into counts (n) values (?);", 0)
+		collectedDB:flush()
+		assert(collectedDB:query("begin immediate;"))
+		for n = 1, 3 do
+			collectedDB:queryAsync("insert into counts (n) values (?);", n)
+		end
+		collectedDB = nil
+
+		local startTime = os.realClock()
+		collectgarbage()
+		assert(os.realClock() - startTime < 1)
+
+		os.remove(walFileName)
+	end
+
+	nextTick(function()
+		assert(#results == 6)
+		assert(results[1] == 1 and results[2] == 1 and results[3] == 1)
+		assert(#results[4] == 3)
+		assert(results[4][2][1] == "Person 2" and results[4][2][2] == 2)
+		assert(results[5] == 'near "hello": syntax error')
+		assert(results[6] == "No statement")
+
+		asyncDB:close()
+		assert(not pcall(asyncDB.queryAsync, asyncDB, "select 1;"))
+		os.remove(fileName)
+	end)
 end
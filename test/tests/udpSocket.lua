@@ -0,0 +1,49 @@
+return function()
+	local receiver = UDPSocket.new(0)
+	local sender = UDPSocket.new()
+
+	assert(receiver.isOpen)
+	assert(receiver.port ~= 0)
+
+	-- Too long to read whole, so it's dropped
+	assert(sender:send("127.0.0.1", receiver.port, ("x"):rep(5000)) == 5000)
+	assert(sender:send("127.0.0.1", receiver.port, "hello") == 5)
+
+	local sent = sender:sendMany({
+		{ "127.0.0.1", receiver.port, "a" },
+		{ "127.0.0.1", receiver.port, "bb" },
+		{ "127.0.0.1", receiver.port, "ccc" },
+	})
+	assert(sent == 3)
+
+	local results = {}
+
+	local maxTicks = 10
+	local ticks = 0
+
+	local function try()
+		ticks = ticks + 1
+
+		receiver:receiveMany(64, results)
+		if #results > 0 then
+			assert(#results == 4)
+			assert(results[1].data == "hello")
+			assert(results[1].address == "127.0.0.1")
+			assert(results[1].port == sender.port)
+			assert(results[4].data == "ccc")
+			assert(receiver.numTruncated == 1)
+
+			receiver:receiveMany(64, results)
+			assert(#results == 0)
+
+			receiver:close()
+			sender:close()
+			assert(not receiver.isOpen)
+		else
+			assert(ticks < maxTicks)
+			nextTick(try)
+		end
+	end
+
+	nextTick(try)
+end
@@ -2,20 +2,72 @@ return function()
 	local worker = assert(Worker.new("tests/worker.worker.lua"))
 
 	assert(not worker:receiveMessage())
-	worker:sendMessage("hi")
+	assert(worker:sendMessage("hi"))
 
 	local maxTicks = 10
 	local ticks = 0
 
-	local function try()
+	local batch = {}
+	local items = {}
+	local buffer = SharedBuffer.new("shared bytes")
+
+	local function tryBuffer()
 		ticks = ticks + 1
 
 		local message = worker:receiveMessage()
 		if message then
-			assert(message == "hello")
+			-- Same block of memory, not a copy
+			assert(message.address == buffer.address)
+			assert(message:toString() == "shared bytes")
 
 			worker:stop()
 			worker = nil
+		else
+			assert(ticks < maxTicks)
+			nextTick(tryBuffer)
+		end
+	end
+
+	local function tryBatch()
+		ticks = ticks + 1
+
+		-- The worker may still be sending, so they can arrive over several ticks
+		worker:receiveMessages(16, batch)
+		for _, item in ipairs(batch) do
+			table.insert(items, item)
+		end
+
+		if #items == 3 then
+			assert(items[1] == "item1")
+			assert(items[2] == "item2")
+			assert(items[3] == "item3")
+
+			worker:receiveMessages(16, batch)
+			assert(#batch == 0)
+
+			assert(worker.numSendDropped == 0)
+			assert(worker.receiveHighWater >= 1)
+
+			ticks = 0
+			assert(worker:sendMessage(buffer))
+			nextTick(tryBuffer)
+		else
+			assert(#items < 3)
+			assert(ticks < maxTicks)
+			nextTick(tryBatch)
+		end
+	end
+
+	local function try()
+		ticks = ticks + 1
+
+		local message = worker:receiveMessage()
+		if message then
+			assert(message == "hello")
+
+			ticks = 0
+			assert(worker:sendMessage("batch"))
+			nextTick(tryBatch)
 		else
 			assert(ticks < maxTicks)
 			nextTick(try)
@@ -1,6 +1,33 @@
+local timer = addTimer(5)
+
+-- "hi" may already be queued, which makes wait return straight away with a
+-- message event until the timer fires
+local timerFired = false
+local deadline = os.realClock() + 1
+while not timerFired do
+	assert(os.realClock() < deadline)
+	for _, event in ipairs(wait(1000)) do
+		if event.type == "timer" then
+			assert(event.id == timer)
+			timerFired = true
+		end
+	end
+end
+removeTimer(timer)
+
 while true do
-	if receiveMessage() == "hi" then
+	local message = receiveMessage(-1)
+	if not message then
+		break
+	end
+
+	if type(message) ~= "string" then
+		sendMessage(message)
+	elseif message == "hi" then
 		sendMessage("hello")
+	elseif message == "batch" then
+		for i = 1, 3 do
+			sendMessage("item" .. i)
+		end
 	end
-	sleep(1)
 end
@@ -0,0 +1,42 @@
+return function()
+	local pool = WorkerPool.new(2, "tests/workerPool.worker.lua")
+	assert(pool.numThreads == 2)
+
+	local ids = pool:map("square", { 1, 2, 3, 4 })
+	assert(#ids == 4)
+	local failID = pool:submit("fail")
+	local missingID = pool:submit("missing", "x")
+	assert(pool.numPending == 6)
+
+	local results = {}
+	local errors = {}
+
+	local maxTicks = 20
+	local ticks = 0
+
+	local function try()
+		ticks = ticks + 1
+
+		for _, job in ipairs(pool:poll()) do
+			if job.error then
+				errors[job.id] = job.error
+			else
+				results[job.id] = job.result
+			end
+		end
+
+		if pool.numPending == 0 then
+			for i, id in ipairs(ids) do
+				assert(results[id] == i * i)
+			end
+			assert(errors[failID]:find("failed on purpose"))
+			assert(errors[missingID])
+			pool = nil
+		else
+			assert(ticks < maxTicks)
+			nextTick(try)
+		end
+	end
+
+	nextTick(try)
+end
@@ -0,0 +1,11 @@
+local module = {}
+
+function module.square(n)
+	return n * n
+end
+
+function module.fail()
+	error("failed on purpose")
+end
+
+return module
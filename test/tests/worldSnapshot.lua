@@ -0,0 +1,32 @@
+return function()
+	local snapshot = WorldSnapshot.new()
+	assert(snapshot.size > 0)
+	assert(not pcall(snapshot.isHumanActive, snapshot, 256))
+	assert(not pcall(snapshot.isVehicleActive, snapshot, 512))
+
+	local man = humans.create(Vector(20, 40, 20), RotMatrix(1, 0, 0, 0, 1, 0, 0, 0, 1), players[0])
+
+	nextTick(function()
+		assert(snapshot:update())
+		assert(not snapshot:update())
+		assert(snapshot.tick == WorldSnapshot.getLatestTick())
+		assert(snapshot.numActiveHumans >= 1)
+
+		local index = man.index
+		assert(snapshot:isHumanActive(index))
+		assert(snapshot:getHumanHealth(index) == man.health)
+
+		local pos = snapshot:getHumanPos(index)
+		assert(math.abs(pos.x - 20) < 1)
+		assert(math.abs(pos.z - 20) < 1)
+
+		local ffi = require("ffi")
+		pcall(ffi.cdef, WorldSnapshot.cdef)
+		local data = ffi.cast("const SnapshotData*", snapshot.address)
+		assert(data.tick == snapshot.tick)
+		assert(data.humans[index].active == 1)
+		assert(data.humans[index].pos.x == pos.x)
+
+		man:remove()
+	end, 2)
+end